@@ -0,0 +1,51 @@
+// 거의 정렬된 순서(타임스탬프)로 들어오는 key: rbtree_insert / 직전 노드를 hint로 준 rbtree_insert_hint
+// 그리고 최솟값/최댓값 조회를 반복하는 비용
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// i번째 key는 대략 4i (앞뒤로 조금씩 섞임)
+static key_t *timestamps(size_t n, int jitter) {
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(1);
+  for (size_t i = 0; i < n; i++) keys[i] = (key_t)(4 * i) + (jitter > 0 ? rand() % jitter : 0);
+  return keys;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  const int jitters[] = {0, 8, 64};
+  for (size_t k = 0; k < sizeof(jitters) / sizeof(jitters[0]); k++) {
+    key_t *keys = timestamps(n, jitters[k]);
+
+    rbtree *t = new_rbtree_with_capacity(n);
+    double start = now_sec();
+    for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+    double plain = now_sec() - start;
+
+    rbtree *u = new_rbtree_with_capacity(n);
+    node_t *hint = NULL;
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) hint = rbtree_insert_hint(u, hint, keys[i]);
+    double hinted = now_sec() - start;
+
+    printf("n=%zu jitter=%2d: insert %6.1f ns/op, insert_hint %6.1f ns/op\n", n, jitters[k], plain / n * 1e9,
+           hinted / n * 1e9);
+    delete_rbtree(u);
+    delete_rbtree(t);
+    free(keys);
+  }
+
+  key_t *keys = timestamps(n, 0);
+  rbtree *t = rbtree_build_from_sorted(keys, n);
+  long sum = 0;
+  double start = now_sec();
+  for (size_t i = 0; i < n; i++) sum += rbtree_min(t)->key + rbtree_max(t)->key;
+  double ends = now_sec() - start;
+  printf("n=%zu min + max: %6.1f ns/op (%ld)\n", n, ends / n * 1e9, sum % 10);
+  delete_rbtree(t);
+  free(keys);
+  return 0;
+}
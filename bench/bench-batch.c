@@ -0,0 +1,64 @@
+// 묶음 삽입/삭제와 key 하나씩 호출하는 경우의 처리량 비교
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// 순차: base부터 연속된 key, 군집: base 근처 좁은 구간의 무작위 key
+static void make_batch(key_t *keys, size_t n, key_t base, int clustered) {
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = clustered ? base + rand() % (int)(4 * n) : base + (key_t)i;
+  }
+}
+
+static void run(const char *name, size_t initial, size_t batch, size_t rounds, int clustered) {
+  key_t *keys = malloc(batch * sizeof(key_t));
+  double loop_ins = 0, batch_ins = 0, loop_del = 0, batch_del = 0;
+
+  for (int mode = 0; mode < 2; mode++) {
+    rbtree *t = new_rbtree();
+    srand(7);
+    for (size_t i = 0; i < initial; i++) rbtree_insert(t, rand());
+    for (size_t r = 0; r < rounds; r++) {
+      make_batch(keys, batch, rand(), clustered);
+      double start = now_sec();
+      if (mode == 0) {
+        for (size_t i = 0; i < batch; i++) rbtree_insert(t, keys[i]);
+      } else {
+        rbtree_insert_batch(t, keys, batch);
+      }
+      double mid = now_sec();
+      if (mode == 0) {
+        for (size_t i = 0; i < batch; i++) rbtree_erase(t, rbtree_find(t, keys[i]));
+      } else {
+        rbtree_erase_keys_batch(t, keys, batch);
+      }
+      double end = now_sec();
+      if (mode == 0) {
+        loop_ins += mid - start;
+        loop_del += end - mid;
+      } else {
+        batch_ins += mid - start;
+        batch_del += end - mid;
+      }
+    }
+    delete_rbtree(t);
+  }
+
+  double ops = (double)batch * rounds;
+  printf("%-10s insert: loop %8.2f Mops/s, batch %8.2f Mops/s | erase: loop %8.2f Mops/s, batch %8.2f Mops/s\n",
+         name, ops / loop_ins / 1e6, ops / batch_ins / 1e6, ops / loop_del / 1e6, ops / batch_del / 1e6);
+  free(keys);
+}
+
+int main(int argc, char *argv[]) {
+  size_t initial = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t batch = argc > 2 ? strtoul(argv[2], NULL, 10) : 4096;
+  size_t rounds = argc > 3 ? strtoul(argv[3], NULL, 10) : 200;
+
+  printf("initial=%zu batch=%zu rounds=%zu\n", initial, batch, rounds);
+  run("sequential", initial, batch, rounds, 0);
+  run("clustered", initial, batch, rounds, 1);
+  return 0;
+}
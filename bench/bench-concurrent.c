@@ -0,0 +1,97 @@
+// 여러 스레드의 읽기 위주 작업: 전역 mutex 하나 / rwlock 하나 / 구간별 shard
+// 스레드마다 90% find, 5% insert, 5% erase
+#include "rbtree.h"
+#include "rbtree_concurrent.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEY_RANGE (1 << 20)
+#define SHARDS 16
+
+enum { MUTEX, RWLOCK, SHARDED };
+
+typedef struct {
+  int kind;
+  size_t ops;
+  unsigned seed;
+} worker_arg;
+
+static pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+static rbtree *global_tree;
+static rbtree_rw *rw;
+static rbtree_sharded *sharded;
+
+static void *worker(void *arg) {
+  worker_arg *a = (worker_arg *)arg;
+  unsigned seed = a->seed;
+  size_t hits = 0;
+  for (size_t i = 0; i < a->ops; i++) {
+    const int r = rand_r(&seed);
+    const key_t key = r % KEY_RANGE;
+    const int op = (r >> 20) % 20;  // 0: insert, 1: erase, 나머지: find
+    switch (a->kind) {
+      case MUTEX:
+        pthread_mutex_lock(&global_lock);
+        if (op == 0) rbtree_insert(global_tree, key);
+        else if (op == 1) rbtree_erase_key(global_tree, key);
+        else hits += rbtree_find(global_tree, key) != NULL;
+        pthread_mutex_unlock(&global_lock);
+        break;
+      case RWLOCK:
+        if (op == 0) rbtree_rw_insert(rw, key);
+        else if (op == 1) rbtree_rw_erase(rw, key);
+        else hits += rbtree_rw_find(rw, key);
+        break;
+      default:
+        if (op == 0) rbtree_sharded_insert(sharded, key);
+        else if (op == 1) rbtree_sharded_erase(sharded, key);
+        else hits += rbtree_sharded_find(sharded, key);
+    }
+  }
+  return (void *)hits;
+}
+
+static double run(int kind, int threads, size_t ops) {
+  pthread_t th[64];
+  worker_arg args[64];
+  double start = now_sec();
+  for (int i = 0; i < threads; i++) {
+    args[i] = (worker_arg){kind, ops / threads, 29u * (i + 1)};
+    pthread_create(&th[i], NULL, worker, &args[i]);
+  }
+  for (int i = 0; i < threads; i++) pthread_join(th[i], NULL);
+  return ops / (now_sec() - start) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+  size_t ops = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000000;
+  global_tree = new_rbtree();
+  rw = new_rbtree_rw(NULL);
+  sharded = new_rbtree_sharded(SHARDS, 0, KEY_RANGE, NULL);
+  // 절반쯤 채운 상태에서 시작
+  srand(17);
+  for (int i = 0; i < KEY_RANGE / 2; i++) {
+    const key_t key = rand() % KEY_RANGE;
+    rbtree_insert(global_tree, key);
+    rbtree_rw_insert(rw, key);
+    rbtree_sharded_insert(sharded, key);
+  }
+
+  const int counts[] = {1, 2, 4, 8};
+  for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+    const int threads = counts[i];
+    double a = run(MUTEX, threads, ops);
+    double b = run(RWLOCK, threads, ops);
+    double c = run(SHARDED, threads, ops);
+    printf("threads=%d 90%% find: mutex %5.2f Mops/s, rwlock %5.2f Mops/s, sharded/%d %5.2f Mops/s\n",
+           threads, a, b, SHARDS, c);
+  }
+
+  delete_rbtree_sharded(sharded);
+  delete_rbtree_rw(rw);
+  delete_rbtree(global_tree);
+  return 0;
+}
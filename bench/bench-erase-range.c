@@ -0,0 +1,50 @@
+// 오래된 key 지우기: [lo, hi)의 원소를 find + erase로 하나씩 / rbtree_erase_range로 한 번에
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// 0..n-1을 섞어서 넣은 트리
+static rbtree *shuffled_tree(size_t n) {
+  key_t *keys = malloc(n * sizeof(key_t));
+  for (size_t i = 0; i < n; i++) keys[i] = (key_t)i;
+  srand(1);
+  for (size_t i = n; i > 1; i--) {
+    size_t j = (size_t)rand() % i;
+    key_t tmp = keys[i - 1];
+    keys[i - 1] = keys[j];
+    keys[j] = tmp;
+  }
+  rbtree *t = new_rbtree_with_capacity(n);
+  for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+  free(keys);
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  const size_t widths[] = {16, 1000, n / 10, n / 2};
+  for (size_t k = 0; k < sizeof(widths) / sizeof(widths[0]); k++) {
+    const key_t lo = (key_t)(n / 4), hi = lo + (key_t)widths[k];
+
+    rbtree *t = shuffled_tree(n);
+    double start = now_sec();
+    for (key_t key = lo; key < hi; key++) {
+      node_t *p = rbtree_find(t, key);
+      if (p != NULL) rbtree_erase(t, p);
+    }
+    double loop = now_sec() - start;
+    delete_rbtree(t);
+
+    t = shuffled_tree(n);
+    start = now_sec();
+    size_t erased = rbtree_erase_range(t, lo, hi);
+    double range = now_sec() - start;
+    delete_rbtree(t);
+
+    printf("n=%zu erase %8zu keys: find + erase %9.3f ms, erase_range %8.3f ms\n", n, erased, loop * 1e3,
+           range * 1e3);
+  }
+  return 0;
+}
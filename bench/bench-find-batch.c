@@ -0,0 +1,57 @@
+// rbtree_find 반복 vs rbtree_find_batch/rbtree_contains_batch (LLC보다 큰 트리에서 메모리 지연이 겹치는지)
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 4000000;
+
+  rbtree *t = new_rbtree_with_capacity(n);
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(5);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+    rbtree_insert(t, keys[i]);
+  }
+  //절반은 있는 key, 절반은 무작위 key(대부분 없음)
+  key_t *q = malloc(queries * sizeof(key_t));
+  for (size_t i = 0; i < queries; i++) q[i] = i % 2 ? keys[(size_t)rand() % n] : rand();
+  node_t **out = malloc(queries * sizeof(node_t *));
+  unsigned char *flags = malloc(queries);
+
+  size_t found = 0;
+  double start = now_sec();
+  for (size_t i = 0; i < queries; i++) found += rbtree_find(t, q[i]) != NULL;
+  double loop = now_sec() - start;
+  printf("n=%zu queries=%zu\n", n, queries);
+  printf("rbtree_find loop:      %7.1f ns/key (found %zu)\n", loop / queries * 1e9, found);
+
+  //요청 하나에 key가 몇 개씩 들어오는 경우를 흉내 내어 묶음 크기별로 잼
+  const size_t chunks[] = {16, 256, queries};
+  for (int c = 0; c < 3; c++) {
+    found = 0;
+    start = now_sec();
+    for (size_t i = 0; i < queries; i += chunks[c]) {
+      size_t m = queries - i < chunks[c] ? queries - i : chunks[c];
+      found += rbtree_find_batch(t, q + i, m, out + i);
+    }
+    double sec = now_sec() - start;
+    printf("rbtree_find_batch %-7zu %7.1f ns/key (found %zu, %.2fx)\n", chunks[c], sec / queries * 1e9, found,
+           loop / sec);
+  }
+
+  start = now_sec();
+  found = rbtree_contains_batch(t, q, queries, flags);
+  double sec = now_sec() - start;
+  printf("rbtree_contains_batch: %7.1f ns/key (found %zu, %.2fx)\n", sec / queries * 1e9, found, loop / sec);
+
+  free(flags);
+  free(out);
+  free(q);
+  free(keys);
+  delete_rbtree(t);
+  return 0;
+}
@@ -0,0 +1,40 @@
+// 노드 레이아웃별 rbtree_find 속도 비교 (레이아웃은 빌드 옵션으로 선택)
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(RBTREE_INDEX32)
+#define LAYOUT "index32"
+#elif defined(RBTREE_COMPACT)
+#define LAYOUT "compact"
+#else
+#define LAYOUT "default"
+#endif
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 4000000;
+
+  rbtree *t = new_rbtree_with_capacity(n);
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(3);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+    rbtree_insert(t, keys[i]);
+  }
+
+  size_t found = 0;
+  double start = now_sec();
+  for (size_t i = 0; i < queries; i++) {
+    found += rbtree_find(t, keys[(size_t)rand() % n]) != NULL;
+  }
+  double elapsed = now_sec() - start;
+
+  printf("%-8s node=%2zu bytes n=%zu: %7.1f ns/find (found %zu)\n", LAYOUT, t->pool.stride, n,
+         elapsed / queries * 1e9, found);
+  free(keys);
+  delete_rbtree(t);
+  return 0;
+}
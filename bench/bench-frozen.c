@@ -0,0 +1,81 @@
+// rbtree_find vs 정렬 배열 이진 탐색 vs rbtree_freeze한 정적 B+ 트리 (블록 비교 방식은 빌드 옵션으로 선택)
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(RBTREE_NO_SIMD)
+#define SEARCH "scalar"
+#elif defined(__AVX2__)
+#define SEARCH "avx2"
+#else
+#define SEARCH "sse2"
+#endif
+
+// 분기 없는 이진 탐색 (rbtree_view_lower_bound와 같은 방식)
+static size_t array_lower_bound(const key_t *keys, size_t n, const key_t key) {
+  const key_t *base = keys;
+  while (n > 1) {
+    const size_t half = n / 2;
+    if (base[half - 1] < key) base += half;
+    n -= half;
+  }
+  return (size_t)(base - keys) + (n == 1 && *base < key);
+}
+
+int main(int argc, char *argv[]) {
+#if defined(__AVX2__) && !defined(RBTREE_NO_SIMD)
+  //AVX2로 빌드한 바이너리를 AVX2가 없는 CPU에서 돌리면 SIGILL로 죽으므로 건너뜀
+  if (!__builtin_cpu_supports("avx2")) {
+    printf("skipped: this CPU does not support AVX2\n");
+    return 0;
+  }
+#endif
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 4000000;
+
+  rbtree *t = new_rbtree_with_capacity(n);
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(7);
+  for (size_t i = 0; i < n; i++) {
+    keys[i] = rand();
+    rbtree_insert(t, keys[i]);
+  }
+  key_t *q = malloc(queries * sizeof(key_t));
+  for (size_t i = 0; i < queries; i++) q[i] = keys[(size_t)rand() % n];
+
+  double start = now_sec();
+  rbtree_frozen *f = rbtree_freeze(t);
+  double freeze = now_sec() - start;
+
+  size_t found = 0;
+  start = now_sec();
+  for (size_t i = 0; i < queries; i++) found += rbtree_find(t, q[i]) != NULL;
+  double tree = now_sec() - start;
+
+  size_t found_array = 0;
+  start = now_sec();
+  for (size_t i = 0; i < queries; i++) {
+    size_t j = array_lower_bound(f->keys, f->n, q[i]);
+    found_array += j < f->n && f->keys[j] == q[i];
+  }
+  double array = now_sec() - start;
+
+  size_t found_frozen = 0;
+  start = now_sec();
+  for (size_t i = 0; i < queries; i++) found_frozen += rbtree_frozen_find(f, q[i]) >= 0;
+  double frozen = now_sec() - start;
+
+  printf("n=%zu queries=%zu, freeze %.1f ms (%d index levels, %s)\n", n, queries, freeze * 1e3, f->levels, SEARCH);
+  printf("rbtree_find:        %7.1f ns/find (found %zu)\n", tree / queries * 1e9, found);
+  printf("binary search:      %7.1f ns/find (found %zu, %.2fx)\n", array / queries * 1e9, found_array, tree / array);
+  printf("rbtree_frozen_find: %7.1f ns/find (found %zu, %.2fx)\n", frozen / queries * 1e9, found_frozen,
+         tree / frozen);
+
+  delete_rbtree_frozen(f);
+  free(q);
+  free(keys);
+  delete_rbtree(t);
+  return 0;
+}
@@ -0,0 +1,58 @@
+// 비교 방식별 find 속도 비교: int API / RBTREE_DEFINE(인라인 비교) / rbtree_any(함수 포인터)
+#include "rbtree.h"
+#include "rbtree_generic.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static inline int int_cmp(int a, int b) { return (a > b) - (a < b); }
+RBTREE_DEFINE(itree, int, int_cmp)
+
+static int int_ptr_cmp(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000000;
+
+  key_t *keys = malloc(n * sizeof(key_t));
+  size_t *order = malloc(queries * sizeof(size_t));
+  srand(5);
+  for (size_t i = 0; i < n; i++) keys[i] = rand();
+  for (size_t i = 0; i < queries; i++) order[i] = (size_t)rand() % n;
+
+  rbtree *t = new_rbtree_with_capacity(n);
+  itree *it = itree_new();
+  rbtree_any *at = rbtree_any_new(int_ptr_cmp);
+  for (size_t i = 0; i < n; i++) {
+    rbtree_insert(t, keys[i]);
+    itree_insert(it, keys[i]);
+    rbtree_any_insert(at, &keys[i]);
+  }
+
+  size_t found = 0;
+  double start = now_sec();
+  for (size_t i = 0; i < queries; i++) found += rbtree_find(t, keys[order[i]]) != NULL;
+  double int_api = now_sec() - start;
+
+  start = now_sec();
+  for (size_t i = 0; i < queries; i++) found += itree_find(it, keys[order[i]]) != NULL;
+  double inlined = now_sec() - start;
+
+  start = now_sec();
+  for (size_t i = 0; i < queries; i++) found += rbtree_any_find(at, &keys[order[i]]) != NULL;
+  double any = now_sec() - start;
+
+  printf("n=%zu find: int API %6.1f ns, RBTREE_DEFINE %6.1f ns, rbtree_any %6.1f ns (found %zu)\n", n,
+         int_api / queries * 1e9, inlined / queries * 1e9, any / queries * 1e9, found);
+
+  rbtree_any_delete(at);
+  itree_delete(it);
+  delete_rbtree(t);
+  free(order);
+  free(keys);
+  return 0;
+}
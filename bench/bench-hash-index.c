@@ -0,0 +1,57 @@
+// 해시 색인을 켠 트리와 끈 트리의 rbtree_find, rbtree_erase_key, 삽입 비교 (색인이 쓰는 메모리도 출력)
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 4000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 4000000;
+
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(9);
+  for (size_t i = 0; i < n; i++) keys[i] = rand();
+  //절반은 있는 key, 절반은 무작위 key(대부분 없음)
+  key_t *q = malloc(queries * sizeof(key_t));
+  for (size_t i = 0; i < queries; i++) q[i] = i % 2 ? keys[(size_t)rand() % n] : rand();
+
+  printf("n=%zu queries=%zu\n", n, queries);
+  double base[3] = {0};
+  for (int indexed = 0; indexed < 2; indexed++) {
+    rbtree_options opts = {0};
+    opts.capacity = n;
+    opts.hash_index = indexed;
+    rbtree *t = new_rbtree_opts(&opts);
+
+    double start = now_sec();
+    for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+    double sec[3];
+    sec[0] = now_sec() - start;
+    const size_t memory = rbtree_hash_index_memory(t);
+
+    size_t found = 0;
+    start = now_sec();
+    for (size_t i = 0; i < queries; i++) found += rbtree_find(t, q[i]) != NULL;
+    sec[1] = now_sec() - start;
+
+    //넣은 순서대로 지움 (트리에서 지우는 비용은 그대로이고 찾는 비용만 달라짐)
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) rbtree_erase_key(t, keys[i]);
+    sec[2] = now_sec() - start;
+
+    const char *name = indexed ? "hash index" : "tree only";
+    if (!indexed) {
+      for (int i = 0; i < 3; i++) base[i] = sec[i];
+    }
+    printf("%-10s insert %7.1f ns/op (%.2fx), find %7.1f ns/op (found %zu, %.2fx), erase_key %7.1f ns/op (%.2fx)\n",
+           name, sec[0] / n * 1e9, base[0] / sec[0], sec[1] / queries * 1e9, found, base[1] / sec[1],
+           sec[2] / n * 1e9, base[2] / sec[2]);
+    if (indexed) printf("%-10s index %.1f MB (%.1f bytes/key)\n", name, memory / 1e6, (double)memory / n);
+    delete_rbtree(t);
+  }
+
+  free(q);
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,56 @@
+// 재시작할 때 트리 복구: key를 하나씩 다시 삽입 / 파일 저장 / 파일로 O(n) 재구성 / 읽기 전용으로 열기
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+  const char *path = argc > 2 ? argv[2] : "bench-load.bin";
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(1);
+  for (size_t i = 0; i < n; i++) keys[i] = rand();
+
+  double start = now_sec();
+  rbtree *t = new_rbtree_with_capacity(n);
+  for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+  double replay = now_sec() - start;
+
+  start = now_sec();
+  if (rbtree_save(t, path) != 0) {
+    perror(path);
+    return 1;
+  }
+  double save = now_sec() - start;
+
+  start = now_sec();
+  rbtree *u = rbtree_load(path);
+  double load = now_sec() - start;
+
+  start = now_sec();
+  rbtree_view *v = rbtree_view_open(path);
+  double open = now_sec() - start;
+
+  // 불러온 트리와 view가 같은 답을 내는지 확인하면서 조회 시간 측정
+  size_t hits = 0;
+  start = now_sec();
+  for (size_t i = 0; i < n; i++) hits += rbtree_find(u, keys[i] ^ 1) != NULL;
+  double tree_find = now_sec() - start;
+  size_t view_hits = 0;
+  start = now_sec();
+  for (size_t i = 0; i < n; i++) view_hits += rbtree_view_find(v, keys[i] ^ 1) >= 0;
+  double view_find = now_sec() - start;
+
+  printf("n=%zu file %.1f MB: replay insert %8.2f ms, save %7.2f ms, load %7.2f ms, view open %7.2f ms\n", n,
+         v->map_size / 1e6, replay * 1e3, save * 1e3, load * 1e3, open * 1e3);
+  printf("n finds: tree %8.2f ms, view %8.2f ms (%s)\n", tree_find * 1e3, view_find * 1e3,
+         hits == view_hits ? "same results" : "MISMATCH");
+  rbtree_view_close(v);
+  delete_rbtree(u);
+  delete_rbtree(t);
+  unlink(path);
+  free(keys);
+  return hits == view_hits ? 0 : 1;
+}
@@ -0,0 +1,93 @@
+// key로 payload 찾기: rbtree_find + 별도 해시 테이블 vs 노드 안에 value를 둔 map
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  int64_t a, b;
+} payload;
+
+// 비교용 해시 테이블 (선형 탐사, key는 0 이상)
+typedef struct {
+  key_t *keys;
+  payload *vals;
+  size_t mask;
+} side_table;
+
+static size_t hash_key(key_t key) { return (uint32_t)key * 2654435761u; }
+
+static void side_put(side_table *h, key_t key, payload v) {
+  size_t i = hash_key(key) & h->mask;
+  while (h->keys[i] >= 0 && h->keys[i] != key) i = (i + 1) & h->mask;
+  h->keys[i] = key;
+  h->vals[i] = v;
+}
+
+static payload *side_get(side_table *h, key_t key) {
+  size_t i = hash_key(key) & h->mask;
+  while (h->keys[i] != key) {
+    if (h->keys[i] < 0) return NULL;
+    i = (i + 1) & h->mask;
+  }
+  return &h->vals[i];
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t queries = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000000;
+
+  key_t *keys = malloc(n * sizeof(key_t));
+  size_t *order = malloc(queries * sizeof(size_t));
+  srand(11);
+  for (size_t i = 0; i < n; i++) keys[i] = rand();
+  for (size_t i = 0; i < queries; i++) order[i] = (size_t)rand() % n;
+
+  side_table h;
+  h.mask = 1;
+  while (h.mask < 2 * n) h.mask <<= 1;
+  h.keys = malloc(h.mask * sizeof(key_t));
+  h.vals = malloc(h.mask * sizeof(payload));
+  for (size_t i = 0; i < h.mask; i++) h.keys[i] = -1;
+  h.mask--;
+
+  rbtree *index = new_rbtree_with_capacity(n);
+  rbtree_options opts = {0};
+  opts.capacity = n;
+  opts.value_size = sizeof(payload);
+  rbtree *map = new_rbtree_opts(&opts);
+  for (size_t i = 0; i < n; i++) {
+    payload v = {keys[i], (int64_t)i};
+    rbtree_insert(index, keys[i]);
+    side_put(&h, keys[i], v);
+    rbtree_map_put(map, keys[i], &v);
+  }
+
+  int64_t sum = 0;
+  double start = now_sec();
+  for (size_t i = 0; i < queries; i++) {
+    key_t key = keys[order[i]];
+    if (rbtree_find(index, key) != NULL) sum += side_get(&h, key)->b;
+  }
+  double side = now_sec() - start;
+
+  start = now_sec();
+  for (size_t i = 0; i < queries; i++) {
+    payload *v = rbtree_map_get(map, keys[order[i]]);
+    if (v != NULL) sum += v->b;
+  }
+  double inline_value = now_sec() - start;
+
+  printf("n=%zu lookup+payload: find+side table %6.1f ns, map_get %6.1f ns (node %zu bytes, sum %lld)\n", n,
+         side / queries * 1e9, inline_value / queries * 1e9, map->pool.stride, (long long)sum);
+
+  delete_rbtree(map);
+  delete_rbtree(index);
+  free(h.vals);
+  free(h.keys);
+  free(order);
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,62 @@
+// 정렬된 배열로 build, to_array, 같은 크기 두 트리의 합집합: 순차 경로 / 병렬 경로(스레드 1, 2, 4, 8개)
+// CPU가 스레드 수보다 적으면 병렬 쪽은 빨라지지 않고 나누고 기다리는 비용만 보임
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int comp(const void *a, const void *b) {
+  const key_t x = *(const key_t *)a, y = *(const key_t *)b;
+  return (x > y) - (x < y);
+}
+
+static key_t *sorted_keys(size_t n, unsigned seed) {
+  key_t *arr = malloc(n * sizeof(key_t));
+  srand(seed);
+  for (size_t i = 0; i < n; i++) arr[i] = rand();
+  qsort(arr, n, sizeof(key_t), comp);
+  return arr;
+}
+
+// 병렬 실행기가 NULL이면 순차 경로로 잼
+static void run(rbtree_workers *w, const char *name, const key_t *a, const key_t *b, key_t *out, size_t n) {
+  double start = now_sec();
+  rbtree *t = w ? rbtree_build_from_sorted_par(w, a, n) : rbtree_build_from_sorted(a, n);
+  double build = now_sec() - start;
+
+  start = now_sec();
+  if (w) rbtree_to_array_par(w, t, out, n);
+  else rbtree_to_array(t, out, n);
+  double export = now_sec() - start;
+
+  rbtree *u = rbtree_build_from_sorted(b, n);
+  start = now_sec();
+  if (w) rbtree_union_par(w, t, u);
+  else rbtree_union(t, u);
+  double join = now_sec() - start;
+
+  printf("%-12s build %8.2f ms, to_array %8.2f ms, union %8.2f ms\n", name, build * 1e3, export * 1e3,
+         join * 1e3);
+  delete_rbtree(u);
+  delete_rbtree(t);
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+  key_t *a = sorted_keys(n, 1), *b = sorted_keys(n, 2), *out = malloc(n * sizeof(key_t));
+  printf("n=%zu\n", n);
+  run(NULL, "sequential", a, b, out, n);
+  const int threads[] = {1, 2, 4, 8};
+  for (size_t k = 0; k < sizeof(threads) / sizeof(threads[0]); k++) {
+    rbtree_workers *w = new_rbtree_workers(threads[k], 0);
+    char name[32];
+    snprintf(name, sizeof(name), "threads=%d", threads[k]);
+    run(w, name, a, b, out, n);
+    delete_rbtree_workers(w);
+  }
+  free(out);
+  free(b);
+  free(a);
+  return 0;
+}
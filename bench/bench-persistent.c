@@ -0,0 +1,47 @@
+// 영속 모드 갱신 비용: 일반 트리 / snapshot 없는 영속 트리 / 주기적으로 snapshot을 뜨는 영속 트리
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static double churn(rbtree *t, const key_t *keys, size_t n, size_t snapshot_every) {
+  rbtree *snap = NULL;
+  double start = now_sec();
+  for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+  for (size_t i = 0; i < n; i++) {
+    if (snapshot_every > 0 && i % snapshot_every == 0) {
+      if (snap != NULL) rbtree_snapshot_release(snap);
+      snap = rbtree_snapshot(t);
+    }
+    rbtree_erase_key(t, keys[i]);
+    rbtree_insert(t, keys[i] + 1);
+  }
+  if (snap != NULL) rbtree_snapshot_release(snap);
+  return now_sec() - start;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 500000;
+  key_t *keys = malloc(n * sizeof(key_t));
+  srand(13);
+  for (size_t i = 0; i < n; i++) keys[i] = rand();
+
+  rbtree_options opts = {0};
+  rbtree *plain = new_rbtree_opts(&opts);
+  opts.persistent = 1;
+  rbtree *quiet = new_rbtree_opts(&opts);
+  rbtree *snapped = new_rbtree_opts(&opts);
+
+  double a = churn(plain, keys, n, 0);
+  double b = churn(quiet, keys, n, 0);
+  double c = churn(snapped, keys, n, 1000);
+  printf("n=%zu insert+churn: plain %6.1f ns/op, persistent %6.1f ns/op, persistent+snapshot/1000 %6.1f ns/op\n",
+         n, a / (3 * n) * 1e9, b / (3 * n) * 1e9, c / (3 * n) * 1e9);
+
+  delete_rbtree(snapped);
+  delete_rbtree(quiet);
+  delete_rbtree(plain);
+  free(keys);
+  return 0;
+}
@@ -0,0 +1,107 @@
+// 타이머 큐: 가장 이른 deadline을 꺼내고 조금 뒤의 deadline을 다시 넣기를 반복 (hold model)
+// 배열 binary heap / rbtree_min + rbtree_erase / rbtree_pop_min, 그리고 만료된 항목을 한 번에 꺼내는 비용
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+  key_t *a;
+  size_t n;
+} heap;
+
+static void heap_push(heap *h, key_t key) {
+  size_t i = h->n++;
+  while (i > 0 && h->a[(i - 1) / 2] > key) {
+    h->a[i] = h->a[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+  h->a[i] = key;
+}
+
+static key_t heap_pop(heap *h) {
+  key_t top = h->a[0], last = h->a[--h->n];
+  size_t i = 0;
+  for (;;) {
+    size_t c = 2 * i + 1;
+    if (c >= h->n) break;
+    if (c + 1 < h->n && h->a[c + 1] < h->a[c]) c++;
+    if (h->a[c] >= last) break;
+    h->a[i] = h->a[c];
+    i = c;
+  }
+  h->a[i] = last;
+  return top;
+}
+
+// 0이면 heap, 1이면 min + erase, 2면 pop_min
+static double hold(int kind, size_t n, size_t ops) {
+  srand(1);
+  heap h = {malloc(n * sizeof(key_t)), 0};
+  rbtree *t = new_rbtree_with_capacity(n);
+  for (size_t i = 0; i < n; i++) {
+    key_t d = rand() % (int)(4 * n);
+    if (kind == 0) heap_push(&h, d);
+    else rbtree_insert(t, d);
+  }
+  double start = now_sec();
+  for (size_t i = 0; i < ops; i++) {
+    key_t now;
+    if (kind == 0) {
+      now = heap_pop(&h);
+    } else if (kind == 1) {
+      node_t *p = rbtree_min(t);
+      now = p->key;
+      rbtree_erase(t, p);
+    } else {
+      rbtree_pop_min(t, &now);
+    }
+    key_t next = now + 1 + rand() % (int)(4 * n);
+    if (kind == 0) heap_push(&h, next);
+    else rbtree_insert(t, next);
+  }
+  double elapsed = now_sec() - start;
+  delete_rbtree(t);
+  free(h.a);
+  return elapsed / ops * 1e9;
+}
+
+// n개 중 앞쪽 절반이 만료됐을 때 한꺼번에 꺼내기 (0이면 heap, 1이면 pop_min 반복, 2면 pop_min_while)
+static double drain(int kind, size_t n) {
+  srand(2);
+  heap h = {malloc(n * sizeof(key_t)), 0};
+  rbtree *t = new_rbtree_with_capacity(n);
+  for (size_t i = 0; i < n; i++) {
+    key_t d = rand() % (int)n;
+    if (kind == 0) heap_push(&h, d);
+    else rbtree_insert(t, d);
+  }
+  key_t *out = malloc(n * sizeof(key_t));
+  const key_t limit = (key_t)(n / 2);
+  size_t got = 0;
+  double start = now_sec();
+  if (kind == 0) {
+    while (h.n > 0 && h.a[0] <= limit) out[got++] = heap_pop(&h);
+  } else if (kind == 1) {
+    while (rbtree_min(t) != NULL && rbtree_min(t)->key <= limit) rbtree_pop_min(t, &out[got++]);
+  } else {
+    got = rbtree_pop_min_while(t, limit, out, n);
+  }
+  double elapsed = now_sec() - start;
+  free(out);
+  delete_rbtree(t);
+  free(h.a);
+  return elapsed / got * 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  size_t max = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  for (size_t n = 1000; n <= max; n *= 10) {
+    const size_t ops = n < 1000000 ? 1000000 : n;
+    printf("n=%8zu hold: heap %6.1f ns, min + erase %6.1f ns, pop_min %6.1f ns | "
+           "drain: heap %6.1f ns, pop_min %6.1f ns, pop_min_while %6.1f ns\n",
+           n, hold(0, n, ops), hold(1, n, ops), hold(2, n, ops), drain(0, n), drain(1, n), drain(2, n));
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+// 큰 트리(n)와 작은 트리(m)의 합집합/차집합: join 기반 연산 / to_array 두 번 + 병합 + 새 트리에 n + m번 삽입
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static rbtree *random_tree(size_t n, unsigned seed) {
+  rbtree *t = new_rbtree();
+  srand(seed);
+  for (size_t i = 0; i < n; i++) rbtree_insert(t, rand());
+  return t;
+}
+
+// 예전 방식의 합집합: 두 트리를 배열로 꺼내 병합한 뒤 새 트리에 차례로 삽입
+static rbtree *union_by_copy(rbtree *a, rbtree *b) {
+  size_t na = rbtree_size(a), nb = rbtree_size(b);
+  key_t *x = malloc(na * sizeof(key_t)), *y = malloc(nb * sizeof(key_t));
+  rbtree_to_array(a, x, na);
+  rbtree_to_array(b, y, nb);
+  rbtree *t = new_rbtree();
+  size_t i = 0, j = 0;
+  while (i < na || j < nb) {
+    if (j >= nb || (i < na && x[i] <= y[j])) rbtree_insert(t, x[i++]);
+    else rbtree_insert(t, y[j++]);
+  }
+  free(y);
+  free(x);
+  return t;
+}
+
+// 예전 방식의 차집합: b에 없는 a의 원소만 새 트리에 삽입
+static rbtree *difference_by_copy(rbtree *a, rbtree *b) {
+  size_t na = rbtree_size(a), nb = rbtree_size(b);
+  key_t *x = malloc(na * sizeof(key_t)), *y = malloc(nb * sizeof(key_t));
+  rbtree_to_array(a, x, na);
+  rbtree_to_array(b, y, nb);
+  rbtree *t = new_rbtree();
+  size_t j = 0;
+  for (size_t i = 0; i < na; i++) {
+    while (j < nb && y[j] < x[i]) j++;
+    if (j >= nb || y[j] != x[i]) rbtree_insert(t, x[i]);
+  }
+  free(y);
+  free(x);
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  const size_t ms[] = {1000, 30000, n};
+  for (size_t k = 0; k < sizeof(ms) / sizeof(ms[0]); k++) {
+    const size_t m = ms[k];
+    rbtree *a = random_tree(n, 1), *b = random_tree(m, 2);
+    double start = now_sec();
+    rbtree *c = union_by_copy(a, b);
+    double copy_union = now_sec() - start;
+    start = now_sec();
+    rbtree *d = difference_by_copy(a, b);
+    double copy_diff = now_sec() - start;
+    delete_rbtree(d);
+    delete_rbtree(c);
+
+    rbtree *a2 = random_tree(n, 1), *b2 = random_tree(m, 2);
+    start = now_sec();
+    rbtree_union(a, b);
+    double join_union = now_sec() - start;
+    start = now_sec();
+    rbtree_difference(a2, b2);
+    double join_diff = now_sec() - start;
+
+    printf("n=%zu m=%7zu union: copy %8.2f ms, join %7.2f ms | difference: copy %8.2f ms, join %7.2f ms\n",
+           n, m, copy_union * 1e3, join_union * 1e3, copy_diff * 1e3, join_diff * 1e3);
+    delete_rbtree(b2);
+    delete_rbtree(a2);
+    delete_rbtree(b);
+    delete_rbtree(a);
+  }
+  return 0;
+}
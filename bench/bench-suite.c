@@ -0,0 +1,296 @@
+// 작업 부하별 성능 측정: key 분포(순차, 무작위, Zipf, 중복) x 작업(삽입, 조회, 삭제, 읽기/쓰기 혼합, churn,
+// to_array, 해제) x 크기(1K부터 --max까지 10배씩)마다 초당 연산 수와 연산 하나의 p50/p99 지연을 CSV나 JSON으로 출력
+// 실행끼리 비교할 수 있도록 key 분포는 고정된 seed로 만듦
+//
+//   ./bench-suite [--format csv|json] [--max N] [--streams a,b] [--workloads a,b] > result.csv
+#include "rbtree.h"
+#include "bench.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SAMPLE_EVERY 16   // 연산 16개 중 하나만 따로 시간을 재서 지연 분포를 구함 (전부 재면 시계 비용이 더 큼)
+#define ZIPF_THETA 0.99
+
+static uint64_t rng_state = 1;
+
+// xorshift64*
+static uint64_t rng(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545f4914f6cdd1dull;
+}
+
+// YCSB의 Zipf 생성기: 0..n-1 중 작은 값일수록 자주 나옴 (생성은 O(1), 준비에 O(n))
+typedef struct {
+  uint64_t n;
+  double zetan, alpha, eta, half_pow;
+} zipf;
+
+static void zipf_init(zipf *z, uint64_t n) {
+  double zeta2 = 1.0 + pow(0.5, ZIPF_THETA);
+  z->n = n;
+  z->zetan = 0;
+  for (uint64_t i = 1; i <= n; i++) z->zetan += 1.0 / pow((double)i, ZIPF_THETA);
+  z->alpha = 1.0 / (1.0 - ZIPF_THETA);
+  z->eta = (1.0 - pow(2.0 / n, 1.0 - ZIPF_THETA)) / (1.0 - zeta2 / z->zetan);
+  z->half_pow = 1.0 + pow(0.5, ZIPF_THETA);
+}
+
+static uint64_t zipf_next(const zipf *z) {
+  double u = (rng() >> 11) * (1.0 / 9007199254740992.0);
+  double uz = u * z->zetan;
+  if (uz < 1.0) return 0;
+  if (uz < z->half_pow) return 1;
+  uint64_t r = (uint64_t)(z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+  return r < z->n ? r : z->n - 1;
+}
+
+// key 분포
+enum { SEQUENTIAL, RANDOM, ZIPF, DUPLICATES, STREAMS };
+static const char *stream_names[STREAMS] = {"sequential", "random", "zipf", "duplicates"};
+
+typedef struct {
+  int kind;
+  size_t next;    // 순차 분포에서 다음 key
+  size_t n;
+  zipf z;
+} stream;
+
+static key_t stream_next(stream *s) {
+  switch (s->kind) {
+  case SEQUENTIAL:
+    return (key_t)s->next++;
+  case RANDOM:
+    return (key_t)(uint32_t)rng();
+  case ZIPF:
+    //순위를 홀수 곱으로 흩어서 자주 나오는 key가 key 공간의 한쪽에 몰리지 않게 함
+    return (key_t)(uint32_t)(zipf_next(&s->z) * 2654435761u);
+  default:
+    //서로 다른 key가 n / 100개뿐
+    return (key_t)(rng() % (s->n / 100 + 1));
+  }
+}
+
+// 한 번의 측정 결과
+typedef struct {
+  double *samples;  // 따로 잰 연산 하나하나의 시간 (초)
+  size_t count, cap;
+  size_t ops;
+  double total;
+} record;
+
+static void record_sample(record *r, double sec) {
+  if (r->count == r->cap) {
+    r->cap = r->cap ? 2 * r->cap : 1024;
+    r->samples = realloc(r->samples, r->cap * sizeof(double));
+  }
+  r->samples[r->count++] = sec;
+}
+
+// i번째 연산 op를 실행하고, SAMPLE_EVERY번에 한 번은 따로 시간을 잼
+#define TIMED(r, i, op)                      \
+  do {                                       \
+    if ((i) % SAMPLE_EVERY == 0) {           \
+      double s_ = now_sec();                 \
+      op;                                    \
+      record_sample((r), now_sec() - s_);    \
+    } else {                                 \
+      op;                                    \
+    }                                        \
+  } while (0)
+
+static int comp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static double percentile(const record *r, double p) {
+  if (r->count == 0) return 0;
+  size_t i = (size_t)(p * (r->count - 1) + 0.5);
+  return r->samples[i];
+}
+
+static const char *format = "csv";
+static int rows = 0;
+
+// 잰 값을 버리고 다음 작업을 위해 비움
+static void record_reset(record *r) {
+  free(r->samples);
+  memset(r, 0, sizeof(*r));
+}
+
+static void report(const char *workload, int kind, size_t n, record *r) {
+  qsort(r->samples, r->count, sizeof(double), comp_double);
+  const double ops_per_sec = r->total > 0 ? r->ops / r->total : 0;
+  const double p50 = percentile(r, 0.50) * 1e9, p99 = percentile(r, 0.99) * 1e9;
+  if (strcmp(format, "json") == 0) {
+    printf("%s  {\"workload\": \"%s\", \"stream\": \"%s\", \"n\": %zu, \"ops\": %zu, \"seconds\": %.6f, "
+           "\"ops_per_sec\": %.0f, \"p50_ns\": %.1f, \"p99_ns\": %.1f}",
+           rows > 0 ? ",\n" : "", workload, stream_names[kind], n, r->ops, r->total, ops_per_sec, p50, p99);
+  } else {
+    printf("%s,%s,%zu,%zu,%.6f,%.0f,%.1f,%.1f\n", workload, stream_names[kind], n, r->ops, r->total,
+           ops_per_sec, p50, p99);
+  }
+  fflush(stdout);
+  rows++;
+  record_reset(r);
+}
+
+static rbtree *build(const key_t *keys, size_t n) {
+  rbtree *t = new_rbtree();
+  for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+  return t;
+}
+
+// list가 NULL이거나 쉼표로 나눈 이름 중에 name이 있으면 1
+static int selected(const char *list, const char *name) {
+  if (list == NULL) return 1;
+  const size_t len = strlen(name);
+  for (const char *p = list; (p = strstr(p, name)) != NULL; p += len) {
+    if ((p == list || p[-1] == ',') && (p[len] == ',' || p[len] == '\0')) return 1;
+  }
+  return 0;
+}
+
+static void run(int kind, size_t n, const char *workloads) {
+  stream s = {.kind = kind, .n = n};
+  rng_state = 0x9e3779b97f4a7c15ull ^ (kind * 1000003u + n);
+  if (kind == ZIPF) zipf_init(&s.z, n);
+  key_t *keys = malloc(n * sizeof(key_t));
+  for (size_t i = 0; i < n; i++) keys[i] = stream_next(&s);
+  record r = {0};
+  double start;
+
+  // 삽입: 빈 트리에 key n개
+  rbtree *t = new_rbtree();
+  start = now_sec();
+  for (size_t i = 0; i < n; i++) TIMED(&r, i, rbtree_insert(t, keys[i]));
+  r.total = now_sec() - start;
+  r.ops = n;
+  if (selected(workloads, "insert")) report("insert", kind, n, &r);
+  else record_reset(&r);
+
+  // 조회: 넣은 key 중 무작위로 n번
+  if (selected(workloads, "find")) {
+    size_t hits = 0;
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) TIMED(&r, i, hits += rbtree_find(t, keys[rng() % n]) != NULL);
+    r.total = now_sec() - start;
+    r.ops = n;
+    if (hits != n) fprintf(stderr, "find: %zu of %zu keys missing\n", n - hits, n);
+    report("find", kind, n, &r);
+  }
+
+  // 읽기/쓰기 혼합: 읽기 비율 90%, 50% (쓰기는 새 key 삽입과 있는 key 삭제가 반반)
+  const int read_pct[] = {90, 50};
+  const char *mixed_names[] = {"mixed-90-10", "mixed-50-50"};
+  for (int m = 0; m < 2; m++) {
+    if (!selected(workloads, mixed_names[m])) continue;
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) {
+      const uint64_t x = rng();
+      if ((int)(x % 100) < read_pct[m]) TIMED(&r, i, rbtree_find(t, keys[(x >> 8) % n]));
+      else if (x & (1 << 20)) TIMED(&r, i, rbtree_insert(t, stream_next(&s)));
+      else TIMED(&r, i, rbtree_erase_key(t, keys[(x >> 8) % n]));
+    }
+    r.total = now_sec() - start;
+    r.ops = n;
+    report(mixed_names[m], kind, n, &r);
+  }
+
+  // churn: 가장 오래된 key를 지우고 새 key를 넣어 크기를 유지 (sliding window)
+  if (selected(workloads, "churn")) {
+    rbtree_clear(t);
+    for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) {
+      const key_t fresh = stream_next(&s);
+      TIMED(&r, i, (rbtree_erase_key(t, keys[i]), rbtree_insert(t, fresh)));
+      keys[i] = fresh;
+    }
+    r.total = now_sec() - start;
+    r.ops = n;
+    report("churn", kind, n, &r);
+  }
+
+  // to_array: 전체를 배열로 (연산 하나 = 전체 복사 한 번, 초당 원소 수로 보고)
+  const int reps = n >= 1000000 ? 3 : (int)(3000000 / n);
+  if (selected(workloads, "to_array")) {
+    const size_t size = rbtree_size(t);
+    key_t *out = malloc(size * sizeof(key_t) + 1);
+    for (int i = 0; i < reps; i++) {
+      start = now_sec();
+      rbtree_to_array(t, out, size);
+      double sec = now_sec() - start;
+      record_sample(&r, sec);
+      r.total += sec;
+    }
+    r.ops = size * reps;
+    free(out);
+    for (size_t i = 0; i < r.count; i++) r.samples[i] /= size;   //원소 하나당 시간
+    report("to_array", kind, n, &r);
+  }
+  delete_rbtree(t);
+
+  // 삭제: 넣은 key를 모두 무작위 순서로
+  if (selected(workloads, "erase")) {
+    t = build(keys, n);
+    for (size_t i = n; i > 1; i--) {
+      size_t j = rng() % i;
+      key_t tmp = keys[i - 1];
+      keys[i - 1] = keys[j];
+      keys[j] = tmp;
+    }
+    start = now_sec();
+    for (size_t i = 0; i < n; i++) TIMED(&r, i, rbtree_erase_key(t, keys[i]));
+    r.total = now_sec() - start;
+    r.ops = n;
+    report("erase", kind, n, &r);
+    delete_rbtree(t);
+  }
+
+  // 해제: 원소 n개짜리 트리 하나를 통째로 (초당 원소 수로 보고)
+  if (selected(workloads, "teardown")) {
+    for (int i = 0; i < (reps < 20 ? reps : 20); i++) {
+      t = build(keys, n);
+      start = now_sec();
+      delete_rbtree(t);
+      double sec = now_sec() - start;
+      record_sample(&r, sec / n);
+      r.total += sec;
+      r.ops += n;
+    }
+    report("teardown", kind, n, &r);
+  }
+  free(keys);
+}
+
+int main(int argc, char *argv[]) {
+  size_t max = 1000000;
+  const char *streams = NULL, *workloads = NULL;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--format") == 0) format = argv[i + 1];
+    else if (strcmp(argv[i], "--max") == 0) max = strtoul(argv[i + 1], NULL, 10);
+    else if (strcmp(argv[i], "--streams") == 0) streams = argv[i + 1];
+    else if (strcmp(argv[i], "--workloads") == 0) workloads = argv[i + 1];
+    else {
+      fprintf(stderr, "usage: %s [--format csv|json] [--max N] [--streams a,b] [--workloads a,b]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if (strcmp(format, "json") == 0) printf("[\n");
+  else printf("workload,stream,n,ops,seconds,ops_per_sec,p50_ns,p99_ns\n");
+  for (size_t n = 1000; n <= max; n *= 10) {
+    for (int kind = 0; kind < STREAMS; kind++) {
+      if (selected(streams, stream_names[kind])) run(kind, n, workloads);
+    }
+  }
+  if (strcmp(format, "json") == 0) printf("\n]\n");
+  return 0;
+}
@@ -0,0 +1,44 @@
+// 트리 해제 비용 측정: 노드 단위 반납 vs slab 일괄 해제 vs rbtree_clear
+#include "rbtree.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static rbtree *build(size_t n) {
+  rbtree *t = new_rbtree();
+  srand(1);
+  for (size_t i = 0; i < n; i++) rbtree_insert(t, rand());
+  return t;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+
+  // 노드를 하나씩 풀에 돌려준 뒤 해제 (예전 delete_rbtree와 같은 방식)
+  rbtree *t = build(n);
+  double start = now_sec();
+  delete_rbtree_sub(t, t->root);
+  t->root = t->nil;
+  delete_rbtree(t);
+  double per_node = now_sec() - start;
+
+  // slab 일괄 해제
+  t = build(n);
+  start = now_sec();
+  delete_rbtree(t);
+  double bulk = now_sec() - start;
+
+  // 트리를 남겨 두고 비우기
+  t = build(n);
+  start = now_sec();
+  rbtree_clear(t);
+  double clear = now_sec() - start;
+  delete_rbtree(t);
+
+  printf("n=%zu\n", n);
+  printf("per-node teardown: %10.3f ms\n", per_node * 1e3);
+  printf("bulk delete:       %10.3f ms\n", bulk * 1e3);
+  printf("rbtree_clear:      %10.3f ms\n", clear * 1e3);
+  return 0;
+}
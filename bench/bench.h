@@ -0,0 +1,12 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <time.h>
+
+static inline double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif  // _BENCH_H_
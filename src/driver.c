@@ -1,101 +1,263 @@
-#include <assert.h>
-#include "../src/rbtree.h"
-#include <stdbool.h>
+// 노드 레이아웃과 탐색 방식을 비교하기 위한 프로파일러
+// 작업(삽입, 조회, 삭제)을 단계별로 돌리면서 perf_event_open으로 하드웨어 카운터를 읽고 연산당 값으로 출력
+// 카운터를 쓸 수 없으면(권한, 가상 머신, 리눅스가 아님) 시간만 잼
+//
+//   ./driver [--workload insert|find|erase|all] [--n N] [--keys sequential|random] [--repeat R] [--csv]
+//   레이아웃별 빌드: driver(기본), driver-compact, driver-index32
+#include "rbtree.h"
+
+#include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(RBTREE_INDEX32)
+#define LAYOUT "index32"
+#elif defined(RBTREE_COMPACT)
+#define LAYOUT "compact"
+#else
+#define LAYOUT "default"
+#endif
+
+// 읽을 카운터 (없는 카운터는 건너뜀)
+enum { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, COUNTERS };
+static const char *counter_names[COUNTERS] = {"cycles", "instructions", "branch-misses", "L1d-misses", "LLC-misses"};
 
-bool touch_nil = false;
-int max_black_depth = 0;
+typedef struct {
+  int fd[COUNTERS];     // 열지 못한 카운터는 -1
+  int available;        // 하나라도 열렸으면 1
+} counters;
 
-void test_duplicate_values() {
-  const key_t entries[] = {10, 5, 5, 34, 6, 23, 12, 12, 6, 12};
-  const size_t n = sizeof(entries) / sizeof(entries[0]);
-  test_rb_constraints(entries, n);
+typedef struct {
+  double value[COUNTERS];   // 여러 카운터가 번갈아 돌았으면 켜져 있던 시간 비율로 보정한 값 (못 읽으면 -1)
+  double seconds;
+} reading;
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
 }
 
-// rbtree should keep search tree and color constraints
-void test_rb_constraints(const key_t arr[], const size_t n) {
-  rbtree *t = new_rbtree();
-  assert(t != NULL);
+#ifdef __linux__
+static int open_counter(uint32_t type, uint64_t config) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;   //perf_event_paranoid가 2여도 사용자 공간만 재면 열 수 있음
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
 
-  insert_arr(t, arr, n);
-  assert(t->root != NULL);
+#define CACHE_READ_MISS(cache) \
+  ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
 
-  test_color_constraint(t);
-  test_search_constraint(t);
+static void counters_open(counters *c) {
+  c->fd[CYCLES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+  c->fd[INSTRUCTIONS] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+  c->fd[BRANCH_MISSES] = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+  c->fd[L1D_MISSES] = open_counter(PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D));
+  c->fd[LLC_MISSES] = open_counter(PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL));
+  int err = 0;
+  c->available = 0;
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fd[i] >= 0) c->available = 1;
+    else if (err == 0) err = errno;
+  }
+  if (!c->available) {
+    fprintf(stderr, "perf_event_open: %s (check kernel.perf_event_paranoid or VM/container PMU access); timing only\n",
+            strerror(err));
+  }
+}
 
-  delete_rbtree(t);
+static void counters_start(counters *c) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fd[i] < 0) continue;
+    ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+static void counters_stop(counters *c, reading *r) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fd[i] >= 0) ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+  }
+  for (int i = 0; i < COUNTERS; i++) {
+    uint64_t buf[3];   // 값, 켜져 있던 시간, 실제로 센 시간
+    r->value[i] = -1;
+    if (c->fd[i] < 0 || read(c->fd[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0) continue;
+    r->value[i] = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+  }
 }
 
-void test_color_constraint(const rbtree *t) {
-  assert(t != NULL);
-#ifdef SENTINEL
-  node_t *nil = t->nil;
+static void counters_close(counters *c) {
+  for (int i = 0; i < COUNTERS; i++) {
+    if (c->fd[i] >= 0) close(c->fd[i]);
+  }
+}
 #else
-  node_t *nil = NULL;
-#endif
-  node_t *p = t->root;
-  assert(p == nil || p->color == RBTREE_BLACK);
+static void counters_open(counters *c) {
+  for (int i = 0; i < COUNTERS; i++) c->fd[i] = -1;
+  c->available = 0;
+  fprintf(stderr, "hardware counters need Linux perf_event_open; timing only\n");
+}
+
+static void counters_start(counters *c) {}
 
-  init_color_traverse();
-  assert(color_traverse(p, RBTREE_BLACK, 0, nil));
+static void counters_stop(counters *c, reading *r) {
+  for (int i = 0; i < COUNTERS; i++) r->value[i] = -1;
 }
 
-void test_search_constraint(const rbtree *t) {
-  assert(t != NULL);
-  node_t *p = t->root;
-  key_t min, max;
-#ifdef SENTINEL
-  node_t *nil = t->nil;
-#else
-  node_t *nil = NULL;
+static void counters_close(counters *c) {}
 #endif
-  assert(search_traverse(p, &min, &max, nil));
+
+// 측정 구간: 카운터를 켜고 시간을 잼 (카운터를 끄고 읽는 비용은 시간에 넣지 않음)
+static void phase_begin(counters *c, reading *r) {
+  counters_start(c);
+  r->seconds = now_sec();
 }
 
-void test_rb_constraints(const key_t arr[], const size_t n) {
-  rbtree *t = new_rbtree();
-  assert(t != NULL);
+static void phase_end(counters *c, reading *r) {
+  r->seconds = now_sec() - r->seconds;
+  counters_stop(c, r);
+}
 
-  insert_arr(t, arr, n);
-  assert(t->root != NULL);
+static int csv = 0;
+
+static void report(const char *phase, size_t ops, const reading *r) {
+  if (csv) {
+    printf("%s,%s,%zu,%.2f", LAYOUT, phase, ops, r->seconds * 1e9 / ops);
+    for (int i = 0; i < COUNTERS; i++) {
+      if (r->value[i] < 0) printf(",");
+      else printf(",%.3f", r->value[i] / ops);
+    }
+    printf("\n");
+    return;
+  }
+  printf("%-8s %10zu %9.1f", phase, ops, r->seconds * 1e9 / ops);
+  for (int i = 0; i < COUNTERS; i++) {
+    if (r->value[i] < 0) printf(" %13s", "-");
+    else printf(" %13.2f", r->value[i] / ops);
+  }
+  printf("\n");
+}
 
-  test_color_constraint(t);
-  test_search_constraint(t);
+static uint64_t rng_state = 88172645463325252ull;
 
-  delete_rbtree(t);
+static uint64_t rng(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
 }
 
-static void insert_arr(rbtree *t, const key_t *arr, const size_t n) {
-  for (size_t i = 0; i < n; i++) {
-    rbtree_insert(t, arr[i]);
+static void shuffle(key_t *arr, size_t n) {
+  for (size_t i = n; i > 1; i--) {
+    size_t j = rng() % i;
+    key_t tmp = arr[i - 1];
+    arr[i - 1] = arr[j];
+    arr[j] = tmp;
   }
 }
-static void init_color_traverse(void) {
-  touch_nil = false;
-  max_black_depth = 0;
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [--workload insert|find|erase|all] [--n N] [--keys sequential|random] [--repeat R] [--csv]\n",
+          prog);
 }
-static bool color_traverse(const node_t *p, const color_t parent_color,
-                           const int black_depth, node_t *nil) {
-  if (p == nil) {
-    if (!touch_nil) {
-      touch_nil = true;
-      max_black_depth = black_depth;
-    } else if (black_depth != max_black_depth) {
-      return false;
+
+int main(int argc, char *argv[]) {
+  const char *workload = "all", *keys_kind = "random";
+  size_t n = 1000000;
+  int repeat = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--csv") == 0) csv = 1;
+    else if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    } else if (strcmp(argv[i], "--workload") == 0) workload = argv[++i];
+    else if (strcmp(argv[i], "--n") == 0) n = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--keys") == 0) keys_kind = argv[++i];
+    else if (strcmp(argv[i], "--repeat") == 0) repeat = atoi(argv[++i]);
+    else {
+      usage(argv[0]);
+      return 1;
     }
-    return true;
   }
-  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
-    return false;
+  const int all = strcmp(workload, "all") == 0;
+  const int do_insert = all || strcmp(workload, "insert") == 0;
+  const int do_find = all || strcmp(workload, "find") == 0;
+  const int do_erase = all || strcmp(workload, "erase") == 0;
+  if (n == 0 || repeat < 1 || !(do_insert || do_find || do_erase)) {
+    usage(argv[0]);
+    return 1;
   }
-  int next_depth = ((p->color == RBTREE_BLACK) ? 1 : 0) + black_depth;
-  return color_traverse(p->left, p->color, next_depth, nil) &&
-         color_traverse(p->right, p->color, next_depth, nil);
-}
 
+  //삽입 순서와 조회/삭제 순서를 따로 섞어서 직전에 건드린 노드가 캐시에 남는 효과를 줄임
+  key_t *keys = malloc(n * sizeof(key_t)), *order = malloc(n * sizeof(key_t));
+  if (keys == NULL || order == NULL) return 1;
+  const int sequential = strcmp(keys_kind, "sequential") == 0;
+  for (size_t i = 0; i < n; i++) keys[i] = sequential ? (key_t)i : (key_t)(uint32_t)rng();
+
+  counters c;
+  counters_open(&c);
+  rbtree *probe = new_rbtree();
+  if (csv) {
+    printf("layout,phase,ops,ns_per_op");
+    for (int i = 0; i < COUNTERS; i++) printf(",%s_per_op", counter_names[i]);
+    printf("\n");
+  } else {
+    printf("layout %s, node stride %zu bytes, %zu %s keys\n", LAYOUT, probe->pool.stride, n, keys_kind);
+    printf("%-8s %10s %9s", "phase", "ops", "ns/op");
+    for (int i = 0; i < COUNTERS; i++) printf(" %13s", counter_names[i]);
+    printf("\n");
+  }
+  delete_rbtree(probe);
+
+  reading r;
+  for (int rep = 0; rep < repeat; rep++) {
+    rbtree *t = new_rbtree();
+    if (do_insert) phase_begin(&c, &r);
+    for (size_t i = 0; i < n; i++) rbtree_insert(t, keys[i]);
+    if (do_insert) {
+      phase_end(&c, &r);
+      report("insert", n, &r);
+    }
+
+    memcpy(order, keys, n * sizeof(key_t));
+    shuffle(order, n);
+    if (do_find) {
+      size_t found = 0;
+      phase_begin(&c, &r);
+      for (size_t i = 0; i < n; i++) found += rbtree_find(t, order[i]) != NULL;
+      phase_end(&c, &r);
+      if (found != n) fprintf(stderr, "find: %zu of %zu keys missing\n", n - found, n);
+      report("find", n, &r);
+    }
+
+    if (do_erase) {
+      shuffle(order, n);
+      phase_begin(&c, &r);
+      for (size_t i = 0; i < n; i++) rbtree_erase(t, rbtree_find(t, order[i]));
+      phase_end(&c, &r);
+      report("erase", n, &r);
+    }
+    delete_rbtree(t);
+  }
 
-int main(void) {
-  test_duplicate_values();
-  printf("Passed all tests!\n");
+  counters_close(&c);
+  free(order);
+  free(keys);
+  return 0;
 }
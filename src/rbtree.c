@@ -1,57 +1,1773 @@
 #include "rbtree.h"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__AVX2__) && !defined(RBTREE_NO_SIMD)
+#include <immintrin.h>
+#elif defined(__SSE2__) && !defined(RBTREE_NO_SIMD)
+#include <emmintrin.h>
+#endif
+
+// 노드 링크 읽기/쓰기. 레이아웃마다 구현이 다르며, 인덱스 레이아웃에서는 주변의 t로 주소를 구함
+#define LEFT(x) rbtree_left(t, x)
+#define RIGHT(x) rbtree_right(t, x)
+#define PARENT(x) rbtree_parent(t, x)
+#define COLOR(x) rbtree_color(x)
+#if defined(RBTREE_INDEX32)
+#define NODE_INDEX(x) ((uint32_t)(((char *)(x) - t->pool.base) >> t->pool.shift))
+#define SET_LEFT(x, y) ((x)->left = NODE_INDEX(y))
+#define SET_RIGHT(x, y) ((x)->right = NODE_INDEX(y))
+#define SET_PARENT(x, y) ((x)->parent_color = (NODE_INDEX(y) << 1) | ((x)->parent_color & 1))
+#define SET_COLOR(x, c) ((x)->parent_color = ((x)->parent_color & ~(uint32_t)1) | (uint32_t)(c))
+#elif defined(RBTREE_COMPACT)
+#define SET_LEFT(x, y) ((x)->left = (y))
+#define SET_RIGHT(x, y) ((x)->right = (y))
+#define SET_PARENT(x, y) ((x)->parent_color = (uintptr_t)(y) | ((x)->parent_color & 1))
+#define SET_COLOR(x, c) ((x)->parent_color = ((x)->parent_color & ~(uintptr_t)1) | (uintptr_t)(c))
+#else
+#define SET_LEFT(x, y) ((x)->left = (y))
+#define SET_RIGHT(x, y) ((x)->right = (y))
+#define SET_PARENT(x, y) ((x)->parent = (y))
+#define SET_COLOR(x, c) ((x)->color = (c))
+#endif
+
+// 노드 배열에서 i번째 노드 (노드 하나가 stride 바이트를 차지)
+#define NODE_AT(base, i, stride) ((node_t *)((char *)(base) + (i) * (stride)))
+
+// 반납된 노드의 첫 바이트들에 다음 반납 노드를 적어 둠 (레이아웃과 무관)
+#define FREE_NEXT(p) (*(node_t **)(p))
+
+#define CACHE_LINE 64
+
+// RBTREE_STATS 빌드에서만 횟수를 셈 (읽기 함수는 const 트리를 받으므로 const를 떼고 셈)
+#ifdef RBTREE_STATS
+#define STAT_ADD(t, field, n) (((rbtree *)(t))->stats.field += (n))
+#define POOL_STAT(pool, field) ((pool)->field++)
+#else
+#define STAT_ADD(t, field, n) ((void)0)
+#define POOL_STAT(pool, field) ((void)0)
+#endif
+#define STAT(t, field) STAT_ADD(t, field, 1)
+
+#ifdef RBTREE_INDEX32
+
+#define POOL_RESERVE_NODES ((size_t)1 << 28)  // 기본으로 예약하는 주소 공간 (노드 수)
+#define POOL_MAX_NODES ((size_t)1 << 31)      // parent 인덱스가 31비트라서 이 이상은 못 씀
+#define POOL_MIN_COMMIT_NODES 1024
+
+// 예약한 구간 중 앞쪽 n개 노드를 읽고 쓸 수 있게 함
+static int pool_commit(node_pool *pool, size_t n) {
+  if (n <= pool->committed) return 0;
+  if (n > pool->reserved) return -1;
+  size_t want = pool->committed * 2;
+  if (want < n) want = n;
+  if (want < POOL_MIN_COMMIT_NODES) want = POOL_MIN_COMMIT_NODES;
+  if (want > pool->reserved) want = pool->reserved;
+  if (mprotect(pool->base, want << pool->shift, PROT_READ | PROT_WRITE) != 0) return -1;
+  pool->committed = want;
+  return 0;
+}
+
+static int pool_init(node_pool *pool, size_t stride, size_t hint) {
+  //인덱스에서 주소를 시프트로 구하도록 stride를 2의 거듭제곱으로 맞춤
+  pool->shift = 0;
+  while (((size_t)1 << pool->shift) < stride) pool->shift++;
+  pool->stride = (size_t)1 << pool->shift;
+  pool->free_list = NULL;
+  pool->used = pool->committed = 0;
+
+  //노드가 옮겨 다니지 않도록 주소 공간만 한 번에 예약해 두고, 실제 메모리는 필요할 때 붙임
+  pool->reserved = hint + 1 > POOL_RESERVE_NODES ? hint + 1 : POOL_RESERVE_NODES;
+  if (pool->reserved > POOL_MAX_NODES) return -1;
+  pool->base = mmap(NULL, pool->reserved << pool->shift, PROT_NONE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (pool->base == MAP_FAILED) {
+    pool->base = NULL;
+    return -1;
+  }
+  return pool_commit(pool, hint + 1);
+}
+
+// 연속된 노드 n개를 잘라 줌
+static node_t *pool_take(node_pool *pool, size_t n) {
+  if (pool_commit(pool, pool->used + n) != 0) return NULL;
+  node_t *p = (node_t *)(pool->base + (pool->used << pool->shift));
+  pool->used += n;
+  return p;
+}
+
+// 이후 노드 n개를 실패 없이 꺼낼 수 있도록 미리 확보
+static int pool_reserve(node_pool *pool, size_t n) {
+  return pool_commit(pool, pool->used + n);
+}
+
+static void pool_destroy(node_pool *pool) {
+  if (pool->base != NULL) munmap(pool->base, pool->reserved << pool->shift);
+  pool->base = NULL;
+  pool->free_list = NULL;
+  pool->used = pool->committed = 0;
+}
+
+// 인덱스 레이아웃의 노드 배열은 트리마다 따로라서 공유하지 않음
+static int pool_shared(const node_pool *pool) {
+  return 0;
+}
+
+// 풀 비우기: nil(0번)만 남기고 처음부터 다시 씀. 물리 메모리는 커널에 한꺼번에 돌려줌
+static void pool_reset(node_pool *pool) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t keep = (pool->stride + page - 1) / page * page;
+  if ((pool->committed << pool->shift) > keep) {
+    madvise(pool->base + keep, (pool->committed << pool->shift) - keep, MADV_DONTNEED);
+  }
+  pool->used = 1;
+  pool->free_list = NULL;
+}
+
+#else
+
+#define POOL_MIN_SLAB_NODES 64        // 첫 slab 크기
+#define POOL_MAX_SLAB_NODES (1 << 16) // slab 크기 상한 (2배씩 늘리다가 여기서 멈춤)
+
+struct rbtree_slab {
+  rbtree_slab *next;
+  size_t n;
+  node_t nodes[];       // 실제로는 stride 간격으로 n개
+};
+
+// 노드를 주고받은 트리들이 함께 쓰는 slab 목록과 nil. 마지막 트리가 지워질 때 해제
+struct rbtree_arena {
+  rbtree_slab *slabs;
+  node_t *nil;
+  size_t trees;         // 이 arena를 쓰는 트리 수
+};
+
+// slab의 첫 노드 위치: 캐시 라인 경계에 맞춰서, stride가 64의 약수면 노드가 두 라인에 걸치지 않음
+static char *slab_start(rbtree_slab *slab) {
+  return (char *)(((uintptr_t)slab->nodes + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+}
+
+// n개짜리 slab을 하나 받아서 풀의 미사용 구간으로 지정
+static int pool_grow(node_pool *pool, size_t n) {
+  rbtree_slab *slab = (rbtree_slab *)malloc(sizeof(rbtree_slab) + CACHE_LINE + n * pool->stride);
+  if (slab == NULL) return -1;
+  rbtree_slab **head = pool->arena != NULL ? &pool->arena->slabs : &pool->slabs;
+  slab->n = n;
+  slab->next = *head;
+  *head = slab;
+  pool->next = slab_start(slab);
+  pool->end = pool->next + n * pool->stride;
+  return 0;
+}
+
+static int pool_init(node_pool *pool, size_t stride, size_t hint) {
+  pool->slabs = NULL;
+  pool->arena = NULL;
+  pool->free_list = NULL;
+  pool->next = pool->end = NULL;
+  pool->stride = stride;
+  pool->slab_nodes = POOL_MIN_SLAB_NODES;
+  // 크기 힌트가 있으면 처음부터 그만큼 한 덩어리로 받아 둔다
+  if (hint > 0) return pool_grow(pool, hint);
+  return 0;
+}
+
+// 연속된 노드 n개를 잘라 줌 (현재 slab에 자리가 없으면 새 slab을 받음)
+static node_t *pool_take(node_pool *pool, size_t n) {
+  if ((size_t)(pool->end - pool->next) < n * pool->stride) {
+    size_t size = n > pool->slab_nodes ? n : pool->slab_nodes;
+    if (pool_grow(pool, size) != 0) return NULL;
+    if (size == pool->slab_nodes && pool->slab_nodes < POOL_MAX_SLAB_NODES) pool->slab_nodes *= 2;
+  }
+  node_t *p = (node_t *)pool->next;
+  pool->next += n * pool->stride;
+  return p;
+}
+
+// 이후 노드 n개를 실패 없이 꺼낼 수 있도록 미리 확보. 모자라면 남은 구간은 free list로 돌리고 새 slab을 받음
+static int pool_reserve(node_pool *pool, size_t n) {
+  if ((size_t)(pool->end - pool->next) >= n * pool->stride) return 0;
+  while (pool->next < pool->end) {
+    FREE_NEXT(pool->next) = pool->free_list;
+    pool->free_list = (node_t *)pool->next;
+    pool->next += pool->stride;
+  }
+  return pool_grow(pool, n > pool->slab_nodes ? n : pool->slab_nodes);
+}
+
+static void free_slabs(rbtree_slab *slab) {
+  while (slab != NULL) {
+    rbtree_slab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+}
+
+static void pool_destroy(node_pool *pool) {
+  free_slabs(pool->slabs);
+  //arena는 그것을 쓰는 마지막 트리가 nil과 함께 해제
+  rbtree_arena *a = pool->arena;
+  if (a != NULL && --a->trees == 0) {
+    free_slabs(a->slabs);
+    free(a->nil);
+    free(a);
+  }
+  pool->slabs = NULL;
+  pool->arena = NULL;
+  pool->free_list = NULL;
+  pool->next = pool->end = NULL;
+}
+
+// 다른 트리와 slab을 함께 쓰는 중인지 (그렇다면 slab을 통째로 비울 수 없음)
+static int pool_shared(const node_pool *pool) {
+  return pool->arena != NULL;
+}
+
+// 풀 비우기: 가장 최근 slab 하나만 남기고 나머지는 한꺼번에 해제, 남은 slab은 처음부터 다시 씀
+static void pool_reset(node_pool *pool) {
+  rbtree_slab *keep = pool->slabs;
+  if (keep == NULL) return;
+  pool->slabs = keep->next;
+  pool_destroy(pool);
+  keep->next = NULL;
+  pool->slabs = keep;
+  pool->next = slab_start(keep);
+  pool->end = pool->next + keep->n * pool->stride;
+}
+
+#endif
+
+// 노드 하나 꺼내기: free list 우선, 없으면 새 구간에서 잘라 줌
+static node_t *pool_alloc(node_pool *pool) {
+  node_t *p = pool->free_list;
+  POOL_STAT(pool, allocs);
+  if (p != NULL) {
+    pool->free_list = FREE_NEXT(p);
+    return p;
+  }
+  return pool_take(pool, 1);
+}
+
+// 노드 반납: 메모리는 풀에 남겨 두고 다음 삽입 때 재사용
+static void pool_free(node_pool *pool, node_t *p) {
+  POOL_STAT(pool, frees);
+  FREE_NEXT(p) = pool->free_list;
+  pool->free_list = p;
+}
+
+// 중복 key를 모으는 트리에서 노드가 나타내는 key의 개수 (노드 바로 뒤에 저장)
+#define NODE_COUNT(p) (*(size_t *)((node_t *)(p) + 1))
+
+// 노드 하나가 나타내는 원소 수
+static inline size_t node_weight(const rbtree *t, const node_t *p) {
+  return t->collapse_duplicates ? NODE_COUNT(p) : 1;
+}
+
+#ifdef RBTREE_ORDER_STATISTICS
+// 서브트리 크기 다시 계산 (nil의 size는 항상 0)
+#define UPDATE_SIZE(t, x) ((x)->size = LEFT(x)->size + RIGHT(x)->size + node_weight(t, x))
+
+// p부터 root까지 서브트리 크기에 d를 더함
+static void add_size_upward(rbtree *t, node_t *p, size_t d) {
+  for (; p != t->nil; p = PARENT(p)) p->size += d;
+}
+#endif
+
+// 루트가 통째로 바뀐 뒤(일괄 연산, 경로 복사) 가장 작은/큰 노드를 양쪽 가장자리를 따라 다시 찾음. O(log n)
+static void reset_ends(rbtree *t) {
+  node_t *lo = t->root, *hi = t->root;
+  if (lo != t->nil) {
+    while (LEFT(lo) != t->nil) lo = LEFT(lo);
+    while (RIGHT(hi) != t->nil) hi = RIGHT(hi);
+  }
+  t->leftmost = lo;
+  t->rightmost = hi;
+}
+
+// ---- key → 노드 해시 색인 ----
+// 열린 주소법(선형 탐사). 칸에 key를 함께 두어 탐사하면서 노드를 읽지 않음. 빈 칸은 node가 NULL
+// 노드는 회전이나 삭제로 자리만 옮길 뿐 key가 바뀌지 않으므로, 노드가 생기고 없어질 때만 고치면 됨
+// 같은 key의 노드가 여럿이면(multiset) 그중 하나를 가리키고, 그 노드가 지워지면 이웃한 같은 key 노드로 넘김
+
+#define HASH_MIN_SLOTS 16
+
+typedef struct {
+  key_t key;
+  node_t *node;
+} hash_slot;
+
+struct rbtree_hash {
+  hash_slot *slots;
+  size_t mask;        // 칸 수 - 1 (칸 수는 2의 거듭제곱)
+  unsigned shift;     // 64 - log2(칸 수)
+  size_t used;        // 채운 칸 수 (서로 다른 key 수)
+};
+
+// 곱셈 해시의 상위 비트 (연속된 key도 고르게 흩어짐)
+static inline size_t hash_home(const rbtree_hash *h, const key_t key) {
+  return (size_t)(((uint64_t)(int64_t)key * 0x9e3779b97f4a7c15ull) >> h->shift);
+}
+
+static hash_slot *hash_slot_of(const rbtree_hash *h, const key_t key) {
+  for (size_t i = hash_home(h, key);; i = (i + 1) & h->mask) {
+    hash_slot *s = &h->slots[i];
+    if (s->node == NULL) return NULL;
+    if (s->key == key) return s;
+  }
+}
+
+static inline node_t *hash_get(const rbtree_hash *h, const key_t key) {
+  const hash_slot *s = hash_slot_of(h, key);
+  return s != NULL ? s->node : NULL;
+}
+
+// 빈 칸 하나에 넣음 (key가 없고 자리가 남아 있어야 함)
+static void hash_place(rbtree_hash *h, const key_t key, node_t *node) {
+  size_t i = hash_home(h, key);
+  while (h->slots[i].node != NULL) i = (i + 1) & h->mask;
+  h->slots[i].key = key;
+  h->slots[i].node = node;
+  h->used++;
+}
+
+// 칸 수를 slots(2의 거듭제곱)개로 바꾸고 채워 둔 칸을 옮김
+static int hash_resize(rbtree_hash *h, size_t slots) {
+  hash_slot *old = h->slots;
+  const size_t old_slots = old != NULL ? h->mask + 1 : 0;
+  h->slots = (hash_slot *)calloc(slots, sizeof(hash_slot));
+  if (h->slots == NULL) {
+    h->slots = old;
+    return -1;
+  }
+  h->mask = slots - 1;
+  h->shift = 64;
+  while (slots > 1) {
+    slots >>= 1;
+    h->shift--;
+  }
+  h->used = 0;
+  for (size_t i = 0; i < old_slots; i++) {
+    if (old[i].node != NULL) hash_place(h, old[i].key, old[i].node);
+  }
+  free(old);
+  return 0;
+}
+
+// key가 없을 때만 넣음. 채운 칸이 3/4을 넘으면 두 배로 늘림
+static int hash_put(rbtree_hash *h, const key_t key, node_t *node) {
+  if (hash_slot_of(h, key) != NULL) return 0;
+  if ((h->used + 1) * 4 > (h->mask + 1) * 3 && hash_resize(h, (h->mask + 1) * 2) != 0) return -1;
+  hash_place(h, key, node);
+  return 0;
+}
+
+// key를 지우고 뒤에 이어진 칸 중 제자리에 더 가까워질 수 있는 것을 당겨 옴 (묘비를 남기지 않음)
+static void hash_remove(rbtree_hash *h, const key_t key) {
+  hash_slot *s = hash_slot_of(h, key);
+  if (s == NULL) return;
+  size_t i = (size_t)(s - h->slots);
+  for (size_t j = (i + 1) & h->mask; h->slots[j].node != NULL; j = (j + 1) & h->mask) {
+    const size_t k = hash_home(h, h->slots[j].key);
+    //k가 (i, j] 구간(한 바퀴 돌 수 있음) 밖이면 j의 key는 i 자리에서도 찾아짐
+    if (i < j ? (k <= i || k > j) : (k <= i && k > j)) {
+      h->slots[i] = h->slots[j];
+      i = j;
+    }
+  }
+  h->slots[i].node = NULL;
+  h->used--;
+}
+
+// 색인을 키우다 메모리가 모자라면 색인을 버리고 트리로만 찾음 (틀린 답보다는 느린 답)
+static void hash_drop(rbtree *t) {
+  free(t->hash->slots);
+  free(t->hash);
+  t->hash = NULL;
+}
+
+// 반납하는 노드 p를 색인이 가리키고 있으면 key를 뺌 (서브트리를 통째로 버릴 때)
+static inline void hash_forget(rbtree_hash *h, const node_t *p) {
+  const hash_slot *s = hash_slot_of(h, p->key);
+  if (s != NULL && s->node == p) hash_remove(h, p->key);
+}
+
+// 새로 매단 노드를 색인에 넣음
+static inline void hash_attach(rbtree *t, node_t *p) {
+  if (t->hash != NULL && hash_put(t->hash, p->key, p) != 0) hash_drop(t);
+}
+
+// 트리에서 떼어 내기 직전의 노드 p를 색인에서 뺌 (parent 링크로 같은 key의 이웃 노드를 찾음)
+static void hash_unlink(rbtree *t, node_t *p) {
+  hash_slot *s = hash_slot_of(t->hash, p->key);
+  if (s == NULL || s->node != p) return;
+  if (!t->collapse_duplicates) {
+    node_t *q = rbtree_next(t, p);
+    if (q == NULL || q->key != p->key) q = rbtree_prev(t, p);
+    if (q != NULL && q->key == p->key) {
+      s->node = q;
+      return;
+    }
+  }
+  hash_remove(t->hash, p->key);
+}
+
+// key n개를 늘리지 않고 담을 칸 수
+static size_t hash_slots_for(const size_t n) {
+  size_t slots = HASH_MIN_SLOTS;
+  while (slots * 3 < n * 4) slots *= 2;
+  return slots;
+}
+
+// 색인을 현재 내용으로 처음부터 다시 만듦. O(n)
+static int hash_rebuild(rbtree *t) {
+  rbtree_hash *h = t->hash;
+  free(h->slots);
+  h->slots = NULL;
+  if (hash_resize(h, hash_slots_for(t->count)) != 0) return -1;
+  for (node_t *p = rbtree_min(t); p != NULL; p = rbtree_next(t, p)) {
+    if (hash_put(h, p->key, p) != 0) return -1;
+  }
+  return 0;
+}
+
+// 트리 사이에서 노드를 통째로 옮긴 뒤(split, concat, 집합 연산) 색인을 다시 맞춤
+static void hash_refresh(rbtree *t) {
+  if (t->hash != NULL && hash_rebuild(t) != 0) hash_drop(t);
+}
+
+// 지금 내용으로 색인을 만들어 켬 (이미 켜져 있으면 그대로)
+int rbtree_hash_index_enable(rbtree *t) {
+  if (t->persistent) return -1;   //경로 복사로 노드가 계속 바뀜
+  if (t->hash != NULL) return 0;
+  t->hash = (rbtree_hash *)calloc(1, sizeof(rbtree_hash));
+  if (t->hash == NULL) return -1;
+  if (hash_rebuild(t) != 0) {
+    hash_drop(t);
+    return -1;
+  }
+  return 0;
+}
+
+void rbtree_hash_index_disable(rbtree *t) {
+  if (t->hash != NULL) hash_drop(t);
+}
+
+// 색인이 쓰는 메모리 (바이트, 꺼져 있으면 0)
+size_t rbtree_hash_index_memory(const rbtree *t) {
+  if (t->hash == NULL) return 0;
+  return sizeof(rbtree_hash) + (t->hash->mask + 1) * sizeof(hash_slot);
+}
+
+// ---- 영속(경로 복사) 모드 ----
+// 노드마다 자신을 가리키는 링크 수(부모의 자식 링크 + 루트로 쥐고 있는 트리/snapshot 수)를 셈.
+// 루트에서부터 링크 수가 모두 1인 노드는 현재 버전만 보는 노드라서 그대로 고치고,
+// 2 이상인 노드를 만나면 복사본으로 바꿔 끼운 뒤 고침. snapshot이 보는 노드는 바뀌지 않음.
+// 노드가 여러 버전에 걸쳐 공유되므로 parent 링크는 유지하지 않고, 지나온 경로를 스택에 적어 둠
+
+#define NODE_REFS(t, p) (*(size_t *)((char *)(p) + (t)->refs_offset))
+#define PATH_MAX_DEPTH 136                       // RB 트리 높이는 2 * log2(n + 1) 이하
+#define PERSIST_RESERVE (4 * PATH_MAX_DEPTH)     // 한 번의 갱신에서 복사할 수 있는 노드 수의 상한
+
+struct rbtree_version {
+  rbtree view;              // snapshot으로 돌려주는 읽기 전용 트리 (첫 필드여야 함)
+  rbtree_version *next;
+  atomic_int released;      // 읽는 쪽이 다 쓰면 1로 바꿈. 노드 회수는 쓰는 쪽이 함
+};
+
+static inline node_t *child(const rbtree *t, const node_t *p, int dir) {
+  return dir ? RIGHT(p) : LEFT(p);
+}
+
+static inline void set_child(rbtree *t, node_t *p, int dir, node_t *c) {
+  if (dir) SET_RIGHT(p, c);
+  else SET_LEFT(p, c);
+}
+
+// parent의 dir쪽 자식 링크(parent가 nil이면 루트)를 c로 바꿈
+static inline void replace_child(rbtree *t, node_t *parent, int dir, node_t *c) {
+  if (parent == t->nil) t->root = c;
+  else set_child(t, parent, dir, c);
+}
+
+// parent(이미 현재 버전 전용)의 dir쪽 자식을 현재 버전 전용으로 만들어 반환. 공유 중이면 복사본으로 바꿔 끼움
+static node_t *own(rbtree *t, node_t *parent, int dir) {
+  node_t *c = parent == t->nil ? t->root : child(t, parent, dir);
+  if (NODE_REFS(t, c) == 1) return c;
+
+  node_t *n = pool_alloc(&t->pool);      //갱신 전에 확보해 두었으므로 실패하지 않음
+  memcpy(n, c, t->pool.stride);
+  NODE_REFS(t, n) = 1;
+  NODE_REFS(t, c)--;
+  if (LEFT(c) != t->nil) NODE_REFS(t, LEFT(c))++;
+  if (RIGHT(c) != t->nil) NODE_REFS(t, RIGHT(c))++;
+  replace_child(t, parent, dir, n);
+  return n;
+}
+
+// p를 가리키던 링크 하나가 사라짐. 아무도 가리키지 않게 된 노드는 풀에 반납
+static void node_unref(rbtree *t, node_t *p) {
+  while (p != t->nil && --NODE_REFS(t, p) == 0) {
+    node_t *l = LEFT(p), *r = RIGHT(p);
+    pool_free(&t->pool, p);
+    node_unref(t, l);
+    p = r;
+  }
+}
+
+// x(parent의 pdir쪽 자식)를 d 방향으로 회전 (d가 0이면 왼쪽 회전). 올라오는 자식도 현재 버전 전용이어야 함
+static void rotate_dir(rbtree *t, node_t *parent, int pdir, node_t *x, int d) {
+  node_t *y = child(t, x, !d);
+  STAT_ADD(t, rotate_left, d == 0);
+  STAT_ADD(t, rotate_right, d != 0);
+  set_child(t, x, !d, child(t, y, d));
+  set_child(t, y, d, x);
+  replace_child(t, parent, pdir, y);
+#ifdef RBTREE_ORDER_STATISTICS
+  UPDATE_SIZE(t, x);
+  UPDATE_SIZE(t, y);
+#endif
+}
+
+// 갱신을 시작하기 전: 반납된 snapshot을 회수하고, snapshot이 남아 있으면 복사할 노드를 미리 확보
+static int persist_begin(rbtree *t) {
+  rbtree_reclaim(t);
+  //snapshot이 하나도 없으면 모든 노드의 링크 수가 1이라 복사가 일어나지 않음
+  if (t->versions == NULL) return 0;
+  return pool_reserve(&t->pool, PERSIST_RESERVE);
+}
+
+// path[i]에 새로 매단 빨간 노드부터 위로 균형 복구 (path[i - 1]이 부모, dirs[i - 1]이 부모에서의 방향)
+static void persist_insert_fixup(rbtree *t, node_t **path, int *dirs, int i) {
+  while (i >= 2 && COLOR(path[i - 1]) == RBTREE_RED) {
+    node_t *p = path[i - 1], *g = path[i - 2];
+    int pd = dirs[i - 2];
+    if (COLOR(child(t, g, !pd)) == RBTREE_RED) {
+      STAT(t, insert_fixup[0]);
+      node_t *u = own(t, g, !pd);
+      SET_COLOR(p, RBTREE_BLACK);
+      SET_COLOR(u, RBTREE_BLACK);
+      SET_COLOR(g, RBTREE_RED);
+      i -= 2;
+      continue;
+    }
+    if (dirs[i - 1] != pd) {
+      STAT(t, insert_fixup[1]);
+      rotate_dir(t, g, pd, p, pd);
+      p = path[i];
+    }
+    STAT(t, insert_fixup[2]);
+    SET_COLOR(p, RBTREE_BLACK);
+    SET_COLOR(g, RBTREE_RED);
+    rotate_dir(t, i >= 3 ? path[i - 3] : t->nil, i >= 3 ? dirs[i - 3] : 0, g, !pd);
+    break;
+  }
+  SET_COLOR(t->root, RBTREE_BLACK);
+}
+
+// 영속 모드 삽입. unique면 같은 key가 이미 있을 때 새로 넣지 않고 그 노드를 반환 (*found = 1)
+static node_t *persist_insert(rbtree *t, const key_t key, int unique, int *found) {
+  node_t *path[PATH_MAX_DEPTH];
+  int dirs[PATH_MAX_DEPTH];
+  int n = 0;
+  *found = 0;
+  STAT(t, inserts);
+  if (persist_begin(t) != 0) return NULL;
+
+  //내려가면서 지나는 노드를 현재 버전 전용으로 만듦
+  node_t *parent = t->nil;
+  int dir = 0;
+  while ((parent == t->nil ? t->root : child(t, parent, dir)) != t->nil) {
+    node_t *x = own(t, parent, dir);
+    STAT(t, insert_compares);
+    if ((unique || t->collapse_duplicates) && x->key == key) {
+      *found = 1;
+      if (t->collapse_duplicates && !unique) {
+        NODE_COUNT(x)++;
+        t->count++;
+#ifdef RBTREE_ORDER_STATISTICS
+        x->size++;
+        for (int i = 0; i < n; i++) path[i]->size++;
+#endif
+      }
+      reset_ends(t);    //경로를 복사했으므로 끝 노드도 새 사본으로 바꿈 (옛 노드는 snapshot만 봄)
+      return x;
+    }
+    dir = x->key > key ? 0 : 1;
+    path[n] = x;
+    dirs[n++] = dir;
+    parent = x;
+  }
+
+  node_t *z = pool_alloc(&t->pool);
+  if (z == NULL) return NULL;
+  z->key = key;
+  SET_PARENT(z, t->nil);
+  SET_LEFT(z, t->nil);
+  SET_RIGHT(z, t->nil);
+  SET_COLOR(z, RBTREE_RED);
+  NODE_REFS(t, z) = 1;
+  if (t->collapse_duplicates) NODE_COUNT(z) = 1;
+  if (t->value_size > 0) memset(rbtree_value(t, z), 0, t->value_size);
+#ifdef RBTREE_ORDER_STATISTICS
+  z->size = 1;
+  for (int i = 0; i < n; i++) path[i]->size++;
+#endif
+  replace_child(t, parent, dir, z);
+  t->count++;
+  path[n] = z;
+  persist_insert_fixup(t, path, dirs, n);
+  reset_ends(t);
+  return z;
+}
+
+// path[i]의 자리에 검은 높이가 하나 모자란 x가 들어온 상태에서 균형 복구
+static void persist_erase_fixup(rbtree *t, node_t **path, int *dirs, int i, node_t *x) {
+  while (i > 0 && COLOR(x) == RBTREE_BLACK) {
+    node_t *p = path[i - 1];
+    int d = dirs[i - 1];
+    node_t *gp = i >= 2 ? path[i - 2] : t->nil;
+    int gd = i >= 2 ? dirs[i - 2] : 0;
+    node_t *w = own(t, p, !d);
+    if (COLOR(w) == RBTREE_RED) {
+      STAT(t, erase_fixup[0]);
+      SET_COLOR(w, RBTREE_BLACK);
+      SET_COLOR(p, RBTREE_RED);
+      rotate_dir(t, gp, gd, p, d);
+      //w가 p 자리로 올라왔으니 경로에 끼워 넣음
+      path[i - 1] = w;
+      path[i] = p;
+      dirs[i] = d;
+      gp = w;
+      gd = d;
+      i++;
+      w = own(t, p, !d);
+    }
+    if (COLOR(LEFT(w)) == RBTREE_BLACK && COLOR(RIGHT(w)) == RBTREE_BLACK) {
+      STAT(t, erase_fixup[1]);
+      SET_COLOR(w, RBTREE_RED);
+      x = p;
+      i--;
+      continue;
+    }
+    if (COLOR(child(t, w, !d)) == RBTREE_BLACK) {
+      STAT(t, erase_fixup[2]);
+      node_t *c = own(t, w, d);
+      SET_COLOR(c, RBTREE_BLACK);
+      SET_COLOR(w, RBTREE_RED);
+      rotate_dir(t, p, !d, w, !d);
+      w = c;
+    }
+    STAT(t, erase_fixup[3]);
+    SET_COLOR(w, COLOR(p));
+    SET_COLOR(p, RBTREE_BLACK);
+    SET_COLOR(own(t, w, !d), RBTREE_BLACK);
+    rotate_dir(t, gp, gd, p, d);
+    return;
+  }
+  if (x != t->nil && COLOR(x) == RBTREE_RED) {
+    x = own(t, i > 0 ? path[i - 1] : t->nil, i > 0 ? dirs[i - 1] : 0);
+    SET_COLOR(x, RBTREE_BLACK);
+  }
+}
+
+// 영속 모드 삭제: key와 같은 원소 하나를 지움 (지웠으면 1)
+static int persist_erase(rbtree *t, const key_t key) {
+  if (rbtree_find(t, key) == NULL) return 0;
+  if (persist_begin(t) != 0) return 0;
+
+  node_t *path[PATH_MAX_DEPTH];
+  int dirs[PATH_MAX_DEPTH];
+  int n = 0;
+  node_t *parent = t->nil;
+  int dir = 0;
+  node_t *z;
+  for (;;) {
+    z = own(t, parent, dir);
+    if (z->key == key) break;
+    dir = z->key > key ? 0 : 1;
+    path[n] = z;
+    dirs[n++] = dir;
+    parent = z;
+  }
+#ifdef RBTREE_ORDER_STATISTICS
+  const int iz = n;
+#endif
+  const size_t wz = node_weight(t, z);
+  if (wz > 1) {
+    NODE_COUNT(z)--;
+    t->count--;
+#ifdef RBTREE_ORDER_STATISTICS
+    z->size--;
+    for (int i = 0; i < n; i++) path[i]->size--;
+#endif
+    reset_ends(t);
+    return 1;
+  }
+
+  //자식이 둘이면 다음 노드 y의 내용을 z로 옮기고 y를 대신 뺌
+  node_t *y = z;
+  if (LEFT(z) != t->nil && RIGHT(z) != t->nil) {
+    path[n] = z;
+    dirs[n++] = 1;
+    y = own(t, z, 1);
+    while (LEFT(y) != t->nil) {
+      path[n] = y;
+      dirs[n++] = 0;
+      y = own(t, y, 0);
+    }
+  }
+#ifdef RBTREE_ORDER_STATISTICS
+  //z까지는 z의 원소가, 그 아래 y의 부모까지는 y가 빠짐 (z에는 y의 개수가 들어옴)
+  for (int i = 0; i < n; i++) path[i]->size -= i <= iz ? wz : node_weight(t, y);
+#endif
+  if (y != z) {
+    z->key = y->key;
+    if (t->collapse_duplicates) NODE_COUNT(z) = NODE_COUNT(y);
+    if (t->value_size > 0) memcpy(rbtree_value(t, z), rbtree_value(t, y), t->value_size);
+  }
+
+  node_t *x = LEFT(y) != t->nil ? LEFT(y) : RIGHT(y);
+  color_t y_color = COLOR(y);
+  replace_child(t, n > 0 ? path[n - 1] : t->nil, n > 0 ? dirs[n - 1] : 0, x);
+  pool_free(&t->pool, y);   //y로 오던 링크가 x로 옮겨 갔으므로 x의 링크 수는 그대로
+  t->count--;
+  if (y_color == RBTREE_BLACK) persist_erase_fixup(t, path, dirs, n, x);
+  reset_ends(t);
+  return 1;
+}
+
+// 영속 트리의 현재 버전을 O(1)에 고정해서 읽기 전용 트리로 반환 (영속 모드가 아니면 NULL)
+// 쓰는 쪽 스레드에서 만들어 읽는 스레드에 넘기며, 읽는 쪽은 find, lower/upper_bound, foreach_range,
+// to_array, min/max, select 등 parent 링크를 쓰지 않는 함수만 쓸 수 있음
+rbtree *rbtree_snapshot(rbtree *t) {
+  if (!t->persistent) return NULL;
+  rbtree_reclaim(t);
+  rbtree_version *v = (rbtree_version *)calloc(1, sizeof(rbtree_version));
+  if (v == NULL) return NULL;
+  v->view = *t;
+  v->view.versions = NULL;
+  atomic_init(&v->released, 0);
+  if (t->root != t->nil) NODE_REFS(t, t->root)++;
+  v->next = t->versions;
+  t->versions = v;
+  return &v->view;
+}
+
+// 다 쓴 snapshot을 반납 (어느 스레드에서든 호출 가능). 노드는 쓰는 쪽이 다음 갱신 때 회수함
+void rbtree_snapshot_release(rbtree *snap) {
+  atomic_store_explicit(&((rbtree_version *)snap)->released, 1, memory_order_release);
+}
+
+// 반납된 snapshot들이 쥐고 있던 노드 중 더 이상 아무도 보지 않는 것을 풀로 돌려줌. 회수한 snapshot 수 반환
+size_t rbtree_reclaim(rbtree *t) {
+  size_t reclaimed = 0;
+  rbtree_version **link = &t->versions;
+  while (*link != NULL) {
+    rbtree_version *v = *link;
+    if (!atomic_load_explicit(&v->released, memory_order_acquire)) {
+      link = &v->next;
+      continue;
+    }
+    *link = v->next;
+    node_unref(t, v->view.root);
+    free(v);
+    reclaimed++;
+  }
+  return reclaimed;
+}
 
 rbtree *new_rbtree(void) {
-  rbtree *p = (rbtree *)calloc(1, sizeof(rbtree));
+  return new_rbtree_opts(NULL);
+}
+
+// hint개의 노드를 미리 확보해 둔 트리 생성 (0이면 필요할 때마다 slab을 받음)
+rbtree *new_rbtree_with_capacity(const size_t hint) {
+  rbtree_options opts = {0};
+  opts.capacity = hint;
+  return new_rbtree_opts(&opts);
+}
+
+// 옵션을 지정해 트리 생성 (opts가 NULL이면 기본값)
+rbtree *new_rbtree_opts(const rbtree_options *opts) {
+  rbtree_options def = {0};
+  if (opts == NULL) opts = &def;
+
+  rbtree *t = (rbtree *)calloc(1, sizeof(rbtree));
+  if (t == NULL) return NULL;
+  t->collapse_duplicates = opts->collapse_duplicates != 0;
+
+  //노드 뒤에 붙는 추가 필드만큼 노드 간격을 늘림
+  size_t stride = sizeof(node_t);
+  if (t->collapse_duplicates) stride += sizeof(size_t);
+  t->persistent = opts->persistent != 0;
+  if (t->persistent) {
+    t->refs_offset = stride;
+    stride += sizeof(size_t);
+  }
+  if (opts->value_size > 0) {
+    //value는 8바이트 경계에 두고, 노드가 한 캐시 라인에 들어가면 간격을 2의 거듭제곱으로 맞춰
+    //key와 value가 항상 같은 라인에 있게 함
+    t->value_size = opts->value_size;
+    t->value_offset = (stride + 7) & ~(size_t)7;
+    stride = (t->value_offset + t->value_size + 7) & ~(size_t)7;
+    if (stride <= CACHE_LINE) {
+      size_t p2 = 8;
+      while (p2 < stride) p2 *= 2;
+      stride = p2;
+    }
+  }
+  if (pool_init(&t->pool, stride, opts->capacity) != 0) {
+    pool_destroy(&t->pool);
+    free(t);
+    return NULL;
+  }
+
+#ifdef RBTREE_INDEX32
+  node_t *NIL = pool_take(&t->pool, 1);   //0번 노드가 nil: 링크가 전부 0이면 nil을 가리킴
+#else
   node_t *NIL = (node_t*)calloc(1, sizeof(node_t));
-  NIL->color = RBTREE_BLACK;
-  p->root = p->nil = NIL;
-  return p;
+#endif
+  t->root = t->nil = t->leftmost = t->rightmost = NIL;
+  SET_COLOR(NIL, RBTREE_BLACK);
+  //capacity를 주었으면 색인도 그만큼 미리 늘려 둠
+  if (opts->hash_index &&
+      (rbtree_hash_index_enable(t) != 0 || hash_resize(t->hash, hash_slots_for(opts->capacity)) != 0)) {
+    delete_rbtree(t);
+    return NULL;
+  }
+  return t;
 }
 
 // 해당 tree가 사용했던 메모리를 전부 반환해야 합니다. (valgrind로 나타나지 않아야 함)
 void delete_rbtree(rbtree *t) {
-  delete_rbtree_sub(t, t->root);    //노드들 메모리 전부 해제
-  free(t->nil);                     //nil 메모리 해제 (root는 노드 메모리 해제할 때 기수행)
+  //남은 snapshot도 함께 사라짐 (노드가 풀과 함께 해제되므로 먼저 다 읽고 나서 지워야 함)
+  while (t->versions != NULL) {
+    rbtree_version *v = t->versions;
+    t->versions = v->next;
+    free(v);
+  }
+#ifndef RBTREE_INDEX32
+  //nil 메모리 해제 (인덱스 레이아웃에서는 풀의 0번 노드, arena를 쓰면 arena가 해제)
+  if (!pool_shared(&t->pool)) free(t->nil);
+#endif
+  pool_destroy(&t->pool);           //노드 메모리는 전부 slab 단위로 한꺼번에 해제
+  if (t->hash != NULL) hash_drop(t);
   free(t);                          //구조체 메모리 해제
 }
 
+// 트리를 비우되 구조체와 nil은 그대로 두어 계속 쓸 수 있게 함
+void rbtree_clear(rbtree *t) {
+  if (t->persistent) rbtree_reclaim(t);
+  if (t->versions != NULL) node_unref(t, t->root);  //snapshot이 보고 있는 노드는 남겨 둠
+  else if (pool_shared(&t->pool)) delete_rbtree_sub(t, t->root);  //다른 트리의 노드가 같은 slab에 있음
+  else pool_reset(&t->pool);
+  t->root = t->leftmost = t->rightmost = t->nil;
+  t->count = 0;
+  if (t->hash != NULL) {
+    memset(t->hash->slots, 0, (t->hash->mask + 1) * sizeof(hash_slot));
+    t->hash->used = 0;
+  }
+}
+
+// p를 루트로 하는 서브트리의 노드들을 풀에 반납 (재귀 없이 O(1) 스택)
 void delete_rbtree_sub(rbtree *t, node_t *p) {
-  if (p != t->nil) {
-    //재귀적으로 메모리 해제 수행
-    delete_rbtree_sub(t, p->left);    
-    delete_rbtree_sub(t, p->right);
-    free(p); 
+  //트리 전체를 지우면 끝 노드도 없어짐 (루트는 호출한 쪽이 nil로 바꿈)
+  if (p == t->root) t->leftmost = t->rightmost = t->nil;
+  const int unhash = t->hash != NULL;
+  if (unhash && p == t->root) {
+    memset(t->hash->slots, 0, (t->hash->mask + 1) * sizeof(hash_slot));
+    t->hash->used = 0;
+  }
+  while (p != t->nil) {
+    if (LEFT(p) != t->nil) {
+      //왼쪽 자식을 위로 올려(오른쪽 회전) 왼쪽 서브트리를 없애 나감
+      node_t *l = LEFT(p);
+      SET_LEFT(p, RIGHT(l));
+      SET_RIGHT(l, p);
+      p = l;
+    } else {
+      node_t *next = RIGHT(p);
+      if (unhash) hash_forget(t->hash, p);
+      pool_free(&t->pool, p);
+      p = next;
+    }
   }
 }
 
-// 구현하는 ADT가 multiset이므로 이미 같은 key의 값이 존재해도 하나 더 추가 합니다.
-node_t *rbtree_insert(rbtree *t, const key_t key) {
-  node_t *x = t->root;                                  //key의 비교 대상 노드
-  node_t *y = t->nil;                                   //key의 부모 노드
-  node_t *cur = (node_t*)calloc(1, sizeof(node_t));     //삽입 노드 메모리 할당해주기
+// arr[lo, hi)로 균형 잡힌 서브트리를 만듦. arr[i]는 nodes[i]에 들어가므로 중위 순서대로 메모리에 놓임
+static node_t *build_sorted_sub(rbtree *t, node_t *nodes, const key_t *arr, size_t lo, size_t hi,
+                                node_t *parent, int depth, int red_depth) {
+  if (lo >= hi) return t->nil;
+  size_t mid = lo + (hi - lo) / 2;
+  node_t *p = NODE_AT(nodes, mid, t->pool.stride);
+  p->key = arr[mid];
+  SET_PARENT(p, parent);
+  //가장 깊은 레벨만 RED로 두면 모든 경로의 black 개수가 같아짐
+  SET_COLOR(p, (depth == red_depth && depth > 0) ? RBTREE_RED : RBTREE_BLACK);
+  SET_LEFT(p, build_sorted_sub(t, nodes, arr, lo, mid, p, depth + 1, red_depth));
+  SET_RIGHT(p, build_sorted_sub(t, nodes, arr, mid + 1, hi, p, depth + 1, red_depth));
+#ifdef RBTREE_ORDER_STATISTICS
+  p->size = hi - lo;
+#endif
+  return p;
+}
 
-  //root부터 아래로 노드 삽입 위치 찾아가기
-  while (x != t->nil) {
-    y = x;
-    if (x->key > key) x = x->left;
-    else x = x->right;
+// 정렬된 배열로 트리를 O(n)에 생성 (회전 없음). 정렬되어 있지 않으면 NULL 반환
+rbtree *rbtree_build_from_sorted(const key_t *arr, const size_t n) {
+  for (size_t i = 1; i < n; i++) {
+    if (arr[i - 1] > arr[i]) return NULL;
+  }
+  rbtree *t = new_rbtree_with_capacity(n);
+  if (t == NULL || n == 0) return t;
+
+  //노드 n개를 한 구간에서 연속으로 꺼내 씀
+  node_t *nodes = pool_take(&t->pool, n);
+  if (nodes == NULL) {
+    delete_rbtree(t);
+    return NULL;
   }
+
+  //중간값 분할 트리의 가장 깊은 레벨은 floor(log2(n))
+  int red_depth = 0;
+  while (((size_t)2 << red_depth) <= n) red_depth++;
+  t->root = build_sorted_sub(t, nodes, arr, 0, n, t->nil, 0, red_depth);
+  t->count = n;
+  reset_ends(t);
+  return t;
+}
+
+// 중복을 모으는 트리에서 p에 같은 key 하나를 더함
+static node_t *add_copy(rbtree *t, node_t *p) {
+  NODE_COUNT(p)++;
+#ifdef RBTREE_ORDER_STATISTICS
+  add_size_upward(t, p, 1);
+#endif
+  t->count++;
+  return p;
+}
+
+// y의 자식 자리에 key를 가진 새 노드를 매달고 균형을 맞춤 (value는 0으로 채움)
+static node_t *attach(rbtree *t, node_t *y, const key_t key) {
+  node_t *cur = pool_alloc(&t->pool);                   //삽입 노드를 풀에서 꺼내오기
+  if (cur == NULL) return NULL;
   
   // 위치 찾았으니 cur의 정보(key, color, parent, left, right) 초기화
   cur->key = key;
-  cur->parent = y;
+  SET_PARENT(cur, y);
 
   // cur 위치에 따라 부모의 자식노드 업데이트 해주기
-  if (y == t->nil) t->root = cur;
-  else if (cur->key < y->key) y->left = cur;
-  else y->right = cur;
-  cur->color = RBTREE_RED;
-  cur->left = cur->right = t->nil;
+  //가장 작은/큰 노드의 바깥쪽에 매달리면 새 노드가 그 자리를 이어받음 (회전은 노드를 바꾸지 않음)
+  if (y == t->nil) {
+    t->root = t->leftmost = t->rightmost = cur;
+  } else if (cur->key < y->key) {
+    SET_LEFT(y, cur);
+    if (y == t->leftmost) t->leftmost = cur;
+  } else {
+    SET_RIGHT(y, cur);
+    if (y == t->rightmost) t->rightmost = cur;
+  }
+  SET_COLOR(cur, RBTREE_RED);
+  SET_LEFT(cur, t->nil);
+  SET_RIGHT(cur, t->nil);
+  if (t->collapse_duplicates) NODE_COUNT(cur) = 1;
+  if (t->value_size > 0) memset(rbtree_value(t, cur), 0, t->value_size);
+#ifdef RBTREE_ORDER_STATISTICS
+  cur->size = 1;
+  add_size_upward(t, y, 1);
+#endif
+  t->count++;
   rbtree_insert_fixup(t, cur);
+  hash_attach(t, cur);
 
-  return t->root;     //속성유지
+  return cur;
+}
+
+// x(부모 y)부터 아래로 내려가며 삽입 위치를 찾아 key를 매달고 새 노드 반환
+static node_t *insert_from(rbtree *t, node_t *x, node_t *y, const key_t key) {
+  //x부터 아래로 노드 삽입 위치 찾아가기
+  if (t->collapse_duplicates) {
+    while (x != t->nil) {
+      //같은 key가 이미 있으면 개수만 늘림 (할당, 회전 없음)
+      STAT(t, insert_compares);
+      if (x->key == key) return add_copy(t, x);
+      y = x;
+      if (x->key > key) x = LEFT(x);
+      else x = RIGHT(x);
+    }
+  } else {
+    while (x != t->nil) {
+      STAT(t, insert_compares);
+      y = x;
+      if (x->key > key) x = LEFT(x);
+      else x = RIGHT(x);
+    }
+  }
+  return attach(t, y, key);
+}
+
+// 구현하는 ADT가 multiset이므로 이미 같은 key의 값이 존재해도 하나 더 추가 합니다.
+// 새로 추가된 노드를 반환 (메모리가 부족하면 NULL)
+node_t *rbtree_insert(rbtree *t, const key_t key) {
+  if (t->persistent) {
+    int found;
+    return persist_insert(t, key, 0, &found);
+  }
+  //양 끝 바깥으로 들어가는 key(거의 정렬된 순서로 들어오는 key)는 루트에서 내려가지 않고 끝 노드에 바로 매닮
+  STAT(t, inserts);
+  if (t->collapse_duplicates && t->hash != NULL) {
+    node_t *p = hash_get(t->hash, key);
+    if (p != NULL) return add_copy(t, p);
+  }
+  node_t *hi = t->rightmost, *lo = t->leftmost;
+  if (hi != t->nil && key >= hi->key) return insert_from(t, hi, PARENT(hi), key);
+  if (lo != t->nil && key < lo->key) return insert_from(t, lo, PARENT(lo), key);
+  return insert_from(t, t->root, t->nil, key);
+}
+
+// key가 있으면 그 노드, 없으면 새로 매단 노드 (루트에서 한 번만 내려감)
+static node_t *map_slot(rbtree *t, const key_t key, int *inserted) {
+  if (t->persistent) {
+    int found;
+    node_t *p = persist_insert(t, key, 1, &found);
+    *inserted = !found;
+    return p;
+  }
+  node_t *x = t->root, *y = t->nil;
+  STAT(t, inserts);
+  if (t->hash != NULL) {
+    //색인에 없으면 새 key이므로 비교 없이 내려가서 매닮
+    node_t *p = hash_get(t->hash, key);
+    if (p != NULL) {
+      *inserted = 0;
+      return p;
+    }
+  }
+  //가장 큰 key보다 크면 오른쪽 끝에 바로 매닮
+  if (t->rightmost != t->nil && key > t->rightmost->key) {
+    x = t->nil;
+    y = t->rightmost;
+  }
+  while (x != t->nil) {
+    STAT(t, insert_compares);
+    if (x->key == key) {
+      *inserted = 0;
+      return x;
+    }
+    y = x;
+    x = x->key > key ? LEFT(x) : RIGHT(x);
+  }
+  *inserted = 1;
+  return attach(t, y, key);
+}
+
+// key의 value를 덮어쓰고(없으면 새로 넣고) 노드 안의 value 위치 반환 (메모리가 부족하면 NULL)
+void *rbtree_map_put(rbtree *t, const key_t key, const void *value) {
+  int inserted;
+  node_t *p = map_slot(t, key, &inserted);
+  if (p == NULL) return NULL;
+  return memcpy(rbtree_value(t, p), value, t->value_size);
+}
+
+// key의 value 위치 (없으면 NULL)
+void *rbtree_map_get(const rbtree *t, const key_t key) {
+  node_t *p = rbtree_find(t, key);
+  return p == NULL ? NULL : rbtree_value(t, p);
+}
+
+// key의 value 위치. 없으면 0으로 채운 value를 새로 넣고, inserted(NULL 가능)에 새로 넣었는지 적음
+void *rbtree_map_get_or_insert(rbtree *t, const key_t key, int *inserted) {
+  int ins;
+  node_t *p = map_slot(t, key, &ins);
+  if (inserted != NULL) *inserted = ins;
+  return p == NULL ? NULL : rbtree_value(t, p);
+}
+
+// hint 근처에 key를 삽입. key가 hint 바로 앞이나 뒤에 들어갈 자리면 루트까지 가지 않고 그 자리에 매닮
+// (멀면 key가 들어갈 범위를 덮는 가장 작은 서브트리까지만 올라갔다가 내려감)
+node_t *rbtree_insert_hint(rbtree *t, node_t *hint, const key_t key) {
+  if (hint == NULL || t->persistent) return rbtree_insert(t, key);
+  STAT(t, inserts);
+  if (hint->key > key) {
+    //hint와 그 이전 노드 사이면 hint의 왼쪽 또는 이전 노드의 오른쪽 빈자리에 매닮
+    node_t *pred = hint == t->leftmost ? NULL : rbtree_prev(t, hint);
+    if (pred == NULL || pred->key <= key) {
+      if (pred != NULL && t->collapse_duplicates && pred->key == key) return add_copy(t, pred);
+      if (LEFT(hint) == t->nil) return insert_from(t, t->nil, hint, key);
+      return insert_from(t, t->nil, pred, key);
+    }
+    node_t *u = hint;
+    while (PARENT(u) != t->nil && !(u == RIGHT(PARENT(u)) && PARENT(u)->key <= key)) u = PARENT(u);
+    //멈춘 조상이 같은 key면 그 아래 서브트리에는 key가 없으므로 조상에 개수를 더함
+    if (t->collapse_duplicates && PARENT(u) != t->nil && PARENT(u)->key == key) return add_copy(t, PARENT(u));
+    return insert_from(t, u, PARENT(u), key);
+  }
+  if (t->collapse_duplicates && hint->key == key) return add_copy(t, hint);
+
+  //hint와 그 다음 노드 사이에 들어가면 바로 그 자리에 매닮 (끝 노드에서 이웃을 찾으며 루트까지 올라가지 않음)
+  node_t *succ = hint == t->rightmost ? NULL : rbtree_next(t, hint);
+  if (succ == NULL || key < succ->key) {
+    if (RIGHT(hint) == t->nil) return insert_from(t, t->nil, hint, key);
+    return insert_from(t, t->nil, succ, key);
+  }
+
+  //아니면 key가 들어갈 범위를 덮는 가장 작은 서브트리까지만 올라갔다가 내려감
+  node_t *u = hint;
+  while (PARENT(u) != t->nil && !(u == LEFT(PARENT(u)) && PARENT(u)->key > key)) u = PARENT(u);
+  return insert_from(t, u, PARENT(u), key);
+}
+
+// start 이후에서 key 이상인 첫 노드 (start->key < key 이어야 함)
+static node_t *lower_bound_from(const rbtree *t, node_t *start, const key_t key) {
+  node_t *u = start;
+  while (PARENT(u) != t->nil && !(u == LEFT(PARENT(u)) && PARENT(u)->key >= key)) u = PARENT(u);
+
+  node_t *res = PARENT(u) == t->nil ? NULL : PARENT(u);
+  node_t *cur = PARENT(u) == t->nil ? t->root : u;
+  while (cur != t->nil) {
+    if (cur->key < key) cur = RIGHT(cur);
+    else {
+      res = cur;
+      cur = LEFT(cur);
+    }
+  }
+  return res;
+}
+
+static int comp_key(const void *p1, const void *p2) {
+  const key_t *e1 = (const key_t *)p1;
+  const key_t *e2 = (const key_t *)p2;
+  return (*e1 > *e2) - (*e1 < *e2);
+}
+
+// 정렬된 배열이면 그대로, 아니면 정렬한 복사본을 *copy에 담아 돌려줌 (실패하면 NULL)
+static const key_t *sorted_batch(const key_t *keys, const size_t n, key_t **copy) {
+  *copy = NULL;
+  size_t i = 1;
+  while (i < n && keys[i - 1] <= keys[i]) i++;
+  if (i >= n) return keys;
+
+  *copy = (key_t *)malloc(n * sizeof(key_t));
+  if (*copy == NULL) return NULL;
+  for (i = 0; i < n; i++) (*copy)[i] = keys[i];
+  qsort(*copy, n, sizeof(key_t), comp_key);
+  return *copy;
+}
+
+// n개의 key를 한꺼번에 삽입. 정렬 순서로 넣으면서 직전 삽입 위치에서부터 자리를 찾음
+// 삽입된 개수 반환
+size_t rbtree_insert_batch(rbtree *t, const key_t *keys, const size_t n) {
+  key_t *copy;
+  const key_t *sorted = sorted_batch(keys, n, &copy);
+  if (sorted == NULL) return 0;
+
+  size_t inserted = 0;
+  node_t *last = NULL;
+  for (size_t i = 0; i < n; i++) {
+    //영속 모드는 parent 링크가 없어서 매번 루트에서 내려감 (rbtree_insert_hint가 hint를 무시)
+    node_t *p = rbtree_insert_hint(t, last, sorted[i]);
+    if (p == NULL) break;
+    last = p;
+    inserted++;
+  }
+  free(copy);
+  return inserted;
+}
+
+// keys에 있는 key마다 같은 key를 가진 노드를 하나씩 삭제. 삭제된 개수 반환
+size_t rbtree_erase_keys_batch(rbtree *t, const key_t *keys, const size_t n) {
+  key_t *copy;
+  const key_t *sorted = sorted_batch(keys, n, &copy);
+  if (sorted == NULL) return 0;
+
+  size_t erased = 0;
+  if (t->persistent) {
+    for (size_t i = 0; i < n; i++) erased += persist_erase(t, sorted[i]);
+    free(copy);
+    return erased;
+  }
+  node_t *next = NULL;    //직전에 지운 노드의 다음 노드: 다음 key는 여기서부터 찾음
+  int started = 0;
+  for (size_t i = 0; i < n; i++) {
+    const key_t key = sorted[i];
+    node_t *p;
+    if (!started) p = rbtree_lower_bound(t, key);
+    else if (next == NULL || next->key >= key) p = next;
+    else p = lower_bound_from(t, next, key);
+    started = 1;
+
+    if (p == NULL || p->key != key) {
+      next = p;
+      continue;
+    }
+    //개수만 줄어드는 경우엔 p가 남아 있으므로 다음 key도 p부터 봄
+    next = node_weight(t, p) > 1 ? p : rbtree_next(t, p);
+    rbtree_erase(t, p);
+    erased++;
+  }
+  free(copy);
+  return erased;
+}
+
+// ---- join 기반 연산 (split, concat, union, intersection, difference) ----
+// 두 서브트리를 key 하나를 사이에 두고 잇는 join을 바탕으로, 트리를 나누고 합치고 집합 연산을 함.
+// 노드는 새로 할당하지 않고 옮기며, 크기가 n, m (m <= n)인 두 트리의 집합 연산은 O(m log(n/m + 1)).
+// 서브트리는 루트의 parent가 nil인 채로 주고받고, 검은 높이(자신 포함, nil 제외)를 함께 넘김
+// 다른 트리에서 노드를 옮겨 오면 두 트리는 slab과 nil을 함께 쓰게 됨 (같은 arena의 트리끼리는
+// 여러 스레드에서 동시에 고치면 안 됨). 인덱스 레이아웃에서는 노드가 자기 트리의 배열을 벗어날 수 없어서 복사함
+
+// 중복 key를 노드 하나로 다루는 트리 (집합 연산에서 같은 key의 노드를 하나로 합침)
+static inline int unique_keys(const rbtree *t) {
+  return t->collapse_duplicates || t->value_size > 0;
+}
+
+// 노드를 주고받을 수 있는 두 트리인지 (노드 모양이 같아야 함, 영속 트리는 제외)
+static int compatible(const rbtree *a, const rbtree *b) {
+  return a != b && !a->persistent && !b->persistent &&
+         a->collapse_duplicates == b->collapse_duplicates && a->value_size == b->value_size;
+}
+
+// t와 같은 옵션의 빈 트리
+static rbtree *new_like(const rbtree *t) {
+  rbtree_options opts = {0};
+  opts.collapse_duplicates = t->collapse_duplicates;
+  opts.value_size = t->value_size;
+  return new_rbtree_opts(&opts);
+}
+
+// 두 트리 구조체의 내용을 통째로 맞바꿈 (노드와 풀이 함께 옮겨 감)
+// 해시 색인은 트리마다 켜고 끄는 설정이라 그대로 두고, 내용을 옮긴 쪽에서 hash_refresh로 다시 맞춤
+static void swap_trees(rbtree *a, rbtree *b) {
+  rbtree tmp = *a;
+  *a = *b;
+  *b = tmp;
+  b->hash = a->hash;
+  a->hash = tmp.hash;
+}
+
+static int subtree_black_height(const rbtree *t, const node_t *p) {
+  int h = 0;
+  for (; p != t->nil; p = LEFT(p)) h += COLOR(p) == RBTREE_BLACK;
+  return h;
+}
+
+static size_t subtree_nodes(const rbtree *t, const node_t *p) {
+  size_t n = 0;
+  while (p != t->nil) {
+    n += 1 + subtree_nodes(t, LEFT(p));
+    p = RIGHT(p);
+  }
+  return n;
+}
+
+// p 아래 노드를 모두 풀에 반납하고 그 노드들이 나타내던 원소 수를 반환
+static size_t discard_sub(rbtree *t, node_t *p) {
+  size_t n = 0;
+  while (p != t->nil) {
+    node_t *l = LEFT(p), *r = RIGHT(p);
+    n += node_weight(t, p) + discard_sub(t, l);
+    if (t->hash != NULL) hash_forget(t->hash, p);
+    pool_free(&t->pool, p);
+    p = r;
+  }
+  return n;
+}
+
+// src의 서브트리 p를 t의 풀에 같은 모양으로 복사
+static node_t *copy_sub(rbtree *t, const rbtree *src, const node_t *p, node_t *parent) {
+  if (p == src->nil) return t->nil;
+  node_t *n = pool_alloc(&t->pool);   //미리 확보해 두었으므로 실패하지 않음
+  memcpy(n, p, t->pool.stride);        //key, 색, 개수, value, 서브트리 크기
+  SET_PARENT(n, parent);
+  SET_LEFT(n, copy_sub(t, src, rbtree_left(src, p), n));
+  SET_RIGHT(n, copy_sub(t, src, rbtree_right(src, p), n));
+  return n;
+}
+
+#ifndef RBTREE_INDEX32
+// t의 slab과 nil을 다른 트리와 함께 쓸 수 있도록 arena로 옮김
+static int share_arena(rbtree *t) {
+  if (t->pool.arena != NULL) return 0;
+  rbtree_arena *a = (rbtree_arena *)malloc(sizeof(rbtree_arena));
+  if (a == NULL) return -1;
+  a->slabs = t->pool.slabs;
+  a->nil = t->nil;
+  a->trees = 1;
+  t->pool.slabs = NULL;
+  t->pool.arena = a;
+  return 0;
+}
+
+// 빈 트리 t를 arena a에 넣음: t의 slab은 a로 넘기고 nil은 a의 것을 씀
+static void arena_enter(rbtree *t, rbtree_arena *a) {
+  if (t->pool.slabs != NULL) {
+    rbtree_slab *last = t->pool.slabs;
+    while (last->next != NULL) last = last->next;
+    last->next = a->slabs;
+    a->slabs = t->pool.slabs;
+    t->pool.slabs = NULL;
+  }
+  free(t->nil);
+  t->root = t->nil = a->nil;
+  t->pool.arena = a;
+  a->trees++;
+}
+
+// 서브트리 p에서 old nil을 가리키던 링크를 t의 nil로 바꿈
+static void relink_nil(rbtree *t, node_t *p, const node_t *old) {
+  while (p != old) {
+    node_t *l = LEFT(p), *r = RIGHT(p);
+    if (l == old) SET_LEFT(p, t->nil);
+    else relink_nil(t, l, old);
+    if (r == old) SET_RIGHT(p, t->nil);
+    p = r;
+  }
+}
+#endif
+
+// src의 노드를 모두 t의 것으로 만들어 그 루트를 반환 (실패하면 NULL). src는 빈 트리로 남음
+// 같은 arena면 그대로, 아니면 slab을 넘겨받고 nil 링크만 고침 (O(src 크기)).
+// src의 slab을 다른 트리도 쓰고 있거나 인덱스 레이아웃이면 노드를 복사함
+static node_t *take_nodes(rbtree *t, rbtree *src) {
+  node_t *root = src->root;
+  if (root == src->nil) return t->nil;
+#ifndef RBTREE_INDEX32
+  rbtree_arena *b = src->pool.arena;
+  if (b != NULL && b == t->pool.arena) {
+    src->root = src->nil;
+    src->count = 0;
+    return root;
+  }
+  if (b == NULL || b->trees == 1) {
+    if (share_arena(t) != 0) return NULL;
+    relink_nil(t, root, src->nil);
+    SET_PARENT(root, t->nil);
+    if (b != NULL) {
+      //혼자 쓰던 arena는 풀어서 slab을 다시 src 소유로 돌린 뒤 t의 arena로 넘김
+      src->pool.slabs = b->slabs;
+      src->pool.arena = NULL;
+      free(b);
+    }
+    src->count = 0;
+    arena_enter(src, t->pool.arena);
+    return root;
+  }
+#endif
+  if (pool_reserve(&t->pool, subtree_nodes(src, root)) != 0) return NULL;
+  root = copy_sub(t, src, root, t->nil);
+  rbtree_clear(src);
+  return root;
+}
+
+// t2의 노드를 t1으로 가져와 원래 t1의 루트를 *a, t2의 루트를 *b에 담음. t1의 루트는 비워 둠
+// 옮기는 비용은 옮겨지는 쪽 크기에 비례하므로, 필요하면 두 트리의 내용을 맞바꿔 작은 쪽을 옮김
+static int absorb(rbtree *t1, rbtree *t2, node_t **a, node_t **b) {
+  int swapped = 0;
+#ifndef RBTREE_INDEX32
+  if (t1->pool.arena == NULL || t1->pool.arena != t2->pool.arena)
+#endif
+    swapped = t2->count > t1->count;
+  if (swapped) swap_trees(t1, t2);
+  node_t *moved = take_nodes(t1, t2);
+  if (moved == NULL) {
+    if (swapped) swap_trees(t1, t2);
+    return -1;
+  }
+  *a = swapped ? moved : t1->root;
+  *b = swapped ? t1->root : moved;
+  t1->root = t1->nil;
+  return 0;
+}
+
+// l < k < r 인 두 서브트리를 k로 이음 (l, r의 루트는 parent가 nil). 새 루트는 검은색, *h에 검은 높이
+// 검은 높이가 높은 쪽의 가장자리를 따라 내려가 높이가 같아지는 검은 노드 자리에 k를 빨갛게 끼우고 삽입처럼 복구
+static node_t *join_sub(rbtree *t, node_t *l, int hl, node_t *k, node_t *r, int hr, int *h) {
+  if (COLOR(l) == RBTREE_RED) {
+    SET_COLOR(l, RBTREE_BLACK);
+    hl++;
+  }
+  if (COLOR(r) == RBTREE_RED) {
+    SET_COLOR(r, RBTREE_BLACK);
+    hr++;
+  }
+  if (hl == hr) {
+    SET_LEFT(k, l);
+    SET_RIGHT(k, r);
+    SET_PARENT(k, t->nil);
+    SET_COLOR(k, RBTREE_BLACK);
+    if (l != t->nil) SET_PARENT(l, k);
+    if (r != t->nil) SET_PARENT(r, k);
+#ifdef RBTREE_ORDER_STATISTICS
+    UPDATE_SIZE(t, k);
+#endif
+    *h = hl + 1;
+    return k;
+  }
+
+  //d가 1이면 l의 오른쪽 가장자리, 0이면 r의 왼쪽 가장자리를 따라 내려감
+  const int d = hl > hr;
+  node_t *big = d ? l : r, *small = d ? r : l;
+  int hc = d ? hl : hr;
+  const int hs = d ? hr : hl;
+  *h = hc;
+  node_t *c = big, *p = t->nil;
+  while (hc > hs || COLOR(c) == RBTREE_RED) {
+    if (COLOR(c) == RBTREE_BLACK) hc--;
+    p = c;
+    c = child(t, c, d);
+  }
+  set_child(t, k, !d, c);
+  set_child(t, k, d, small);
+  if (c != t->nil) SET_PARENT(c, k);
+  if (small != t->nil) SET_PARENT(small, k);
+  SET_PARENT(k, p);
+  set_child(t, p, d, k);
+  SET_COLOR(k, RBTREE_RED);
+#ifdef RBTREE_ORDER_STATISTICS
+  UPDATE_SIZE(t, k);
+  add_size_upward(t, p, small->size + node_weight(t, k));
+#endif
+
+  //big을 잠시 트리의 루트로 두고 삽입과 같은 방법으로 복구 (회전이 루트를 바꿀 수 있으므로)
+  node_t *saved = t->root;
+  t->root = big;
+  node_t *z = k;
+  while (COLOR(PARENT(z)) == RBTREE_RED) {
+    node_t *pz = PARENT(z), *g = PARENT(pz);
+    const int pd = pz == RIGHT(g);
+    node_t *u = child(t, g, !pd);
+    if (COLOR(u) == RBTREE_RED) {
+      SET_COLOR(pz, RBTREE_BLACK);
+      SET_COLOR(u, RBTREE_BLACK);
+      SET_COLOR(g, RBTREE_RED);
+      z = g;
+      continue;
+    }
+    if (z == child(t, pz, !pd)) {
+      z = pz;
+      if (pd) rotate_right(t, z);
+      else rotate_left(t, z);
+      pz = PARENT(z);
+    }
+    SET_COLOR(pz, RBTREE_BLACK);
+    SET_COLOR(g, RBTREE_RED);
+    if (pd) rotate_left(t, g);
+    else rotate_right(t, g);
+  }
+  //빨간색이 루트까지 올라왔으면 검게 칠하고 검은 높이가 하나 늘어남
+  big = t->root;
+  t->root = saved;
+  if (COLOR(big) == RBTREE_RED) {
+    SET_COLOR(big, RBTREE_BLACK);
+    (*h)++;
+  }
+  return big;
+}
+
+// 서브트리 x(검은 높이 hx)를 key 앞뒤로 나눔: upper가 0이면 key 미만/이상, 1이면 key 이하/초과
+static void split_sub(rbtree *t, node_t *x, int hx, const key_t key, int upper,
+                      node_t **l, int *hl, node_t **r, int *hr) {
+  if (x == t->nil) {
+    *l = *r = t->nil;
+    *hl = *hr = 0;
+    return;
+  }
+  node_t *a = LEFT(x), *b = RIGHT(x);
+  const int hc = hx - (COLOR(x) == RBTREE_BLACK);
+  if (a != t->nil) SET_PARENT(a, t->nil);
+  if (b != t->nil) SET_PARENT(b, t->nil);
+  if (x->key < key || (upper && x->key == key)) {
+    node_t *bl;
+    int hbl;
+    split_sub(t, b, hc, key, upper, &bl, &hbl, r, hr);
+    *l = join_sub(t, a, hc, x, bl, hbl, hl);
+  } else {
+    node_t *ar;
+    int har;
+    split_sub(t, a, hc, key, upper, l, hl, &ar, &har);
+    *r = join_sub(t, ar, har, x, b, hc, hr);
+  }
+}
+
+// 서브트리 x에서 key가 가장 큰 노드를 떼어 *last에 담고 나머지를 반환
+static node_t *split_last(rbtree *t, node_t *x, int hx, node_t **last, int *h) {
+  node_t *a = LEFT(x), *b = RIGHT(x);
+  const int hc = hx - (COLOR(x) == RBTREE_BLACK);
+  if (a != t->nil) SET_PARENT(a, t->nil);
+  if (b == t->nil) {
+    *last = x;
+    *h = hc;
+    return a;
+  }
+  SET_PARENT(b, t->nil);
+  int hr;
+  node_t *rest = split_last(t, b, hc, last, &hr);
+  return join_sub(t, a, hc, x, rest, hr, h);
+}
+
+// a의 key가 모두 b의 key 이하일 때 두 서브트리를 이음
+static node_t *concat_sub(rbtree *t, node_t *a, int ha, node_t *b, int hb, int *h) {
+  if (a == t->nil) {
+    *h = hb;
+    return b;
+  }
+  if (b == t->nil) {
+    *h = ha;
+    return a;
+  }
+  node_t *last;
+  int hl;
+  node_t *rest = split_last(t, a, ha, &last, &hl);
+  return join_sub(t, rest, hl, last, b, hb, h);
+}
+
+// a를 key 미만 / key와 같음 / key 초과의 세 서브트리로 나눔
+static void split3(rbtree *t, node_t *a, int ha, const key_t key, node_t *out[3], int hout[3]) {
+  node_t *ge;
+  int hge;
+  split_sub(t, a, ha, key, 0, &out[0], &hout[0], &ge, &hge);
+  split_sub(t, ge, hge, key, 1, &out[1], &hout[1], &out[2], &hout[2]);
+}
+
+// 집합 연산은 b의 루트를 기준으로 a를 나누고, 양쪽을 재귀로 처리한 뒤 다시 이음.
+// a는 원래 t1, b는 t2의 노드. *removed에는 결과에서 빠진 t1의 원소 수를 더함
+enum { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE };
+
+// 한 단계에서 나눈 결과: 양쪽 재귀의 입력 (a[i], b[i])와 가운데의 b 루트 k, k와 같은 key를 가진 a의 노드들 eq
+typedef struct {
+  node_t *k, *eq;
+  node_t *a[2], *b[2];
+  int ha[2], hb[2], heq;
+} set_op_step;
+
+// 한쪽이 비었을 때의 결과
+static node_t *set_op_leaf(rbtree *t, int op, node_t *a, int ha, node_t *b, int hb,
+                           size_t *removed, int *h) {
+  *h = 0;
+  if (op == SET_UNION) {
+    *h = a == t->nil ? hb : ha;
+    return a == t->nil ? b : a;
+  }
+  delete_rbtree_sub(t, b);
+  if (op == SET_DIFFERENCE) {
+    *h = ha;
+    return a;
+  }
+  *removed += discard_sub(t, a);
+  return t->nil;
+}
+
+// b의 루트를 떼어 내고 a를 그 key 앞뒤로 나눔 (a, b 모두 비어 있지 않음)
+static void set_op_divide(rbtree *t, int op, node_t *a, int ha, node_t *b, int hb, set_op_step *s) {
+  s->k = b;
+  s->b[0] = LEFT(b);
+  s->b[1] = RIGHT(b);
+  s->hb[0] = s->hb[1] = hb - (COLOR(b) == RBTREE_BLACK);
+  if (s->b[0] != t->nil) SET_PARENT(s->b[0], t->nil);
+  if (s->b[1] != t->nil) SET_PARENT(s->b[1], t->nil);
+
+  if (op == SET_UNION && !unique_keys(t)) {
+    //multiset: 같은 key는 양쪽에 모두 남김 (b의 왼쪽 서브트리에도 k와 같은 key가 있을 수 있음)
+    split_sub(t, a, ha, b->key, 0, &s->a[0], &s->ha[0], &s->a[1], &s->ha[1]);
+    s->eq = t->nil;
+    s->heq = 0;
+    return;
+  }
+  node_t *part[3];
+  int hpart[3];
+  split3(t, a, ha, b->key, part, hpart);
+  s->a[0] = part[0];
+  s->ha[0] = hpart[0];
+  s->eq = part[1];
+  s->heq = hpart[1];
+  s->a[1] = part[2];
+  s->ha[1] = hpart[2];
+}
+
+// 양쪽 결과 l, r을 가운데와 함께 이음
+static node_t *set_op_combine(rbtree *t, int op, set_op_step *s, node_t *l, int hl, node_t *r, int hr,
+                              size_t *removed, int *h) {
+  node_t *k = s->k, *eq = s->eq;
+  if (op == SET_UNION) {
+    //같은 key가 양쪽에 있으면 t1의 노드를 남기고 개수를 더함 (map이면 t1의 value가 남음)
+    if (eq != t->nil) {
+      if (t->collapse_duplicates) NODE_COUNT(eq) += NODE_COUNT(k);
+      else (*removed)++;
+      pool_free(&t->pool, k);
+      k = eq;
+    }
+    return join_sub(t, l, hl, k, r, hr, h);
+  }
+  pool_free(&t->pool, k);
+  if (op == SET_DIFFERENCE) {
+    *removed += discard_sub(t, eq);
+    return concat_sub(t, l, hl, r, hr, h);
+  }
+  int hm;
+  node_t *m = concat_sub(t, l, hl, eq, s->heq, &hm);
+  return concat_sub(t, m, hm, r, hr, h);
+}
+
+static node_t *set_op_sub(rbtree *t, int op, node_t *a, int ha, node_t *b, int hb,
+                          size_t *removed, int *h) {
+  if (a == t->nil || b == t->nil) return set_op_leaf(t, op, a, ha, b, hb, removed, h);
+  set_op_step s;
+  set_op_divide(t, op, a, ha, b, hb, &s);
+  int hl, hr;
+  node_t *l = set_op_sub(t, op, s.a[0], s.ha[0], s.b[0], s.hb[0], removed, &hl);
+  node_t *r = set_op_sub(t, op, s.a[1], s.ha[1], s.b[1], s.hb[1], removed, &hr);
+  return set_op_combine(t, op, &s, l, hl, r, hr, removed, h);
+}
+
+static int set_op(rbtree *t1, rbtree *t2, int op) {
+  if (!compatible(t1, t2)) return -1;
+  const size_t c1 = t1->count, c2 = t2->count;
+  node_t *a, *b;
+  if (absorb(t1, t2, &a, &b) != 0) return -1;
+  size_t removed = 0;
+  int h;
+  t1->root = set_op_sub(t1, op, a, subtree_black_height(t1, a), b, subtree_black_height(t1, b),
+                        &removed, &h);
+  SET_COLOR(t1->root, RBTREE_BLACK);
+  t1->count = (op == SET_UNION ? c1 + c2 : c1) - removed;
+  reset_ends(t1);
+  reset_ends(t2);
+  hash_refresh(t1);
+  hash_refresh(t2);
+  return 0;
+}
+
+// 합집합: t2의 원소를 모두 t1으로 옮김. multiset이면 같은 key도 모두 남고,
+// 중복을 모으는 트리는 개수를 더하고, map은 같은 key면 t1의 value를 남김. t2는 빈 트리가 됨
+int rbtree_union(rbtree *t1, rbtree *t2) {
+  return set_op(t1, t2, SET_UNION);
+}
+
+// 교집합: t1의 원소 중 key가 t2에도 있는 것만 남김. t2는 빈 트리가 됨
+int rbtree_intersection(rbtree *t1, rbtree *t2) {
+  return set_op(t1, t2, SET_INTERSECTION);
+}
+
+// 차집합: t1의 원소 중 key가 t2에 없는 것만 남김. t2는 빈 트리가 됨
+int rbtree_difference(rbtree *t1, rbtree *t2) {
+  return set_op(t1, t2, SET_DIFFERENCE);
+}
+
+// t1의 key가 모두 t2의 key 이하일 때 t2를 t1 뒤에 이어 붙임 (중복을 모으는 트리와 map은 미만이어야 함)
+int rbtree_concat(rbtree *t1, rbtree *t2) {
+  if (!compatible(t1, t2)) return -1;
+  node_t *hi = rbtree_max(t1), *lo = rbtree_min(t2);
+  if (hi != NULL && lo != NULL && (hi->key > lo->key || (unique_keys(t1) && hi->key == lo->key))) {
+    return -1;
+  }
+  const size_t total = t1->count + t2->count;
+  node_t *a, *b;
+  if (absorb(t1, t2, &a, &b) != 0) return -1;
+  int h;
+  t1->root = concat_sub(t1, a, subtree_black_height(t1, a), b, subtree_black_height(t1, b), &h);
+  SET_COLOR(t1->root, RBTREE_BLACK);
+  t1->count = total;
+  reset_ends(t1);
+  reset_ends(t2);
+  hash_refresh(t1);
+  hash_refresh(t2);
+  return 0;
+}
+
+// t1의 key <= key <= t2의 key일 때 t1, key, t2를 차례로 이어 t1에 담음 (t2는 빈 트리가 됨)
+int rbtree_join(rbtree *t1, const key_t key, rbtree *t2) {
+  if (!compatible(t1, t2)) return -1;
+  node_t *hi = rbtree_max(t1), *lo = rbtree_min(t2);
+  const int strict = unique_keys(t1);
+  if ((hi != NULL && (hi->key > key || (strict && hi->key == key))) ||
+      (lo != NULL && (key > lo->key || (strict && key == lo->key)))) {
+    return -1;
+  }
+  //key는 t1의 오른쪽 끝에 붙으므로 O(log n). 이어 붙이다 실패하면 다시 뺌
+  node_t *k = rbtree_insert(t1, key);
+  if (k == NULL) return -1;
+  if (rbtree_concat(t1, t2) != 0) {
+    rbtree_erase(t1, k);
+    return -1;
+  }
+  return 0;
+}
+
+#ifndef RBTREE_ORDER_STATISTICS
+static node_t *subtree_min(const rbtree *t, node_t *p) {
+  if (p == t->nil) return NULL;
+  while (LEFT(p) != t->nil) p = LEFT(p);
+  return p;
+}
+
+// 두 서브트리를 한 노드씩 번갈아 세어 먼저 끝나는 쪽(*in_a: a인지)의 원소 수를 구함. O(작은 쪽 크기)
+static size_t count_smaller(const rbtree *t, node_t *a, node_t *b, int *in_a) {
+  node_t *p = subtree_min(t, a), *q = subtree_min(t, b);
+  size_t np = 0, nq = 0;
+  while (p != NULL && q != NULL) {
+    np += node_weight(t, p);
+    nq += node_weight(t, q);
+    p = rbtree_next(t, p);
+    q = rbtree_next(t, q);
+  }
+  *in_a = p == NULL;
+  return p == NULL ? np : nq;
+}
+#endif
+
+// t를 key 미만(*lo)과 key 이상(*hi)의 두 새 트리로 나눔. t는 빈 트리로 남음
+// 포인터 레이아웃에서는 세 트리가 노드와 slab을 함께 쓰며 O(log n)
+// (서브트리 크기가 없는 빌드에서는 원소 수를 세느라 작은 쪽 크기만큼, 인덱스 레이아웃에서는 *hi를 복사하느라 그 크기만큼 더 걸림)
+int rbtree_split(rbtree *t, const key_t key, rbtree **lo, rbtree **hi) {
+  if (t->persistent) return -1;
+  rbtree *l = new_like(t), *r = new_like(t);
+  if (l == NULL || r == NULL) goto fail;
+#ifdef RBTREE_INDEX32
+  if (pool_reserve(&r->pool, subtree_nodes(t, t->root)) != 0) goto fail;
+#else
+  if (share_arena(t) != 0) goto fail;
+#endif
+  swap_trees(l, t);
+
+  node_t *lr, *rr;
+  int hl, hr;
+  const size_t total = l->count;
+  split_sub(l, l->root, subtree_black_height(l, l->root), key, 0, &lr, &hl, &rr, &hr);
+#ifdef RBTREE_ORDER_STATISTICS
+  l->count = lr->size;
+#else
+  int in_l;
+  size_t smaller = count_smaller(l, lr, rr, &in_l);
+  l->count = in_l ? smaller : total - smaller;
+#endif
+  l->root = lr;
+  r->count = total - l->count;
+#ifdef RBTREE_INDEX32
+  r->root = copy_sub(r, l, rr, r->nil);
+  delete_rbtree_sub(l, rr);
+#else
+  arena_enter(r, l->pool.arena);
+  r->root = rr;
+#endif
+  reset_ends(l);
+  reset_ends(r);
+  hash_refresh(t);    //t는 비었으므로 색인만 비움 (나눠진 두 트리는 색인 없이 시작)
+  *lo = l;
+  *hi = r;
+  return 0;
+
+fail:
+  if (l != NULL) delete_rbtree(l);
+  if (r != NULL) delete_rbtree(r);
+  return -1;
 }
 
 // 불균형 복구
@@ -60,165 +1776,634 @@ void rbtree_insert_fixup(rbtree *t, node_t *z) {
   node_t *y;
 
   // 부모노드가 BLACK 될때까지 반복
-  while (z->parent->color == RBTREE_RED) {
+  while (COLOR(PARENT(z)) == RBTREE_RED) {
     // 부모노드가 조부모의 왼쪽 자식일 때
-    if (z->parent == z->parent->parent->left) {
-      y = z->parent->parent->right;
+    if (PARENT(z) == LEFT(PARENT(PARENT(z)))) {
+      y = RIGHT(PARENT(PARENT(z)));
 
       // case 1: 삽입노드의 삼촌 노드가 RED  => 부모 레벨의 색과 조부모의 색 스왑
-      if (y->color == RBTREE_RED) {
-        z->parent->color = RBTREE_BLACK;
-        y->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        z = z->parent->parent;
+      if (COLOR(y) == RBTREE_RED) {
+        STAT(t, insert_fixup[0]);
+        SET_COLOR(PARENT(z), RBTREE_BLACK);
+        SET_COLOR(y, RBTREE_BLACK);
+        SET_COLOR(PARENT(PARENT(z)), RBTREE_RED);
+        z = PARENT(PARENT(z));
       }
       // case 2: 삼촌노드가 BLACK이고 삽입노드가 오른쪽 자식일 때 => 회전
       else {
-        if (z == z->parent->right) {
-          z = z->parent;
+        if (z == RIGHT(PARENT(z))) {
+          STAT(t, insert_fixup[1]);
+          z = PARENT(z);
           rotate_left(t, z);
         }
         // case 3: 삼촌노드가 BLACK이고 삽입노드가 왼쪽 자식일 때 => 부모와 조부모 색 스왑 후 회전
-        z->parent->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        rotate_right(t, z->parent->parent);
+        STAT(t, insert_fixup[2]);
+        SET_COLOR(PARENT(z), RBTREE_BLACK);
+        SET_COLOR(PARENT(PARENT(z)), RBTREE_RED);
+        rotate_right(t, PARENT(PARENT(z)));
       }
     }
 
     // 부모노드가 조부모의 왼쪽 자식일 때
     else {
-      y = z->parent->parent->left;
-      // case 1: 삽입노드의 삼촌 노드가 RED  => 부모 레벨의 색과 조부모의 색 스왑
-      if (y->color == RBTREE_RED) {
-        z->parent->color = RBTREE_BLACK;
-        y->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        z = z->parent->parent;
+      y = LEFT(PARENT(PARENT(z)));
+      // case 1: 삽입노드의 삼촌 노드가 RED  => 부모 레벨의 색과 조부모의 색 스왑
+      if (COLOR(y) == RBTREE_RED) {
+        STAT(t, insert_fixup[0]);
+        SET_COLOR(PARENT(z), RBTREE_BLACK);
+        SET_COLOR(y, RBTREE_BLACK);
+        SET_COLOR(PARENT(PARENT(z)), RBTREE_RED);
+        z = PARENT(PARENT(z));
+      }
+      // case 2: 삼촌노드가 BLACK이고 삽입노드가 오른쪽 자식일 때 => 회전
+      else {
+        if (z == LEFT(PARENT(z))) {
+          STAT(t, insert_fixup[1]);
+          z = PARENT(z);
+          rotate_right(t, z);
+        }
+        // case 3: 삼촌노드가 BLACK이고 삽입노드가 왼쪽 자식일 때 => 부모와 조부모 색 스왑 후 회전
+        STAT(t, insert_fixup[2]);
+        SET_COLOR(PARENT(z), RBTREE_BLACK);
+        SET_COLOR(PARENT(PARENT(z)), RBTREE_RED);
+        rotate_left(t, PARENT(PARENT(z)));        
+      }
+    }
+  }
+  SET_COLOR(t->root, RBTREE_BLACK);
+}
+
+void rotate_left(rbtree *t, node_t *x) {
+  node_t *y = RIGHT(x);
+  STAT(t, rotate_left);
+  SET_RIGHT(x, LEFT(y));                                  //y의 왼쪽 서브트리를 x의 오른쪽 서브트리로 회전
+  if (LEFT(y) != t->nil) SET_PARENT(LEFT(y), x);  //y이 왼쪽 자식노드를 가지고 있다면 x의 오른쪽 자식으로 바꿔주기
+  SET_PARENT(y, PARENT(x));                               //y의 부모노드 업데이트
+
+  // x이 root인 경우
+  if (PARENT(x) == t->nil) t->root = y;
+  // x이 왼쪽 자식인 경우
+  else if (x == LEFT(PARENT(x))) SET_LEFT(PARENT(x), y);
+  // x이 오른쪽 자식인 경우
+  else SET_RIGHT(PARENT(x), y);
+
+  // y의 왼쪽 자식과 x의 부모 노드 업데이트
+  SET_LEFT(y, x);
+  SET_PARENT(x, y);
+#ifdef RBTREE_ORDER_STATISTICS
+  y->size = x->size;    //y가 x의 자리를 그대로 물려받음
+  UPDATE_SIZE(t, x);
+#endif
+}
+
+void rotate_right(rbtree *t, node_t *x) {
+  node_t *y = LEFT(x);
+  STAT(t, rotate_right);
+  SET_LEFT(x, RIGHT(y));                                      //y의 오른쪽 서브트리를 x의 왼쪽 서브트리로 회전
+  if (RIGHT(y) != t->nil) SET_PARENT(RIGHT(y), x);    //y이 오른쪽 자식노드를 가지고 있다면 x의 왼쪽 자식으로 바꿔주기
+  SET_PARENT(y, PARENT(x));                                   //y의 부모노드 업데이트
+
+  if(PARENT(x) == t->nil) t->root = y;
+  else if (x == RIGHT(PARENT(x))) SET_RIGHT(PARENT(x), y);
+  else SET_LEFT(PARENT(x), y);
+
+  SET_RIGHT(y, x);
+  SET_PARENT(x, y);
+#ifdef RBTREE_ORDER_STATISTICS
+  y->size = x->size;
+  UPDATE_SIZE(t, x);
+#endif
+}
+
+node_t *rbtree_find(const rbtree *t, const key_t key) {
+  // RB tree내에 해당 key가 있는지 탐색하여 있으면 해당 node pointer 반환, 없으면 NULL 반환
+  node_t * cur = t->root;
+  STAT(t, finds);
+  if (t->hash != NULL) return hash_get(t->hash, key);
+
+#ifdef RBTREE_INDEX32
+  //자식 인덱스를 먼저 고른 뒤 주소로 바꿈 (분기 대신 cmov로 내려가도록)
+  char *base = t->pool.base;
+  unsigned shift = t->pool.shift;
+  while (cur != t->nil) {
+    STAT(t, find_compares);
+    if (cur->key == key) return cur;
+    uint32_t next = cur->key < key ? cur->right : cur->left;
+    cur = (node_t *)(base + ((size_t)next << shift));
+  }
+#else
+  while (cur != t->nil) {
+    STAT(t, find_compares);
+    if (cur->key == key) return cur;
+    if (cur->key < key) cur = RIGHT(cur);
+    else cur = LEFT(cur);
+  }
+#endif
+  return NULL;
+}
+
+#define FIND_BATCH_LANES 16   // 동시에 진행하는 탐색 수 (대기 중인 캐시 미스 수와 비슷하게)
+
+// keys의 탐색을 FIND_BATCH_LANES개씩 번갈아 한 단계씩 진행
+// 한 탐색이 다음 노드를 prefetch해 두고 넘어가면 다른 탐색들이 그동안 자기 노드를 읽으므로
+// 메모리 지연이 key끼리 겹침. 끝난 자리에는 다음 key를 채움
+// out_nodes[i]에 rbtree_find(t, keys[i])와 같은 노드를, out_flags[i]에 찾았는지를 적음 (둘 다 NULL 가능)
+static size_t find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out_nodes,
+                         unsigned char *out_flags) {
+  node_t *cur[FIND_BATCH_LANES];
+  size_t idx[FIND_BATCH_LANES];
+  size_t next = 0, active = 0, found = 0;
+  STAT_ADD(t, finds, n);
+  while (active < FIND_BATCH_LANES && next < n) {
+    cur[active] = t->root;
+    idx[active++] = next++;
+  }
+  while (active > 0) {
+    for (size_t l = 0; l < active;) {
+      node_t *p = cur[l];
+      const key_t key = keys[idx[l]];
+      if (p != t->nil && p->key != key) {
+        STAT(t, find_compares);
+        p = p->key < key ? RIGHT(p) : LEFT(p);
+        __builtin_prefetch(p);
+        cur[l++] = p;
+        continue;
+      }
+      //이 탐색은 끝남: 결과를 적고 자리를 다음 key(없으면 마지막 자리의 탐색)로 채움
+      if (p != t->nil) {
+        STAT(t, find_compares);
+        found++;
+      }
+      if (out_nodes != NULL) out_nodes[idx[l]] = p != t->nil ? p : NULL;
+      if (out_flags != NULL) out_flags[idx[l]] = p != t->nil;
+      if (next < n) {
+        cur[l] = t->root;
+        idx[l++] = next++;
+      } else {
+        active--;
+        cur[l] = cur[active];
+        idx[l] = idx[active];
+      }
+    }
+  }
+  return found;
+}
+
+// key마다 rbtree_find를 부른 결과를 out_nodes에 (없으면 NULL). 찾은 key 수 반환
+size_t rbtree_find_batch(const rbtree *t, const key_t *keys, const size_t n, node_t **out_nodes) {
+  return find_batch(t, keys, n, out_nodes, NULL);
+}
+
+// key마다 있으면 1, 없으면 0을 out에 (NULL이면 세기만 함). 있는 key 수 반환
+size_t rbtree_contains_batch(const rbtree *t, const key_t *keys, const size_t n, unsigned char *out) {
+  return find_batch(t, keys, n, NULL, out);
+}
+
+// key 이상인 첫 노드 (없으면 NULL)
+node_t *rbtree_lower_bound(const rbtree *t, const key_t key) {
+  node_t *cur = t->root;
+  node_t *res = NULL;
+  while (cur != t->nil) {
+    if (cur->key < key) cur = RIGHT(cur);
+    else {
+      res = cur;
+      cur = LEFT(cur);
+    }
+  }
+  return res;
+}
+
+// key보다 큰 첫 노드 (없으면 NULL)
+node_t *rbtree_upper_bound(const rbtree *t, const key_t key) {
+  node_t *cur = t->root;
+  node_t *res = NULL;
+  while (cur != t->nil) {
+    if (cur->key <= key) cur = RIGHT(cur);
+    else {
+      res = cur;
+      cur = LEFT(cur);
+    }
+  }
+  return res;
+}
+
+// key와 같은 노드들의 구간 [*first, *last) 를 한 번의 하강으로 구함 (NULL은 끝을 뜻함)
+void rbtree_equal_range(const rbtree *t, const key_t key, node_t **first, node_t **last) {
+  node_t *cur = t->root;
+  node_t *lo = NULL, *hi = NULL;
+
+  //key와 같은 노드를 만날 때까지는 두 경계가 같은 경로를 따라감
+  while (cur != t->nil && cur->key != key) {
+    if (cur->key < key) cur = RIGHT(cur);
+    else {
+      lo = hi = cur;
+      cur = LEFT(cur);
+    }
+  }
+  if (cur != t->nil) {
+    //갈라지는 지점부터 하한은 왼쪽, 상한은 오른쪽 서브트리에서 찾음
+    node_t *l = LEFT(cur), *r = RIGHT(cur);
+    lo = cur;
+    while (l != t->nil) {
+      if (l->key < key) l = RIGHT(l);
+      else {
+        lo = l;
+        l = LEFT(l);
       }
-      // case 2: 삼촌노드가 BLACK이고 삽입노드가 오른쪽 자식일 때 => 회전
+    }
+    while (r != t->nil) {
+      if (r->key <= key) r = RIGHT(r);
       else {
-        if (z == z->parent->left) {
-          z = z->parent;
-          rotate_right(t, z);
-        }
-        // case 3: 삼촌노드가 BLACK이고 삽입노드가 왼쪽 자식일 때 => 부모와 조부모 색 스왑 후 회전
-        z->parent->color = RBTREE_BLACK;
-        z->parent->parent->color = RBTREE_RED;
-        rotate_left(t, z->parent->parent);        
+        hi = r;
+        r = LEFT(r);
       }
     }
   }
-  t->root->color = RBTREE_BLACK;
+  *first = lo;
+  *last = hi;
 }
 
-void rotate_left(rbtree *t, node_t *x) {
-  node_t *y = x->right;
-  x->right = y->left;                                  //y의 왼쪽 서브트리를 x의 오른쪽 서브트리로 회전
-  if (y->left != t->nil) y->left->parent = x;  //y이 왼쪽 자식노드를 가지고 있다면 x의 오른쪽 자식으로 바꿔주기
-  y->parent = x->parent;                               //y의 부모노드 업데이트
+#ifdef RBTREE_ORDER_STATISTICS
+// key보다 작은(upper면 key 이하인) 노드의 개수
+static size_t rank_of_bound(const rbtree *t, const key_t key, int upper) {
+  node_t *cur = t->root;
+  size_t rank = 0;
+  while (cur != t->nil) {
+    if (cur->key < key || (upper && cur->key == key)) {
+      rank += LEFT(cur)->size + node_weight(t, cur);
+      cur = RIGHT(cur);
+    } else {
+      cur = LEFT(cur);
+    }
+  }
+  return rank;
+}
 
-  // x이 root인 경우
-  if (x->parent == t->nil) t->root = y;
-  // x이 왼쪽 자식인 경우
-  else if (x == x->parent->left) x->parent->left = y;
-  // x이 오른쪽 자식인 경우
-  else x->parent->right = y;
+#endif
 
-  // y의 왼쪽 자식과 x의 부모 노드 업데이트
-  y->left = x;
-  x->parent = y;
+#ifndef RBTREE_ORDER_STATISTICS
+// p 아래에서 key와 같은 노드 수. key와 다른 쪽 서브트리는 건너뛰므로 O(log n + 개수)
+// (parent 링크를 쓰지 않아서 영속 트리와 snapshot에서도 쓸 수 있음)
+static size_t count_equal(const rbtree *t, const node_t *p, const key_t key) {
+  size_t cnt = 0;
+  while (p != t->nil) {
+    if (p->key < key) p = RIGHT(p);
+    else if (p->key > key) p = LEFT(p);
+    else {
+      cnt += 1 + count_equal(t, LEFT(p), key);
+      p = RIGHT(p);
+    }
+  }
+  return cnt;
 }
+#endif
 
-void rotate_right(rbtree *t, node_t *x) {
-  node_t *y = x->left;
-  x->left = y->right;                                      //y의 오른쪽 서브트리를 x의 왼쪽 서브트리로 회전
-  if (y->right != t->nil) y->right->parent = x;    //y이 오른쪽 자식노드를 가지고 있다면 x의 왼쪽 자식으로 바꿔주기
-  y->parent = x->parent;                                   //y의 부모노드 업데이트
-
-  if(x->parent == t->nil) t->root = y;
-  else if (x == x->parent->right) x->parent->right = y;
-  else x->parent->left = y;
+// key와 같은 원소의 개수
+size_t rbtree_count(const rbtree *t, const key_t key) {
+  if (t->collapse_duplicates) {
+    node_t *p = rbtree_find(t, key);
+    return p == NULL ? 0 : NODE_COUNT(p);
+  }
+#ifdef RBTREE_ORDER_STATISTICS
+  //서브트리 크기가 있으면 두 경계의 순위 차이로 바로 구함
+  return rank_of_bound(t, key, 1) - rank_of_bound(t, key, 0);
+#else
+  return count_equal(t, t->root, key);
+#endif
+}
 
-  y->right = x;
-  x->parent = y;
+// 트리에 들어 있는 원소 수 (O(1))
+size_t rbtree_size(const rbtree *t) {
+  return t->count;
 }
 
-node_t *rbtree_find(const rbtree *t, const key_t key) {
-  // RB tree내에 해당 key가 있는지 탐색하여 있으면 해당 node pointer 반환, 없으면 NULL 반환
-  node_t * cur = t->root;
+// 노드 p가 나타내는 원소 수 (중복을 모으지 않는 트리에서는 항상 1)
+size_t rbtree_node_count(const rbtree *t, const node_t *p) {
+  return node_weight(t, p);
+}
 
+#ifdef RBTREE_ORDER_STATISTICS
+// 0부터 세어 k번째로 작은 원소의 노드 (k가 크기 이상이면 NULL)
+node_t *rbtree_select(const rbtree *t, size_t k) {
+  node_t *cur = t->root;
+  if (k >= cur->size) return NULL;
   while (cur != t->nil) {
-    if (cur->key == key) return cur;
-    if (cur->key < key) cur = cur->right;
-    else cur = cur->left;
+    size_t left = LEFT(cur)->size;
+    if (k < left) cur = LEFT(cur);
+    else if (k < left + node_weight(t, cur)) return cur;
+    else {
+      k -= left + node_weight(t, cur);
+      cur = RIGHT(cur);
+    }
   }
   return NULL;
 }
 
-// 노드 중 가장 작은 키 값 반환
+// p보다 앞에 오는 원소의 개수 (rbtree_select의 역)
+size_t rbtree_rank(const rbtree *t, const node_t *p) {
+  size_t rank = LEFT(p)->size;
+  for (; PARENT(p) != t->nil; p = PARENT(p)) {
+    if (p == RIGHT(PARENT(p))) rank += LEFT(PARENT(p))->size + node_weight(t, PARENT(p));
+  }
+  return rank;
+}
+#endif
+
+// 노드 중 가장 작은 키 값 반환 (트리가 들고 있는 끝 노드라 O(1))
 node_t *rbtree_min(const rbtree *t) {
-  if (t->root == t->nil) return NULL;
-  node_t *cur = t->root;
-  while (cur->left != t->nil) cur = cur->left;
-  
-  return cur;
+  return t->leftmost == t->nil ? NULL : t->leftmost;
 }
 
 // 노드 중 가장 큰 키 값 반환
 node_t *rbtree_max(const rbtree *t) {
-  if (t->root == t->nil) return NULL;
-  node_t *cur = t->root;
-  while (cur->right != t->nil) cur = cur->right;
+  return t->rightmost == t->nil ? NULL : t->rightmost;
+}
 
-  return cur;
+// 중위 순회 기준 다음 노드 (없으면 NULL)
+node_t *rbtree_next(const rbtree *t, const node_t *p) {
+  if (RIGHT(p) != t->nil) {
+    node_t *cur = RIGHT(p);
+    while (LEFT(cur) != t->nil) cur = LEFT(cur);
+    return cur;
+  }
+  //오른쪽 자식이 없으면 왼쪽 자식으로 올라오는 첫 조상이 다음 노드
+  node_t *y = PARENT(p);
+  while (y != t->nil && p == RIGHT(y)) {
+    p = y;
+    y = PARENT(y);
+  }
+  return y == t->nil ? NULL : y;
+}
+
+// 중위 순회 기준 이전 노드 (없으면 NULL)
+node_t *rbtree_prev(const rbtree *t, const node_t *p) {
+  if (LEFT(p) != t->nil) {
+    node_t *cur = LEFT(p);
+    while (RIGHT(cur) != t->nil) cur = RIGHT(cur);
+    return cur;
+  }
+  node_t *y = PARENT(p);
+  while (y != t->nil && p == LEFT(y)) {
+    p = y;
+    y = PARENT(y);
+  }
+  return y == t->nil ? NULL : y;
+}
+
+// [lo, hi) 범위만 내려가는 중위 순회. fn이 0이 아닌 값을 돌려주면 멈추고 1 반환
+static int foreach_range_sub(const rbtree *t, node_t *p, const key_t lo, const key_t hi,
+                             rbtree_visit_fn fn, void *ctx, size_t *visited) {
+  while (p != t->nil) {
+    //p가 범위 아래쪽이면 왼쪽 서브트리는 볼 필요 없음
+    if (p->key < lo) {
+      p = RIGHT(p);
+      continue;
+    }
+    if (p->key >= hi) {
+      p = LEFT(p);
+      continue;
+    }
+    if (foreach_range_sub(t, LEFT(p), lo, hi, fn, ctx, visited)) return 1;
+    (*visited)++;
+    if (fn(p, ctx)) return 1;
+    p = RIGHT(p);   //오른쪽은 재귀 대신 반복
+  }
+  return 0;
 }
 
-// 노드 삭제
+// lo <= key < hi 인 노드들을 key 순서대로 fn에 넘김. 방문한 노드 수 반환
+size_t rbtree_foreach_range(const rbtree *t, const key_t lo, const key_t hi,
+                            rbtree_visit_fn fn, void *ctx) {
+  size_t visited = 0;
+  if (lo < hi) foreach_range_sub(t, t->root, lo, hi, fn, ctx, &visited);
+  return visited;
+}
+
+// key를 가진 원소 하나 삭제. 지웠으면 1, 없으면 0 반환
+// (찾으며 내려간 노드 아래에서 후임자만 찾으므로 루트에서 한 번 내려가는 것으로 끝남)
+int rbtree_erase_key(rbtree *t, const key_t key) {
+  if (t->persistent) return persist_erase(t, key);
+  node_t *p = rbtree_find(t, key);
+  if (p == NULL) return 0;
+  rbtree_erase(t, p);
+  return 1;
+}
+
+// 노드 삭제. 중복을 모으는 트리에서는 개수가 2 이상이면 하나만 줄임
 int rbtree_erase(rbtree *t, node_t *p) {
+  if (t->persistent) {
+    //영속 모드에서는 노드가 복사되어 옮겨 다니므로 key로 찾아서 지움 (같은 key의 다른 사본이 지워질 수 있음)
+    return persist_erase(t, p->key) ? 0 : -1;
+  }
+  if (t->collapse_duplicates && NODE_COUNT(p) > 1) {
+    NODE_COUNT(p)--;
+#ifdef RBTREE_ORDER_STATISTICS
+    add_size_upward(t, p, (size_t)-1);
+#endif
+    t->count--;
+    return 0;
+  }
+
+  if (t->hash != NULL) hash_unlink(t, p);
+  //노드는 자리를 옮길 뿐 바뀌지 않으므로 지워지는 노드가 끝 노드일 때만 옆 노드로 넘김
+  if (p == t->leftmost) t->leftmost = RIGHT(p) != t->nil ? rbtree_next(t, p) : PARENT(p);
+  if (p == t->rightmost) t->rightmost = LEFT(p) != t->nil ? rbtree_prev(t, p) : PARENT(p);
+
   node_t *y = p;
   node_t *x;
-  color_t y_original_color = y->color;
-
-  if (p->left == t->nil) {
-    x = p->right;
-    rbtree_transplant(t, p, p->right);
-  } else if (p->right == t->nil) {
-    x = p->left;
-    rbtree_transplant(t, p, p->left);
+  color_t y_original_color = COLOR(y);
+#ifdef RBTREE_ORDER_STATISTICS
+  node_t *shrink = PARENT(p);   //여기서부터 root까지 서브트리 크기가 1씩 줄어듦
+#endif
+
+  if (LEFT(p) == t->nil) {
+    x = RIGHT(p);
+    rbtree_transplant(t, p, RIGHT(p));
+  } else if (RIGHT(p) == t->nil) {
+    x = LEFT(p);
+    rbtree_transplant(t, p, LEFT(p));
   } else {
     y = tree_minimum(t, p);
-    y_original_color = y->color;
-    x = y->right;
-    if (y != p->right) {
-      rbtree_transplant(t, y, y->right);
-      y->right = p->right;
-      y->right->parent = y;
+    y_original_color = COLOR(y);
+    x = RIGHT(y);
+#ifdef RBTREE_ORDER_STATISTICS
+    shrink = (y != RIGHT(p)) ? PARENT(y) : y;
+    y->size = p->size;
+    //y가 빠져나간 자리부터 p 아래까지는 y가 나타내던 개수만큼 줄어듦 (아래에서 1은 따로 뺌)
+    if (node_weight(t, y) > 1) {
+      for (node_t *q = PARENT(y); q != p; q = PARENT(q)) q->size -= node_weight(t, y) - 1;
+    }
+#endif
+    if (y != RIGHT(p)) {
+      rbtree_transplant(t, y, RIGHT(y));
+      SET_RIGHT(y, RIGHT(p));
+      SET_PARENT(RIGHT(y), y);
     } else {
-      x->parent = y;
+      SET_PARENT(x, y);
       }
     rbtree_transplant(t, p, y);
-    y->left = p->left;
-    y->left->parent = y;
-    y->color = p->color;
+    SET_LEFT(y, LEFT(p));
+    SET_PARENT(LEFT(y), y);
+    SET_COLOR(y, COLOR(p));
     }
+#ifdef RBTREE_ORDER_STATISTICS
+  add_size_upward(t, shrink, (size_t)-1);
+#endif
+  t->count--;
   if (y_original_color == RBTREE_BLACK) {
   rbtree_erase_fixup(t, x);
   }
-  free(p);
+  pool_free(&t->pool, p);
   return 0;
 }
 
+// 가장 작은(dir이 0) 또는 가장 큰(dir이 1) 원소 하나를 빼서 *key(NULL 가능)에 담음. 비어 있으면 0
+// 끝 노드는 바깥쪽 자식이 없고 안쪽 자식도 빨간 잎 하나뿐이라 후임자를 찾거나 자리를 옮기지 않고 바로 떼어 냄
+// (안쪽 자식이 있으면 검게 칠하는 것으로 끝나고, 없을 때 검은 노드를 뺀 경우만 균형 복구)
+static int pop_end(rbtree *t, int dir, key_t *key) {
+  node_t *p = dir ? t->rightmost : t->leftmost;
+  if (p == t->nil) return 0;
+  if (key != NULL) *key = p->key;
+  if (t->persistent) return persist_erase(t, p->key);
+  if (t->collapse_duplicates && NODE_COUNT(p) > 1) {
+    NODE_COUNT(p)--;
+#ifdef RBTREE_ORDER_STATISTICS
+    add_size_upward(t, p, (size_t)-1);
+#endif
+    t->count--;
+    return 1;
+  }
+
+  if (t->hash != NULL) hash_unlink(t, p);
+  node_t *x = child(t, p, !dir), *parent = PARENT(p);
+  replace_child(t, parent, dir, x);
+  SET_PARENT(x, parent);    //x가 nil이어도 복구에서 부모를 찾을 수 있게 적어 둠
+#ifdef RBTREE_ORDER_STATISTICS
+  add_size_upward(t, parent, (size_t)-1);
+#endif
+  //노드가 하나뿐이었으면 반대쪽 끝도 함께 비워짐
+  node_t *end = x != t->nil ? x : parent;
+  if (t->leftmost == p) t->leftmost = end;
+  if (t->rightmost == p) t->rightmost = end;
+  t->count--;
+  if (x != t->nil) SET_COLOR(x, RBTREE_BLACK);
+  else if (COLOR(p) == RBTREE_BLACK) rbtree_erase_fixup(t, x);
+  pool_free(&t->pool, p);   //노드는 free list로 돌아가 다음 삽입에서 다시 쓰임
+  return 1;
+}
+
+int rbtree_pop_min(rbtree *t, key_t *key) {
+  return pop_end(t, 0, key);
+}
+
+int rbtree_pop_max(rbtree *t, key_t *key) {
+  return pop_end(t, 1, key);
+}
+
+// key <= limit 인 원소를 작은 것부터 최대 cap개 빼서 out에 담고 개수 반환 (만료된 타이머를 한 번에 꺼낼 때)
+// 중복을 모은 노드는 남길 개수만 빼고 한꺼번에 꺼냄
+size_t rbtree_pop_min_while(rbtree *t, const key_t limit, key_t *out, const size_t cap) {
+  size_t n = 0;
+  while (n < cap && t->leftmost != t->nil && t->leftmost->key <= limit) {
+    node_t *p = t->leftmost;
+    if (t->collapse_duplicates && !t->persistent && NODE_COUNT(p) > 1) {
+      size_t k = NODE_COUNT(p) - 1;
+      if (k > cap - n) k = cap - n;
+      NODE_COUNT(p) -= k;
+#ifdef RBTREE_ORDER_STATISTICS
+      add_size_upward(t, p, (size_t)0 - k);
+#endif
+      t->count -= k;
+      for (; k > 0; k--) out[n++] = p->key;
+      continue;
+    }
+    pop_end(t, 0, &out[n++]);
+  }
+  return n;
+}
+
+#define ERASE_RANGE_SMALL 32   // 범위에 든 노드가 이보다 많으면 잘라 내서 한꺼번에 반납
+
+// 노드 p를 (중복을 모은 개수까지) 통째로 지우고 지운 원소 수 반환
+static size_t erase_node_all(rbtree *t, node_t *p) {
+  const size_t w = node_weight(t, p);
+  if (w > 1) {
+    NODE_COUNT(p) = 1;
+#ifdef RBTREE_ORDER_STATISTICS
+    add_size_upward(t, p, (size_t)1 - w);
+#endif
+    t->count -= w - 1;
+  }
+  rbtree_erase(t, p);
+  return w;
+}
+
+// lo <= key 이고 key < hi (upper면 key <= hi)인 원소를 모두 지우고 지운 개수 반환
+// 범위의 노드가 적으면 하나씩 지우고, 많으면 세 조각으로 나눠 가운데를 통째로 반납한 뒤 양쪽을 이음: O(log n + k)
+static size_t erase_between(rbtree *t, const key_t lo, const key_t hi, int upper) {
+  size_t erased = 0;
+  if (t->persistent) {
+    //영속 모드는 parent 링크가 없어서 원소마다 루트에서 지움
+    node_t *p;
+    while ((p = rbtree_lower_bound(t, lo)) != NULL && (p->key < hi || (upper && p->key == hi))) {
+      erased += persist_erase(t, p->key);
+    }
+    return erased;
+  }
+
+  node_t *first = rbtree_lower_bound(t, lo), *end = first;
+  size_t nodes = 0;
+  while (end != NULL && (end->key < hi || (upper && end->key == hi)) && nodes <= ERASE_RANGE_SMALL) {
+    end = rbtree_next(t, end);
+    nodes++;
+  }
+  if (nodes <= ERASE_RANGE_SMALL) {
+    //지워도 다른 노드는 그대로라 미리 구한 다음 노드를 계속 쓸 수 있음
+    for (node_t *p = first, *next; p != end; p = next) {
+      next = rbtree_next(t, p);
+      erased += erase_node_all(t, p);
+    }
+    return erased;
+  }
+
+  node_t *root = t->root, *a, *rest, *mid, *b;
+  int ha, hr, hm, hb, h;
+  t->root = t->nil;
+  split_sub(t, root, subtree_black_height(t, root), lo, 0, &a, &ha, &rest, &hr);
+  split_sub(t, rest, hr, hi, upper, &mid, &hm, &b, &hb);
+  erased = discard_sub(t, mid);
+  t->root = concat_sub(t, a, ha, b, hb, &h);
+  SET_COLOR(t->root, RBTREE_BLACK);
+  t->count -= erased;
+  reset_ends(t);
+  return erased;
+}
+
+// key를 가진 원소를 모두 지우고 지운 개수 반환
+size_t rbtree_erase_all(rbtree *t, const key_t key) {
+  if (t->collapse_duplicates && !t->persistent) {
+    node_t *p = rbtree_find(t, key);
+    return p == NULL ? 0 : erase_node_all(t, p);
+  }
+  return erase_between(t, key, key, 1);
+}
+
+// lo <= key < hi 인 원소를 모두 지우고 지운 개수 반환
+size_t rbtree_erase_range(rbtree *t, const key_t lo, const key_t hi) {
+  return lo < hi ? erase_between(t, lo, hi, 0) : 0;
+}
+
 // son을 del 자리로 옮기는 함수
 void rbtree_transplant(rbtree *t, node_t *del, node_t *son) {
-  if (del->parent == t->nil) t->root = son;                     //root일 경우
-  else if (del == del->parent->left) del->parent->left = son;   //왼쪽 자식일 경우
-  else del->parent->right = son;                                //오른쪽 자식일 경우
-  son->parent = del->parent;
+  if (PARENT(del) == t->nil) t->root = son;                     //root일 경우
+  else if (del == LEFT(PARENT(del))) SET_LEFT(PARENT(del), son);   //왼쪽 자식일 경우
+  else SET_RIGHT(PARENT(del), son);                                //오른쪽 자식일 경우
+  SET_PARENT(son, PARENT(del));
 }
 
 // 후임자(삭제 노드보다 큰 노드 중 가장 작은 노드) 찾는 함수
 node_t *tree_minimum(rbtree *t, node_t *node) {
-  node_t *cur = node->right;
+  node_t *cur = RIGHT(node);
   node_t *min = cur;
 
   // 후임자가 없을 경우 NULL 반환
@@ -226,64 +2411,72 @@ node_t *tree_minimum(rbtree *t, node_t *node) {
 
   while(cur != t->nil) {
     min = cur;
-    cur = cur->left;
+    cur = LEFT(cur);
   }
   return min;
 }
 
 void rbtree_erase_fixup(rbtree *t, node_t *p) {
-  while (p != t->root && p->color == RBTREE_BLACK) {
-    if (p == p->parent->left) {
-      node_t *w = p->parent->right;
-      if (w->color == RBTREE_RED) {
-        w->color = RBTREE_BLACK;
-        p->parent->color = RBTREE_RED;
-        rotate_left(t, p->parent);
-        w = p->parent->right;
+  while (p != t->root && COLOR(p) == RBTREE_BLACK) {
+    if (p == LEFT(PARENT(p))) {
+      node_t *w = RIGHT(PARENT(p));
+      if (COLOR(w) == RBTREE_RED) {
+        STAT(t, erase_fixup[0]);
+        SET_COLOR(w, RBTREE_BLACK);
+        SET_COLOR(PARENT(p), RBTREE_RED);
+        rotate_left(t, PARENT(p));
+        w = RIGHT(PARENT(p));
       }
-      if (w->left->color == RBTREE_BLACK && w->right->color == RBTREE_BLACK) {
-        w->color = RBTREE_RED;
-        p = p->parent;
+      if (COLOR(LEFT(w)) == RBTREE_BLACK && COLOR(RIGHT(w)) == RBTREE_BLACK) {
+        STAT(t, erase_fixup[1]);
+        SET_COLOR(w, RBTREE_RED);
+        p = PARENT(p);
       } else {
-        if (w->right->color == RBTREE_BLACK) {
-          w->left->color = RBTREE_BLACK;
-          w->color = RBTREE_RED;
+        if (COLOR(RIGHT(w)) == RBTREE_BLACK) {
+          STAT(t, erase_fixup[2]);
+          SET_COLOR(LEFT(w), RBTREE_BLACK);
+          SET_COLOR(w, RBTREE_RED);
           rotate_right(t, w);
-          w = p->parent->right;
+          w = RIGHT(PARENT(p));
         }
-        w->color = p->parent->color;
-        p->parent->color = RBTREE_BLACK;
-        w->right->color = RBTREE_BLACK;
-        rotate_left(t, p->parent);
+        STAT(t, erase_fixup[3]);
+        SET_COLOR(w, COLOR(PARENT(p)));
+        SET_COLOR(PARENT(p), RBTREE_BLACK);
+        SET_COLOR(RIGHT(w), RBTREE_BLACK);
+        rotate_left(t, PARENT(p));
         p = t->root;
       }
     } else {
-      node_t *w = p->parent->left;
-      if (w->color == RBTREE_RED) {
-        w->color = RBTREE_BLACK;
-        p->parent->color = RBTREE_RED;
-        rotate_right(t, p->parent);
-        w = p->parent->left;
+      node_t *w = LEFT(PARENT(p));
+      if (COLOR(w) == RBTREE_RED) {
+        STAT(t, erase_fixup[0]);
+        SET_COLOR(w, RBTREE_BLACK);
+        SET_COLOR(PARENT(p), RBTREE_RED);
+        rotate_right(t, PARENT(p));
+        w = LEFT(PARENT(p));
       }
-      if (w->right->color == RBTREE_BLACK && w->left->color == RBTREE_BLACK) {
-        w->color = RBTREE_RED;
-        p = p->parent;
+      if (COLOR(RIGHT(w)) == RBTREE_BLACK && COLOR(LEFT(w)) == RBTREE_BLACK) {
+        STAT(t, erase_fixup[1]);
+        SET_COLOR(w, RBTREE_RED);
+        p = PARENT(p);
       } else {
-        if (w->left->color == RBTREE_BLACK) {
-          w->right->color = RBTREE_BLACK;
-          w->color = RBTREE_RED;
+        if (COLOR(LEFT(w)) == RBTREE_BLACK) {
+          STAT(t, erase_fixup[2]);
+          SET_COLOR(RIGHT(w), RBTREE_BLACK);
+          SET_COLOR(w, RBTREE_RED);
           rotate_left(t, w);
-          w = p->parent->left;
+          w = LEFT(PARENT(p));
         }
-        w->color = p->parent->color;
-        p->parent->color = RBTREE_BLACK;
-        w->left->color = RBTREE_BLACK;
-        rotate_right(t, p->parent);
+        STAT(t, erase_fixup[3]);
+        SET_COLOR(w, COLOR(PARENT(p)));
+        SET_COLOR(PARENT(p), RBTREE_BLACK);
+        SET_COLOR(LEFT(w), RBTREE_BLACK);
+        rotate_right(t, PARENT(p));
         p = t->root;
       }
     }
   }
-  p->color = RBTREE_BLACK;
+  SET_COLOR(p, RBTREE_BLACK);
 }
 
 int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
@@ -299,12 +2492,873 @@ int rbtree_to_array(const rbtree *t, key_t *arr, const size_t n) {
 void rbtree_to_array_recursive(const rbtree *t, const node_t *node, key_t *arr, const size_t n, size_t *index) {
   if (node == t->nil || *index >= n) return;
   
-  rbtree_to_array_recursive(t, node->left, arr, n, index);
+  rbtree_to_array_recursive(t, LEFT(node), arr, n, index);
   
-  if (*index < n) {
+  //중복을 모은 노드는 개수만큼 펼쳐서 넣음
+  for (size_t c = node_weight(t, node); c > 0 && *index < n; c--) {
     arr[*index] = node->key;
     (*index)++;
   }
   
-  rbtree_to_array_recursive(t, node->right, arr, n, index);
-}
\ No newline at end of file
+  rbtree_to_array_recursive(t, RIGHT(node), arr, n, index);
+}
+
+// ---- fork-join 병렬 실행 ----
+// 스레드마다 task 덱을 두고, 자기 덱은 뒤에서 꺼내고 일이 없으면 다른 스레드의 덱 앞에서 훔쳐 옴 (work stealing).
+// 부모 task는 자식 하나를 덱에 넣어 두고(fork) 나머지를 직접 처리한 뒤, 자식이 끝날 때까지 다른 task를 대신 실행하며 기다림(sync).
+// 일을 서브트리 단위로 나누고, cutoff 이하로 작아지면 나누지 않고 순차 코드로 처리함
+
+#define PAR_DEQUE_CAP 256             // 덱 하나에 쌓일 수 있는 task 수 (넘치면 그 자리에서 바로 실행)
+#define PAR_DEFAULT_CUTOFF (1 << 14)  // 기본 순차 처리 기준 (원소 수)
+#define PAR_MAX_DEPTH 20              // 나누는 깊이의 상한 (offset 표 크기가 2^(깊이 + 1))
+
+typedef struct par_task par_task;
+struct par_task {
+  void (*run)(par_task *);
+  atomic_int done;
+};
+
+typedef struct {
+  pthread_mutex_t lock;
+  par_task *tasks[PAR_DEQUE_CAP];
+  size_t top, bottom;         // [top, bottom)에 task가 있음
+  rbtree_workers *w;
+  pthread_t thread;
+  unsigned seed;
+} __attribute__((aligned(CACHE_LINE))) par_worker;
+
+struct rbtree_workers {
+  int threads;
+  size_t cutoff;
+  par_worker *workers;        // workers[0]은 연산을 호출한 스레드가 씀
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  atomic_int active;          // 연산이 진행 중이면 1
+  int stop;
+};
+
+static _Thread_local par_worker *par_self;   //지금 스레드가 맡은 worker (연산 밖이면 NULL)
+
+static void par_execute(par_task *task) {
+  task->run(task);
+  atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+// 다른 worker 하나를 골라 덱 앞에서 task를 훔침
+static par_task *par_steal(par_worker *self) {
+  rbtree_workers *w = self->w;
+  if (w->threads < 2) return NULL;
+  par_worker *victim = &w->workers[rand_r(&self->seed) % w->threads];
+  if (victim == self) return NULL;
+  par_task *task = NULL;
+  pthread_mutex_lock(&victim->lock);
+  if (victim->bottom > victim->top) task = victim->tasks[victim->top++ % PAR_DEQUE_CAP];
+  pthread_mutex_unlock(&victim->lock);
+  return task;
+}
+
+// task를 다른 스레드가 가져갈 수 있게 내놓음 (연산 밖이거나 덱이 가득 차면 바로 실행)
+static void par_fork(par_task *task) {
+  atomic_store_explicit(&task->done, 0, memory_order_relaxed);
+  par_worker *self = par_self;
+  if (self != NULL) {
+    pthread_mutex_lock(&self->lock);
+    int pushed = self->bottom - self->top < PAR_DEQUE_CAP;
+    if (pushed) self->tasks[self->bottom++ % PAR_DEQUE_CAP] = task;
+    pthread_mutex_unlock(&self->lock);
+    if (pushed) return;
+  }
+  par_execute(task);
+}
+
+// task가 끝날 때까지 기다림. 아직 덱에 있으면 직접 실행하고, 누가 가져갔으면 다른 task를 도우며 기다림
+static void par_sync(par_task *task) {
+  par_worker *self = par_self;
+  while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+    par_task *next = NULL;
+    if (self != NULL) {
+      pthread_mutex_lock(&self->lock);
+      if (self->bottom > self->top) next = self->tasks[--self->bottom % PAR_DEQUE_CAP];
+      pthread_mutex_unlock(&self->lock);
+      if (next == NULL) next = par_steal(self);
+    }
+    if (next != NULL) par_execute(next);
+    else sched_yield();
+  }
+}
+
+static void *par_worker_main(void *arg) {
+  par_worker *self = (par_worker *)arg;
+  rbtree_workers *w = self->w;
+  par_self = self;
+  pthread_mutex_lock(&w->lock);
+  for (;;) {
+    while (!atomic_load(&w->active) && !w->stop) pthread_cond_wait(&w->wake, &w->lock);
+    if (w->stop) break;
+    pthread_mutex_unlock(&w->lock);
+    //연산이 끝날 때까지 다른 worker의 task를 훔쳐 실행
+    while (atomic_load_explicit(&w->active, memory_order_acquire)) {
+      par_task *task = par_steal(self);
+      if (task != NULL) par_execute(task);
+      else sched_yield();
+    }
+    pthread_mutex_lock(&w->lock);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+// 호출한 스레드를 workers[0]으로 삼아 root task를 실행 (이미 연산 안이면 그대로 실행)
+static void par_run(rbtree_workers *w, par_task *root) {
+  if (par_self != NULL || w->threads < 2) {
+    root->run(root);
+    return;
+  }
+  par_self = &w->workers[0];
+  pthread_mutex_lock(&w->lock);
+  atomic_store(&w->active, 1);
+  pthread_cond_broadcast(&w->wake);
+  pthread_mutex_unlock(&w->lock);
+  root->run(root);
+  atomic_store_explicit(&w->active, 0, memory_order_release);
+  par_self = NULL;
+}
+
+// threads개 스레드(0이면 CPU 수, 호출한 스레드 포함)와 순차 처리 기준 cutoff(0이면 기본값)로 실행기 생성
+// 한 실행기로는 한 번에 연산 하나만 돌릴 수 있음
+rbtree_workers *new_rbtree_workers(int threads, size_t cutoff) {
+  if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads <= 0) threads = 1;
+  rbtree_workers *w = (rbtree_workers *)calloc(1, sizeof(rbtree_workers));
+  if (w == NULL) return NULL;
+  w->workers = (par_worker *)aligned_alloc(CACHE_LINE, threads * sizeof(par_worker));
+  if (w->workers == NULL) {
+    free(w);
+    return NULL;
+  }
+  w->cutoff = cutoff > 0 ? cutoff : PAR_DEFAULT_CUTOFF;
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->wake, NULL);
+  atomic_init(&w->active, 0);
+  for (int i = 0; i < threads; i++) {
+    par_worker *p = &w->workers[i];
+    pthread_mutex_init(&p->lock, NULL);
+    p->top = p->bottom = 0;
+    p->w = w;
+    p->seed = 0x9e3779b9u * (i + 1);
+  }
+  //스레드를 띄우다 실패하면 띄운 만큼만 씀
+  w->threads = 1;
+  while (w->threads < threads &&
+         pthread_create(&w->workers[w->threads].thread, NULL, par_worker_main, &w->workers[w->threads]) == 0) {
+    w->threads++;
+  }
+  return w;
+}
+
+void delete_rbtree_workers(rbtree_workers *w) {
+  pthread_mutex_lock(&w->lock);
+  w->stop = 1;
+  pthread_cond_broadcast(&w->wake);
+  pthread_mutex_unlock(&w->lock);
+  for (int i = 1; i < w->threads; i++) pthread_join(w->workers[i].thread, NULL);
+  for (int i = 0; i < w->threads; i++) pthread_mutex_destroy(&w->workers[i].lock);
+  pthread_cond_destroy(&w->wake);
+  pthread_mutex_destroy(&w->lock);
+  free(w->workers);
+  free(w);
+}
+
+// 원소 n개를 cutoff 이하 조각으로 나누려면 몇 단계 내려가야 하는지
+static int par_depth(const rbtree_workers *w, size_t n) {
+  int depth = 0;
+  while ((n >> depth) > w->cutoff && depth < PAR_MAX_DEPTH) depth++;
+  return depth;
+}
+
+// 병렬 build: 가운데 원소로 노드를 만들고 왼쪽은 fork, 오른쪽은 직접
+typedef struct {
+  par_task task;
+  rbtree *t;
+  node_t *nodes;
+  const key_t *arr;
+  size_t lo, hi, cutoff;
+  node_t *parent, *out;
+  int depth, red_depth;
+  atomic_int *unsorted;
+} build_task;
+
+static void build_run(par_task *task) {
+  build_task *b = (build_task *)task;
+  rbtree *t = b->t;
+  if (b->hi - b->lo <= b->cutoff) {
+    //순차 구간: 정렬 여부도 여기서 확인 (앞 구간의 마지막 원소와의 경계 포함)
+    for (size_t i = b->lo > 0 ? b->lo : 1; i < b->hi; i++) {
+      if (b->arr[i - 1] > b->arr[i]) atomic_store(b->unsorted, 1);
+    }
+    b->out = build_sorted_sub(t, b->nodes, b->arr, b->lo, b->hi, b->parent, b->depth, b->red_depth);
+    return;
+  }
+  const size_t mid = b->lo + (b->hi - b->lo) / 2;
+  node_t *p = NODE_AT(b->nodes, mid, t->pool.stride);
+  if (b->arr[mid - 1] > b->arr[mid]) atomic_store(b->unsorted, 1);
+  p->key = b->arr[mid];
+  SET_PARENT(p, b->parent);
+  SET_COLOR(p, (b->depth == b->red_depth && b->depth > 0) ? RBTREE_RED : RBTREE_BLACK);
+#ifdef RBTREE_ORDER_STATISTICS
+  p->size = b->hi - b->lo;
+#endif
+  build_task l = *b, r = *b;
+  l.hi = mid;
+  r.lo = mid + 1;
+  l.parent = r.parent = p;
+  l.depth = r.depth = b->depth + 1;
+  par_fork(&l.task);
+  build_run(&r.task);
+  par_sync(&l.task);
+  SET_LEFT(p, l.out);
+  SET_RIGHT(p, r.out);
+  b->out = p;
+}
+
+// 정렬된 배열로 트리를 병렬로 생성 (rbtree_build_from_sorted와 같은 모양). 정렬되어 있지 않으면 NULL
+rbtree *rbtree_build_from_sorted_par(rbtree_workers *w, const key_t *arr, const size_t n) {
+  rbtree *t = new_rbtree_with_capacity(n);
+  if (t == NULL || n == 0) return t;
+  node_t *nodes = pool_take(&t->pool, n);
+  if (nodes == NULL) {
+    delete_rbtree(t);
+    return NULL;
+  }
+  atomic_int unsorted;
+  atomic_init(&unsorted, 0);
+  build_task root = {.t = t, .nodes = nodes, .arr = arr, .lo = 0, .hi = n, .cutoff = w->cutoff,
+                     .parent = t->nil, .unsorted = &unsorted};
+  while (((size_t)2 << root.red_depth) <= n) root.red_depth++;
+  root.task.run = build_run;
+  par_run(w, &root.task);
+  if (atomic_load(&unsorted)) {
+    delete_rbtree(t);
+    return NULL;
+  }
+  t->root = root.out;
+  t->count = n;
+  reset_ends(t);
+  return t;
+}
+
+// 병렬 export: 위쪽 몇 단계의 서브트리 크기로 각 서브트리가 배열의 어디부터 채울지 정함
+// 서브트리 크기가 노드에 없으면 먼저 그 단계까지의 크기를 병렬로 세어 counts[힙 인덱스]에 적어 둠
+typedef struct {
+  par_task task;
+  const rbtree *t;
+  const node_t *p;
+  size_t idx, off;
+  int depth, max_depth;
+  size_t *counts;
+  key_t *arr;
+  size_t n;
+} export_task;
+
+#ifndef RBTREE_ORDER_STATISTICS
+static size_t subtree_weight(const rbtree *t, const node_t *p) {
+  size_t n = 0;
+  while (p != t->nil) {
+    n += node_weight(t, p) + subtree_weight(t, LEFT(p));
+    p = RIGHT(p);
+  }
+  return n;
+}
+
+static void count_run(par_task *task) {
+  export_task *e = (export_task *)task;
+  const rbtree *t = e->t;
+  if (e->p == t->nil || e->depth == e->max_depth) {
+    e->counts[e->idx] = subtree_weight(t, e->p);
+    return;
+  }
+  export_task l = *e, r = *e;
+  l.p = LEFT(e->p);
+  r.p = RIGHT(e->p);
+  l.idx = 2 * e->idx;
+  r.idx = 2 * e->idx + 1;
+  l.depth = r.depth = e->depth + 1;
+  par_fork(&l.task);
+  count_run(&r.task);
+  par_sync(&l.task);
+  e->counts[e->idx] = e->counts[l.idx] + e->counts[r.idx] + node_weight(t, e->p);
+}
+#endif
+
+static void export_run(par_task *task) {
+  export_task *e = (export_task *)task;
+  const rbtree *t = e->t;
+  if (e->p == t->nil || e->off >= e->n) return;
+  if (e->depth == e->max_depth) {
+    size_t index = e->off;
+    rbtree_to_array_recursive(t, e->p, e->arr, e->n, &index);
+    return;
+  }
+  export_task l = *e, r = *e;
+  l.p = LEFT(e->p);
+  r.p = RIGHT(e->p);
+  l.idx = 2 * e->idx;
+  r.idx = 2 * e->idx + 1;
+  l.depth = r.depth = e->depth + 1;
+#ifdef RBTREE_ORDER_STATISTICS
+  const size_t left = l.p->size;
+#else
+  const size_t left = e->counts[l.idx];
+#endif
+  size_t off = e->off + left;
+  for (size_t c = node_weight(t, e->p); c > 0 && off < e->n; c--) e->arr[off++] = e->p->key;
+  r.off = off;
+  par_fork(&l.task);
+  export_run(&r.task);
+  par_sync(&l.task);
+}
+
+// 최대 n개를 key 순서대로 arr에 병렬로 복사하고 복사한 개수 반환
+size_t rbtree_to_array_par(rbtree_workers *w, const rbtree *t, key_t *arr, const size_t n) {
+  if (t == NULL || arr == NULL || n == 0) return 0;
+  export_task root = {.t = t, .p = t->root, .idx = 1, .arr = arr, .n = n};
+  root.max_depth = par_depth(w, t->count);
+#ifndef RBTREE_ORDER_STATISTICS
+  root.counts = (size_t *)malloc(((size_t)2 << root.max_depth) * sizeof(size_t));
+  if (root.counts == NULL) return (size_t)rbtree_to_array(t, arr, n);
+  root.task.run = count_run;
+  par_run(w, &root.task);
+#endif
+  root.task.run = export_run;
+  par_run(w, &root.task);
+  free(root.counts);
+  return n < t->count ? n : t->count;
+}
+
+// 병렬 집합 연산: 나눈 양쪽을 각각 task로 처리. task마다 트리 구조체를 복사해 써서
+// join이 잠시 쓰는 루트 자리와 반납하는 노드 목록이 겹치지 않게 하고, 반납 목록은 끝날 때 모아 붙임
+typedef struct {
+  rbtree proto;               // task가 복사해 쓰는 트리 (루트와 free list는 비움)
+  int op, max_depth;
+  pthread_mutex_t lock;       // freed를 고칠 때
+  node_t *freed;              // task들이 반납한 노드를 모은 목록
+} set_op_ctx;
+
+typedef struct {
+  par_task task;
+  set_op_ctx *ctx;
+  node_t *a, *b, *out;
+  int ha, hb, h, depth;
+  size_t removed;
+} set_op_task;
+
+static void set_op_run(par_task *task) {
+  set_op_task *s = (set_op_task *)task;
+  set_op_ctx *ctx = s->ctx;
+  rbtree local = ctx->proto;
+  s->removed = 0;
+  if (s->a == local.nil || s->b == local.nil || s->depth >= ctx->max_depth) {
+    s->out = set_op_sub(&local, ctx->op, s->a, s->ha, s->b, s->hb, &s->removed, &s->h);
+  } else {
+    set_op_step step;
+    set_op_divide(&local, ctx->op, s->a, s->ha, s->b, s->hb, &step);
+    set_op_task l = *s, r = *s;
+    for (int i = 0; i < 2; i++) {
+      set_op_task *c = i ? &r : &l;
+      c->a = step.a[i];
+      c->ha = step.ha[i];
+      c->b = step.b[i];
+      c->hb = step.hb[i];
+      c->depth = s->depth + 1;
+    }
+    par_fork(&l.task);
+    set_op_run(&r.task);
+    par_sync(&l.task);
+    s->removed = l.removed + r.removed;
+    s->out = set_op_combine(&local, ctx->op, &step, l.out, l.h, r.out, r.h, &s->removed, &s->h);
+  }
+  if (local.pool.free_list != NULL) {
+    node_t *last = local.pool.free_list;
+    while (FREE_NEXT(last) != NULL) last = FREE_NEXT(last);
+    pthread_mutex_lock(&ctx->lock);
+    FREE_NEXT(last) = ctx->freed;
+    ctx->freed = local.pool.free_list;
+    pthread_mutex_unlock(&ctx->lock);
+  }
+}
+
+// rbtree_union과 같은 결과를 여러 스레드로 계산
+int rbtree_union_par(rbtree_workers *w, rbtree *t1, rbtree *t2) {
+  if (!compatible(t1, t2)) return -1;
+  const size_t c1 = t1->count, c2 = t2->count;
+  node_t *a, *b;
+  if (absorb(t1, t2, &a, &b) != 0) return -1;
+  set_op_ctx ctx = {.proto = *t1, .op = SET_UNION, .max_depth = par_depth(w, c1 + c2)};
+  ctx.proto.root = t1->nil;
+  ctx.proto.pool.free_list = NULL;
+  ctx.proto.hash = NULL;    //색인은 여러 스레드에서 고칠 수 없으므로 끝난 뒤 다시 만듦
+  pthread_mutex_init(&ctx.lock, NULL);
+  set_op_task root = {.ctx = &ctx, .a = a, .b = b};
+  root.ha = subtree_black_height(t1, a);
+  root.hb = subtree_black_height(t1, b);
+  root.task.run = set_op_run;
+  par_run(w, &root.task);
+  pthread_mutex_destroy(&ctx.lock);
+  //반납된 노드를 t1의 free list 앞에 붙임
+  for (node_t *p = ctx.freed, *next; p != NULL; p = next) {
+    next = FREE_NEXT(p);
+    FREE_NEXT(p) = t1->pool.free_list;
+    t1->pool.free_list = p;
+  }
+  t1->root = root.out;
+  SET_COLOR(t1->root, RBTREE_BLACK);
+  t1->count = c1 + c2 - root.removed;
+  reset_ends(t1);
+  reset_ends(t2);
+  hash_refresh(t1);
+  hash_refresh(t2);
+  return 0;
+}
+
+// ---- 파일 저장/불러오기 ----
+// 파일 = 헤더(64바이트) + 정렬된 key[nodes] + (중복을 모으는 트리면) 개수[nodes] + (map이면) value[nodes]
+// 모양은 key 배열만으로 정해지므로(가운데 원소가 루트, 가장 깊은 레벨만 RED) 링크와 색은 저장하지 않음
+// 각 구간은 8바이트 경계에서 시작하므로 mmap한 파일의 배열을 그대로 읽을 수 있음
+
+#define RBTREE_FILE_MAGIC "RBTREE\0\0"
+#define RBTREE_FILE_VERSION 1
+#define RBTREE_FILE_BYTE_ORDER 0x01020304u    // 저장한 머신과 byte order가 다르면 다르게 읽힘
+#define RBTREE_FILE_COLLAPSE 1u
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t key_size;
+  uint32_t flags;
+  uint64_t nodes;         // 노드 수 (key 배열 길이)
+  uint64_t count;         // 원소 수
+  uint64_t value_size;
+  uint64_t checksum;      // 이 필드를 0으로 둔 헤더 + 나머지 전부
+  uint64_t reserved;
+} rbtree_file_header;
+
+_Static_assert(sizeof(rbtree_file_header) == 64, "file header must stay 64 bytes");
+
+// 구간들의 위치. 파일 크기가 size_t를 넘으면 -1
+static int file_layout(const rbtree_file_header *h, size_t *counts_at, size_t *values_at, size_t *end) {
+  const uint64_t limit = SIZE_MAX / 2;
+  if (h->nodes > limit / 8 || h->value_size > limit / (h->nodes + 1)) return -1;
+  size_t at = sizeof(rbtree_file_header) + ((h->nodes * sizeof(key_t) + 7) & ~(size_t)7);
+  *counts_at = at;
+  if (h->flags & RBTREE_FILE_COLLAPSE) at += h->nodes * sizeof(uint64_t);
+  *values_at = at;
+  at += (h->nodes * h->value_size + 7) & ~(size_t)7;
+  *end = at;
+  return 0;
+}
+
+// 64비트 단어 4개를 한 번에 섞는 체크섬 (xxHash64의 round)
+#define CHECKSUM_P1 0x9e3779b185ebca87ull
+#define CHECKSUM_P2 0xc2b2ae3d27d4eb4full
+
+static inline uint64_t checksum_round(uint64_t acc, uint64_t w) {
+  acc += w * CHECKSUM_P2;
+  acc = (acc << 31) | (acc >> 33);
+  return acc * CHECKSUM_P1;
+}
+
+// 32바이트 단위로 섞고 남은 바이트 수를 돌려줌
+static size_t checksum_blocks(uint64_t lane[4], const unsigned char *p, size_t n) {
+  for (; n >= 32; p += 32, n -= 32) {
+    uint64_t w[4];
+    memcpy(w, p, sizeof(w));
+    for (int i = 0; i < 4; i++) lane[i] = checksum_round(lane[i], w[i]);
+  }
+  return n;
+}
+
+// 헤더(checksum 필드는 0으로 보고)와 payload의 체크섬
+static uint64_t file_checksum(const rbtree_file_header *h, const unsigned char *data, size_t n) {
+  uint64_t lane[4] = {CHECKSUM_P1, CHECKSUM_P2, 0, (uint64_t)0 - CHECKSUM_P1};
+  rbtree_file_header head = *h;
+  head.checksum = 0;
+  checksum_blocks(lane, (const unsigned char *)&head, sizeof(head));
+  size_t rest = checksum_blocks(lane, data, n);
+  uint64_t acc = n;
+  for (int i = 0; i < 4; i++) acc = checksum_round(acc ^ lane[i], (uint64_t)i);
+  for (const unsigned char *p = data + n - rest; rest > 0; rest--, p++) acc = checksum_round(acc, *p);
+  acc ^= acc >> 29;
+  return acc * CHECKSUM_P1;
+}
+
+typedef struct {
+  key_t *keys;
+  uint64_t *counts;
+  char *values;
+  size_t i;
+} save_cursor;
+
+static void save_sub(const rbtree *t, const node_t *p, save_cursor *c) {
+  while (p != t->nil) {
+    save_sub(t, LEFT(p), c);
+    c->keys[c->i] = p->key;
+    if (c->counts != NULL) c->counts[c->i] = NODE_COUNT(p);
+    if (c->values != NULL) memcpy(c->values + c->i * t->value_size, rbtree_value(t, p), t->value_size);
+    c->i++;
+    p = RIGHT(p);
+  }
+}
+
+// 트리를 path에 저장 (성공하면 0, 실패하면 -1)
+// 같은 디렉터리의 임시 파일에 다 쓰고 fsync한 뒤 rename하므로, 도중에 멈춰도 기존 파일은 그대로 남음
+int rbtree_save(const rbtree *t, const char *path) {
+  rbtree_file_header h = {.magic = RBTREE_FILE_MAGIC, .version = RBTREE_FILE_VERSION,
+                          .byte_order = RBTREE_FILE_BYTE_ORDER, .key_size = sizeof(key_t)};
+  h.flags = t->collapse_duplicates ? RBTREE_FILE_COLLAPSE : 0;
+  h.nodes = t->collapse_duplicates ? subtree_nodes(t, t->root) : t->count;
+  h.count = t->count;
+  h.value_size = t->value_size;
+  size_t counts_at, values_at, size;
+  if (file_layout(&h, &counts_at, &values_at, &size) != 0) return -1;
+
+  const size_t len = strlen(path);
+  char *tmp = (char *)malloc(len + 5);
+  if (tmp == NULL) return -1;
+  memcpy(tmp, path, len);
+  memcpy(tmp + len, ".tmp", 5);
+  int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    free(tmp);
+    return -1;
+  }
+  int ok = 0;
+  unsigned char *map = MAP_FAILED;
+  if (ftruncate(fd, (off_t)size) == 0) map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map != MAP_FAILED) {
+    save_cursor c = {.keys = (key_t *)(map + sizeof(h))};
+    if (h.flags & RBTREE_FILE_COLLAPSE) c.counts = (uint64_t *)(map + counts_at);
+    if (h.value_size > 0) c.values = (char *)(map + values_at);
+    save_sub(t, t->root, &c);
+    h.checksum = file_checksum(&h, map + sizeof(h), size - sizeof(h));
+    memcpy(map, &h, sizeof(h));
+    ok = msync(map, size, MS_SYNC) == 0;
+    munmap(map, size);
+  }
+  ok = ok && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  ok = ok && rename(tmp, path) == 0;
+  if (!ok) unlink(tmp);
+  free(tmp);
+  return ok ? 0 : -1;
+}
+
+// 저장된 파일을 읽기 전용으로 mmap (헤더, 크기, 체크섬, key 순서를 확인하고 틀리면 NULL)
+rbtree_view *rbtree_view_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(rbtree_file_header)) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (map == MAP_FAILED) return NULL;
+  const size_t size = (size_t)st.st_size;
+  madvise(map, size, MADV_SEQUENTIAL);
+
+  const rbtree_file_header *h = (const rbtree_file_header *)map;
+  const unsigned char *data = (const unsigned char *)map + sizeof(*h);
+  size_t counts_at, values_at, end;
+  rbtree_view *v = NULL;
+  if (memcmp(h->magic, RBTREE_FILE_MAGIC, sizeof(h->magic)) == 0 && h->version == RBTREE_FILE_VERSION &&
+      h->byte_order == RBTREE_FILE_BYTE_ORDER && h->key_size == sizeof(key_t) &&
+      (h->flags & ~RBTREE_FILE_COLLAPSE) == 0 && file_layout(h, &counts_at, &values_at, &end) == 0 &&
+      end == size && file_checksum(h, data, size - sizeof(*h)) == h->checksum) {
+    v = (rbtree_view *)calloc(1, sizeof(rbtree_view));
+  }
+  if (v == NULL) {
+    munmap(map, size);
+    return NULL;
+  }
+  v->keys = (const key_t *)data;
+  v->counts = (h->flags & RBTREE_FILE_COLLAPSE) ? (const uint64_t *)((const char *)map + counts_at) : NULL;
+  v->values = h->value_size > 0 ? (const char *)map + values_at : NULL;
+  v->nodes = h->nodes;
+  v->count = h->count;
+  v->value_size = h->value_size;
+  v->map = map;
+  v->map_size = size;
+
+  //체크섬이 맞아도 만든 쪽 버그로 순서가 틀린 파일은 트리로 쓸 수 없음
+  //(중복을 모으거나 map이면 key가 서로 달라야 하고, 개수 합이 원소 수와 같아야 함)
+  const int unique = v->counts != NULL || v->values != NULL;
+  uint64_t total = v->counts == NULL ? v->nodes : 0;
+  int valid = v->counts != NULL || v->count == v->nodes;
+  for (size_t i = 0; valid && i < v->nodes; i++) {
+    if (i > 0 && (v->keys[i - 1] > v->keys[i] || (unique && v->keys[i - 1] == v->keys[i]))) valid = 0;
+    if (v->counts != NULL) {
+      if (v->counts[i] == 0) valid = 0;
+      total += v->counts[i];
+    }
+  }
+  if (!valid || total != v->count) {
+    rbtree_view_close(v);
+    return NULL;
+  }
+  madvise(map, size, MADV_RANDOM);
+  return v;
+}
+
+void rbtree_view_close(rbtree_view *v) {
+  munmap(v->map, v->map_size);
+  free(v);
+}
+
+// key 이상인 첫 원소의 위치 (없으면 v->nodes)
+size_t rbtree_view_lower_bound(const rbtree_view *v, const key_t key) {
+  const key_t *base = v->keys;
+  size_t n = v->nodes;
+  while (n > 1) {
+    const size_t half = n / 2;
+    if (base[half - 1] < key) base += half;
+    n -= half;
+  }
+  return (size_t)(base - v->keys) + (n == 1 && *base < key);
+}
+
+// key가 있으면 그 위치, 없으면 -1
+ptrdiff_t rbtree_view_find(const rbtree_view *v, const key_t key) {
+  const size_t i = rbtree_view_lower_bound(v, key);
+  return i < v->nodes && v->keys[i] == key ? (ptrdiff_t)i : -1;
+}
+
+// map 파일에서 key의 value (없으면 NULL)
+const void *rbtree_view_get(const rbtree_view *v, const key_t key) {
+  const ptrdiff_t i = rbtree_view_find(v, key);
+  return i >= 0 && v->values != NULL ? v->values + (size_t)i * v->value_size : NULL;
+}
+
+#if defined(RBTREE_ORDER_STATISTICS)
+// 개수를 채운 뒤 서브트리 크기를 아래에서부터 다시 계산
+static void load_sizes(rbtree *t, node_t *p) {
+  if (p == t->nil) return;
+  load_sizes(t, LEFT(p));
+  load_sizes(t, RIGHT(p));
+  UPDATE_SIZE(t, p);
+}
+#endif
+
+// 열어 둔 파일로 트리를 O(n)에 다시 만듦 (회전 없음, 노드는 한 구간에서 연속으로 꺼냄)
+rbtree *rbtree_load_view(const rbtree_view *v) {
+  rbtree_options opts = {0};
+  opts.capacity = v->nodes;
+  opts.collapse_duplicates = v->counts != NULL;
+  opts.value_size = v->value_size;
+  rbtree *t = new_rbtree_opts(&opts);
+  if (t == NULL || v->nodes == 0) return t;
+  node_t *nodes = pool_take(&t->pool, v->nodes);
+  if (nodes == NULL) {
+    delete_rbtree(t);
+    return NULL;
+  }
+  int red_depth = 0;
+  while (((size_t)2 << red_depth) <= v->nodes) red_depth++;
+  t->root = build_sorted_sub(t, nodes, v->keys, 0, v->nodes, t->nil, 0, red_depth);
+  //i번째 key는 i번째 노드에 들어가므로 개수와 value도 같은 순서로 채움
+  if (v->counts != NULL || v->values != NULL) {
+    for (size_t i = 0; i < v->nodes; i++) {
+      node_t *p = NODE_AT(nodes, i, t->pool.stride);
+      if (v->counts != NULL) NODE_COUNT(p) = v->counts[i];
+      if (v->values != NULL) memcpy(rbtree_value(t, p), v->values + i * v->value_size, v->value_size);
+    }
+#if defined(RBTREE_ORDER_STATISTICS)
+    if (v->counts != NULL) load_sizes(t, t->root);
+#endif
+  }
+  t->count = v->count;
+  reset_ends(t);
+  return t;
+}
+
+// path에 저장된 트리를 불러옴 (파일이 없거나 손상됐으면 NULL)
+rbtree *rbtree_load(const char *path) {
+  rbtree_view *v = rbtree_view_open(path);
+  if (v == NULL) return NULL;
+  madvise(v->map, v->map_size, MADV_SEQUENTIAL);
+  rbtree *t = rbtree_load_view(v);
+  rbtree_view_close(v);
+  return t;
+}
+
+// ---- 읽기 전용 정적 B+ 트리 (rbtree_freeze) ----
+// 잎: 정렬된 key를 RBTREE_FROZEN_B개씩(int key면 캐시 라인 하나) 나눈 블록. 마지막 블록은 KEY_MAX로 채움
+// 내부 노드: key B개와 자식 B + 1개. i번 노드의 k번 자식은 아래 층의 i * (B + 1) + k번이라 링크가 없고,
+// j번 key는 j + 1번 자식 서브트리의 가장 작은 key (없는 자식이면 KEY_MAX)
+// 탐색은 층마다 블록 하나에서 key보다 작은 key의 수를 세어 자식을 고름 (SIMD 비교 후 popcount)
+
+#define FROZEN_B RBTREE_FROZEN_B
+#define KEY_MAX ((key_t)INT_MAX)
+
+// 블록(B개, 64바이트 정렬)에서 key보다 작은 key의 수
+#if defined(__AVX2__) && !defined(RBTREE_NO_SIMD)
+_Static_assert(sizeof(key_t) == 4 && FROZEN_B == 16, "SIMD 블록 탐색은 32비트 key 16개 기준");
+static inline size_t block_rank(const key_t *blk, const key_t key) {
+  const __m256i x = _mm256_set1_epi32(key);
+  const __m256i a = _mm256_load_si256((const __m256i *)blk);
+  const __m256i b = _mm256_load_si256((const __m256i *)(blk + 8));
+  const unsigned ma = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, a)));
+  const unsigned mb = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, b)));
+  return (size_t)__builtin_popcount(ma | (mb << 8));
+}
+#elif defined(__SSE2__) && !defined(RBTREE_NO_SIMD)
+_Static_assert(sizeof(key_t) == 4 && FROZEN_B == 16, "SIMD 블록 탐색은 32비트 key 16개 기준");
+static inline size_t block_rank(const key_t *blk, const key_t key) {
+  const __m128i x = _mm_set1_epi32(key);
+  const __m128i *v = (const __m128i *)blk;
+  //비교 결과(-1/0)를 16비트, 8비트로 줄여서 바이트 마스크 하나로 모음
+  const __m128i lo = _mm_packs_epi32(_mm_cmplt_epi32(_mm_load_si128(v), x), _mm_cmplt_epi32(_mm_load_si128(v + 1), x));
+  const __m128i hi = _mm_packs_epi32(_mm_cmplt_epi32(_mm_load_si128(v + 2), x), _mm_cmplt_epi32(_mm_load_si128(v + 3), x));
+  return (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_packs_epi16(lo, hi)));
+}
+#else
+static inline size_t block_rank(const key_t *blk, const key_t key) {
+  size_t c = 0;
+  for (int i = 0; i < FROZEN_B; i++) c += blk[i] < key;
+  return c;
+}
+#endif
+
+// t의 현재 내용(중복 포함)을 정적 B+ 트리로 복사. 이후 t를 고쳐도 영향이 없음 (메모리가 부족하면 NULL)
+rbtree_frozen *rbtree_freeze(const rbtree *t) {
+  rbtree_frozen *f = (rbtree_frozen *)calloc(1, sizeof(rbtree_frozen));
+  if (f == NULL) return NULL;
+  const size_t n = rbtree_size(t);
+  const size_t leaves = (n + FROZEN_B - 1) / FROZEN_B;
+
+  //층별 노드 수 (아래에서 위로), 루트 층은 노드 하나
+  size_t counts[RBTREE_FROZEN_MAX_LEVELS];
+  size_t internal = 0;
+  for (size_t c = leaves; c > 1; f->levels++) {
+    c = (c + FROZEN_B) / (FROZEN_B + 1);
+    counts[f->levels] = c;
+    internal += c;
+  }
+  //루트 층부터 차례로 놓음
+  for (int l = 0; l < f->levels; l++) {
+    f->level_start[l] = l == 0 ? 0 : f->level_start[l - 1] + counts[f->levels - l];
+  }
+
+  const size_t bytes = (internal + leaves) * FROZEN_B * sizeof(key_t);
+  f->index = (key_t *)aligned_alloc(CACHE_LINE, bytes > 0 ? (bytes + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1) : CACHE_LINE);
+  if (f->index == NULL) {
+    free(f);
+    return NULL;
+  }
+  key_t *keys = f->index + internal * FROZEN_B;
+  f->keys = keys;
+  f->n = n;
+  if (n > 0 && (size_t)rbtree_to_array(t, keys, n) != n) {
+    delete_rbtree_frozen(f);
+    return NULL;
+  }
+  for (size_t i = n; i < leaves * FROZEN_B; i++) keys[i] = KEY_MAX;
+
+  //h층(잎 바로 위가 0) 노드의 자식 하나는 잎 블록 span개를 덮음
+  size_t span = 1, below = leaves;
+  for (int h = 0; h < f->levels; h++) {
+    key_t *level = f->index + f->level_start[f->levels - 1 - h] * FROZEN_B;
+    for (size_t i = 0; i < counts[h]; i++) {
+      for (int j = 0; j < FROZEN_B; j++) {
+        const size_t c = i * (FROZEN_B + 1) + (size_t)j + 1;
+        level[i * FROZEN_B + j] = c < below ? keys[c * span * FROZEN_B] : KEY_MAX;
+      }
+    }
+    span *= FROZEN_B + 1;
+    below = counts[h];
+  }
+  return f;
+}
+
+void delete_rbtree_frozen(rbtree_frozen *f) {
+  free(f->index);
+  free(f);
+}
+
+// key 이상인 첫 key의 위치 (없으면 n)
+size_t rbtree_frozen_lower_bound(const rbtree_frozen *f, const key_t key) {
+  if (f->n == 0) return 0;
+  size_t node = 0;
+  for (int l = 0; l < f->levels; l++) {
+    node = node * (FROZEN_B + 1) + block_rank(f->index + (f->level_start[l] + node) * FROZEN_B, key);
+  }
+  //잎 블록의 key가 모두 작으면 다음 블록의 첫 위치가 답 (잎은 이어져 있으므로 그대로 맞음)
+  const size_t i = node * FROZEN_B + block_rank(f->keys + node * FROZEN_B, key);
+  return i < f->n ? i : f->n;
+}
+
+// key가 있으면 그 위치(같은 key가 여럿이면 첫 위치), 없으면 -1
+ptrdiff_t rbtree_frozen_find(const rbtree_frozen *f, const key_t key) {
+  const size_t i = rbtree_frozen_lower_bound(f, key);
+  return i < f->n && f->keys[i] == key ? (ptrdiff_t)i : -1;
+}
+
+// lo <= key < hi 인 key의 수. *first에 그 첫 위치를 적음 (f->keys[*first]부터 차례로 읽으면 됨)
+size_t rbtree_frozen_range(const rbtree_frozen *f, const key_t lo, const key_t hi, size_t *first) {
+  const size_t b = rbtree_frozen_lower_bound(f, lo);
+  const size_t e = hi > lo ? rbtree_frozen_lower_bound(f, hi) : b;
+  if (first != NULL) *first = b;
+  return e - b;
+}
+
+// ---- 연산 통계 (RBTREE_STATS) ----
+#ifdef RBTREE_STATS
+
+void rbtree_stats_snapshot(const rbtree *t, rbtree_stats *out) {
+  *out = t->stats;
+  out->allocs = t->pool.allocs;
+  out->frees = t->pool.frees;
+}
+
+void rbtree_stats_reset(rbtree *t) {
+  memset(&t->stats, 0, sizeof(t->stats));
+  t->pool.allocs = t->pool.frees = 0;
+}
+
+// parent 링크 없이 스택으로 내려가므로 영속 트리와 snapshot에도 쓸 수 있음
+int rbtree_depth_histogram(const rbtree *t, size_t *depth, size_t *black, const size_t cap) {
+  if (cap == 0) return 0;
+  if (depth != NULL) memset(depth, 0, cap * sizeof(size_t));
+  if (black != NULL) memset(black, 0, cap * sizeof(size_t));
+
+  //오른쪽 자식을 스택에 미뤄 두고 왼쪽으로 내려감 (스택에는 경로마다 한 칸 이하라서 높이만큼이면 충분)
+  const node_t *stack[PATH_MAX_DEPTH];
+  int depths[PATH_MAX_DEPTH], blacks[PATH_MAX_DEPTH];
+  int top = 0, height = 0;
+  const node_t *p = t->root;
+  int d = 0, b = 0;
+  for (;;) {
+    if (p == t->nil) {
+      if (top == 0) break;
+      top--;
+      p = stack[top];
+      d = depths[top];
+      b = blacks[top];
+      continue;
+    }
+    b += COLOR(p) == RBTREE_BLACK;
+    if (d + 1 > height) height = d + 1;
+    if (depth != NULL) depth[(size_t)d < cap ? (size_t)d : cap - 1]++;
+    if (black != NULL) black[(size_t)b < cap ? (size_t)b : cap - 1]++;
+    if (RIGHT(p) != t->nil) {
+      stack[top] = RIGHT(p);
+      depths[top] = d + 1;
+      blacks[top++] = b;
+    }
+    p = LEFT(p);
+    d++;
+  }
+  return height;
+}
+
+#endif
@@ -2,40 +2,270 @@
 #define _RBTREE_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum { RBTREE_RED, RBTREE_BLACK } color_t;
 
 typedef int key_t;
 
+// 노드 레이아웃 (빌드 옵션으로 선택, 함수 API는 모두 같음)
+// - 기본: color, key, parent/left/right 포인터
+// - RBTREE_COMPACT: color를 parent 포인터의 최하위 비트에 저장
+// - RBTREE_INDEX32: 링크를 트리 노드 배열의 32비트 인덱스로 저장 (int key면 노드당 16바이트)
+// 링크는 rbtree_left/rbtree_right/rbtree_parent/rbtree_color로 읽음
+//
+// RBTREE_ORDER_STATISTICS로 빌드하면 노드마다 서브트리 크기를 유지 (rbtree_select, rbtree_rank)
+// RBTREE_STATS로 빌드하면 트리마다 비교, 회전, 균형 복구 횟수를 셈 (끄면 필드도 코드도 없음)
+#if defined(RBTREE_INDEX32)
+typedef struct node_t {
+  key_t key;
+  uint32_t parent_color;  // (parent 인덱스 << 1) | color
+  uint32_t left, right;
+#ifdef RBTREE_ORDER_STATISTICS
+  size_t size;  // 이 노드를 루트로 하는 서브트리의 원소 수
+#endif
+} node_t;
+#elif defined(RBTREE_COMPACT)
+typedef struct node_t {
+  uintptr_t parent_color; // parent 포인터 | color
+  struct node_t *left, *right;
+  key_t key;
+#ifdef RBTREE_ORDER_STATISTICS
+  size_t size;
+#endif
+} node_t;
+#else
 typedef struct node_t {
   color_t color;
   key_t key;
   struct node_t *parent, *left, *right;
+#ifdef RBTREE_ORDER_STATISTICS
+  size_t size;
+#endif
 } node_t;
+#endif
+
+typedef struct rbtree_slab rbtree_slab;
+typedef struct rbtree_arena rbtree_arena;
+typedef struct rbtree_version rbtree_version;
+typedef struct rbtree_hash rbtree_hash;
+
+// 트리별 노드 풀
+// 포인터 레이아웃: slab 단위로 노드를 받아 두고, 반납된 노드는 free list로 재사용
+// 인덱스 레이아웃: 주소 공간을 한 번에 예약해 둔 연속 배열 (0번 노드가 nil)
+typedef struct {
+#ifdef RBTREE_INDEX32
+  char *base;           // 노드 배열 시작 주소
+  size_t used;          // 잘라 준 노드 수
+  size_t committed;     // 읽고 쓸 수 있게 만든 노드 수
+  size_t reserved;      // 예약한 노드 수
+  unsigned shift;       // stride == 1 << shift
+#else
+  rbtree_slab *slabs;   // 할당받은 slab 목록
+  char *next, *end;     // 가장 최근 slab에서 아직 쓰지 않은 구간
+  size_t slab_nodes;    // 다음에 받을 slab의 노드 수
+  rbtree_arena *arena;  // split/join으로 노드를 주고받는 트리들이 함께 소유하는 slab (없으면 NULL)
+#endif
+  node_t *free_list;    // 반납된 노드 목록
+  size_t stride;        // 노드 하나가 차지하는 바이트 수 (노드 뒤에 붙는 필드 포함)
+#ifdef RBTREE_STATS
+  uint64_t allocs, frees;  // 노드 하나씩 꺼내고 반납한 횟수
+#endif
+} node_pool;
+
+#ifdef RBTREE_STATS
+// 트리 하나의 연산 횟수 (rbtree_stats_snapshot으로 읽고 rbtree_stats_reset으로 0으로 돌림)
+// 읽기 함수도 횟수를 고치므로 여러 스레드가 같은 트리를 동시에 읽으면 값이 정확하지 않음
+typedef struct {
+  uint64_t finds;             // rbtree_find 호출 수
+  uint64_t find_compares;     // rbtree_find가 key를 비교한 노드 수
+  uint64_t inserts;           // rbtree_insert, rbtree_insert_hint, map 삽입 호출 수
+  uint64_t insert_compares;   // 삽입 위치를 찾으며 key를 비교한 노드 수
+  uint64_t rotate_left, rotate_right;
+  uint64_t insert_fixup[3];   // 삽입 복구에서 CLRS case 1~3을 거친 횟수 (삼촌이 빨강 / 꺾인 모양 / 곧은 모양, case 2 뒤에는 case 3)
+  uint64_t erase_fixup[4];    // 삭제 복구에서 CLRS case 1~4를 거친 횟수 (형제가 빨강 / 조카 둘 다 검정 / 바깥 조카만 검정 / 바깥 조카가 빨강)
+  uint64_t allocs, frees;     // 풀에서 하나씩 꺼내고 반납한 노드 수 (정렬 배열로 한꺼번에 만든 노드는 제외)
+} rbtree_stats;
+#endif
 
 typedef struct {
   node_t *root;
   node_t *nil;  // for sentinel
+  node_t *leftmost, *rightmost;  // 가장 작은/큰 노드 (비어 있으면 nil)
+  node_pool pool;
+  size_t count;  // 원소 수
+  int collapse_duplicates;
+  size_t value_offset;  // map: 노드 시작에서 value까지의 거리 (0이면 value 없음)
+  size_t value_size;
+  int persistent;           // 경로 복사 모드
+  size_t refs_offset;       // 영속 모드: 노드를 가리키는 링크 수가 저장된 위치
+  rbtree_version *versions; // 영속 모드: 아직 회수하지 않은 snapshot 목록
+  rbtree_hash *hash;        // key → 노드 해시 색인 (꺼져 있으면 NULL)
+#ifdef RBTREE_STATS
+  rbtree_stats stats;       // allocs, frees는 pool에서 세고 snapshot에서 채움
+#endif
 } rbtree;
 
+typedef struct {
+  size_t capacity;          // 미리 확보해 둘 노드 수
+  int collapse_duplicates;  // 같은 key는 노드 하나에 개수로 모음
+  size_t value_size;        // 0이 아니면 key→value map: 노드마다 value를 key 옆에 저장
+  int persistent;           // 갱신할 때 공유된 노드를 고치지 않고 경로를 복사 (rbtree_snapshot 사용 가능)
+  int hash_index;           // key → 노드 해시 색인을 함께 유지해서 find, key로 지우기를 O(1)에 (영속 모드와는 함께 못 씀)
+} rbtree_options;
+
+#if defined(RBTREE_INDEX32)
+#define RBTREE_NODE(t, i) ((node_t *)((t)->pool.base + ((size_t)(i) << (t)->pool.shift)))
+static inline node_t *rbtree_left(const rbtree *t, const node_t *p) { return RBTREE_NODE(t, p->left); }
+static inline node_t *rbtree_right(const rbtree *t, const node_t *p) { return RBTREE_NODE(t, p->right); }
+static inline node_t *rbtree_parent(const rbtree *t, const node_t *p) { return RBTREE_NODE(t, p->parent_color >> 1); }
+static inline color_t rbtree_color(const node_t *p) { return (color_t)(p->parent_color & 1); }
+#elif defined(RBTREE_COMPACT)
+static inline node_t *rbtree_left(const rbtree *t, const node_t *p) { return p->left; }
+static inline node_t *rbtree_right(const rbtree *t, const node_t *p) { return p->right; }
+static inline node_t *rbtree_parent(const rbtree *t, const node_t *p) { return (node_t *)(p->parent_color & ~(uintptr_t)1); }
+static inline color_t rbtree_color(const node_t *p) { return (color_t)(p->parent_color & 1); }
+#else
+static inline node_t *rbtree_left(const rbtree *t, const node_t *p) { return p->left; }
+static inline node_t *rbtree_right(const rbtree *t, const node_t *p) { return p->right; }
+static inline node_t *rbtree_parent(const rbtree *t, const node_t *p) { return p->parent; }
+static inline color_t rbtree_color(const node_t *p) { return p->color; }
+#endif
+
+// map 트리에서 노드에 붙은 value
+static inline void *rbtree_value(const rbtree *t, const node_t *p) { return (char *)p + t->value_offset; }
+
 rbtree *new_rbtree(void);
+rbtree *new_rbtree_with_capacity(const size_t);
+rbtree *new_rbtree_opts(const rbtree_options *);
+rbtree *rbtree_build_from_sorted(const key_t *, const size_t);
 void delete_rbtree(rbtree *);
+void rbtree_clear(rbtree *);
 void delete_rbtree_sub(rbtree *, node_t *);
 
 node_t *rbtree_insert(rbtree *, const key_t);
+node_t *rbtree_insert_hint(rbtree *, node_t *, const key_t);
+size_t rbtree_insert_batch(rbtree *, const key_t *, const size_t);
 void rbtree_insert_fixup(rbtree *, node_t *);
 void rotate_left(rbtree *, node_t *);
 void rotate_right(rbtree *, node_t *);
 
 node_t *rbtree_find(const rbtree *, const key_t);
+size_t rbtree_find_batch(const rbtree *, const key_t *, const size_t, node_t **);
+size_t rbtree_contains_batch(const rbtree *, const key_t *, const size_t, unsigned char *);
+node_t *rbtree_lower_bound(const rbtree *, const key_t);
+node_t *rbtree_upper_bound(const rbtree *, const key_t);
+void rbtree_equal_range(const rbtree *, const key_t, node_t **, node_t **);
+size_t rbtree_count(const rbtree *, const key_t);
+size_t rbtree_size(const rbtree *);
+size_t rbtree_node_count(const rbtree *, const node_t *);
+#ifdef RBTREE_ORDER_STATISTICS
+node_t *rbtree_select(const rbtree *, size_t);
+size_t rbtree_rank(const rbtree *, const node_t *);
+#endif
 node_t *rbtree_min(const rbtree *);
 node_t *rbtree_max(const rbtree *);
 
+node_t *rbtree_next(const rbtree *, const node_t *);
+node_t *rbtree_prev(const rbtree *, const node_t *);
+
+// 0이 아닌 값을 돌려주면 순회를 멈춤
+typedef int (*rbtree_visit_fn)(node_t *, void *);
+size_t rbtree_foreach_range(const rbtree *, const key_t, const key_t, rbtree_visit_fn, void *);
+
+void *rbtree_map_put(rbtree *, const key_t, const void *);
+void *rbtree_map_get(const rbtree *, const key_t);
+void *rbtree_map_get_or_insert(rbtree *, const key_t, int *);
+
+// 성공하면 0. 영속 트리에서는 노드 대신 그 key를 가진 원소 하나를 지우고, 그런 원소가 이미 없으면 -1
 int rbtree_erase(rbtree *, node_t *);
+int rbtree_erase_key(rbtree *, const key_t);
+size_t rbtree_erase_all(rbtree *, const key_t);
+size_t rbtree_erase_range(rbtree *, const key_t, const key_t);
+size_t rbtree_erase_keys_batch(rbtree *, const key_t *, const size_t);
+int rbtree_pop_min(rbtree *, key_t *);
+int rbtree_pop_max(rbtree *, key_t *);
+size_t rbtree_pop_min_while(rbtree *, const key_t, key_t *, const size_t);
 void rbtree_erase_fixup(rbtree *, node_t *);
 void rbtree_transplant(rbtree *, node_t *, node_t *) ;
 node_t *tree_minimum(rbtree *, node_t *);
 
+// key → 노드 해시 색인: 켜 두면 삽입/삭제 때 함께 고치고, rbtree_find는 트리 대신 색인에서 찾음
+// (같은 key가 여럿이면 그중 한 노드). 성공하면 0, 영속 트리거나 메모리가 부족하면 -1
+int rbtree_hash_index_enable(rbtree *);
+void rbtree_hash_index_disable(rbtree *);
+size_t rbtree_hash_index_memory(const rbtree *);
+
+rbtree *rbtree_snapshot(rbtree *);
+void rbtree_snapshot_release(rbtree *);
+size_t rbtree_reclaim(rbtree *);
+
+// join 기반 연산: 노드를 새로 할당하지 않고 트리 사이에서 옮김 (성공하면 0, 실패하면 -1)
+int rbtree_join(rbtree *, const key_t, rbtree *);
+int rbtree_concat(rbtree *, rbtree *);
+int rbtree_split(rbtree *, const key_t, rbtree **, rbtree **);
+int rbtree_union(rbtree *, rbtree *);
+int rbtree_intersection(rbtree *, rbtree *);
+int rbtree_difference(rbtree *, rbtree *);
+
+// fork-join 병렬 실행기: 스레드를 만들어 두고 큰 트리의 일괄 연산을 서브트리 단위로 나눠 처리
+typedef struct rbtree_workers rbtree_workers;
+rbtree_workers *new_rbtree_workers(int, size_t);
+void delete_rbtree_workers(rbtree_workers *);
+rbtree *rbtree_build_from_sorted_par(rbtree_workers *, const key_t *, const size_t);
+size_t rbtree_to_array_par(rbtree_workers *, const rbtree *, key_t *, const size_t);
+int rbtree_union_par(rbtree_workers *, rbtree *, rbtree *);
+
+// 파일 저장/불러오기: 정렬된 key(와 개수, value)를 버전과 체크섬이 붙은 파일로 저장하고,
+// 불러올 때는 mmap한 배열로 트리를 O(n)에 다시 만들거나 트리 없이 읽기 전용으로 바로 씀
+typedef struct {
+  const key_t *keys;        // 정렬된 key (파일을 mmap한 메모리를 그대로 가리킴)
+  const uint64_t *counts;   // 중복을 모은 트리면 key별 개수 (아니면 NULL)
+  const char *values;       // map이면 key별 value가 value_size 간격으로 (아니면 NULL)
+  size_t nodes;             // key 배열 길이
+  size_t count;             // 원소 수
+  size_t value_size;
+  void *map;
+  size_t map_size;
+} rbtree_view;
+
+int rbtree_save(const rbtree *, const char *);
+rbtree *rbtree_load(const char *);
+rbtree_view *rbtree_view_open(const char *);
+void rbtree_view_close(rbtree_view *);
+rbtree *rbtree_load_view(const rbtree_view *);
+size_t rbtree_view_lower_bound(const rbtree_view *, const key_t);
+ptrdiff_t rbtree_view_find(const rbtree_view *, const key_t);
+const void *rbtree_view_get(const rbtree_view *, const key_t);
+
+#ifdef RBTREE_STATS
+void rbtree_stats_snapshot(const rbtree *, rbtree_stats *);
+void rbtree_stats_reset(rbtree *);
+// 높이 히스토그램: depth[d]는 루트에서 d번째 레벨(루트가 0)의 노드 수
+// 검은 깊이 히스토그램: black[b]는 루트부터 자신까지 검은 노드가 b개인 노드 수
+// 두 배열(NULL 가능)은 cap칸이며 더 깊은 노드는 마지막 칸에 셈. 트리 높이(레벨 수) 반환
+int rbtree_depth_histogram(const rbtree *, size_t *, size_t *, const size_t);
+#endif
+
+// 읽기 전용 정적 B+ 트리: 트리를 정렬된 key 배열로 내보내고, 그 위에 key 16개(int key면 캐시 라인 하나)와
+// 자식 17개짜리 내부 노드 층을 쌓음. 자식 위치는 계산으로 구하고 블록 안은 SIMD로 비교함
+// (AVX2로 빌드하면 AVX2, 아니면 SSE2, RBTREE_NO_SIMD면 스칼라)
+#define RBTREE_FROZEN_B 16
+#define RBTREE_FROZEN_MAX_LEVELS 16
+typedef struct {
+  const key_t *keys;        // 정렬된 key n개 (중복 포함)
+  size_t n;
+  key_t *index;             // 내부 노드 층들(루트 층부터)과 잎 블록을 담은 64바이트 정렬 메모리
+  int levels;               // 내부 노드 층 수
+  size_t level_start[RBTREE_FROZEN_MAX_LEVELS];  // 층마다 첫 노드의 위치 (노드 단위)
+} rbtree_frozen;
+
+rbtree_frozen *rbtree_freeze(const rbtree *);
+void delete_rbtree_frozen(rbtree_frozen *);
+size_t rbtree_frozen_lower_bound(const rbtree_frozen *, const key_t);
+ptrdiff_t rbtree_frozen_find(const rbtree_frozen *, const key_t);
+size_t rbtree_frozen_range(const rbtree_frozen *, const key_t, const key_t, size_t *);
+
 int rbtree_to_array(const rbtree *, key_t *, const size_t);
 void rbtree_to_array_recursive(const rbtree *, const node_t *, key_t *, const size_t, size_t *);
 
@@ -0,0 +1,187 @@
+#include "rbtree_concurrent.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+static int rw_init(rbtree_rw *rw, const rbtree_options *opts) {
+  rw->tree = new_rbtree_opts(opts);
+  if (rw->tree == NULL) return -1;
+  if (pthread_rwlock_init(&rw->lock, NULL) != 0) {
+    delete_rbtree(rw->tree);
+    return -1;
+  }
+  return 0;
+}
+
+static void rw_destroy(rbtree_rw *rw) {
+  pthread_rwlock_destroy(&rw->lock);
+  delete_rbtree(rw->tree);
+}
+
+// opts는 new_rbtree_opts와 같음 (NULL이면 기본값)
+rbtree_rw *new_rbtree_rw(const rbtree_options *opts) {
+  rbtree_rw *rw = (rbtree_rw *)aligned_alloc(64, sizeof(rbtree_rw));
+  if (rw == NULL) return NULL;
+  if (rw_init(rw, opts) != 0) {
+    free(rw);
+    return NULL;
+  }
+  return rw;
+}
+
+void delete_rbtree_rw(rbtree_rw *rw) {
+  rw_destroy(rw);
+  free(rw);
+}
+
+// 삽입되면 1, 메모리가 부족하면 0
+int rbtree_rw_insert(rbtree_rw *rw, const key_t key) {
+  pthread_rwlock_wrlock(&rw->lock);
+  int ok = rbtree_insert(rw->tree, key) != NULL;
+  pthread_rwlock_unlock(&rw->lock);
+  return ok;
+}
+
+// key가 있으면 1
+int rbtree_rw_find(rbtree_rw *rw, const key_t key) {
+  pthread_rwlock_rdlock(&rw->lock);
+  int found = rbtree_find(rw->tree, key) != NULL;
+  pthread_rwlock_unlock(&rw->lock);
+  return found;
+}
+
+// key와 같은 원소 하나를 지움 (지웠으면 1)
+int rbtree_rw_erase(rbtree_rw *rw, const key_t key) {
+  pthread_rwlock_wrlock(&rw->lock);
+  int erased = rbtree_erase_key(rw->tree, key);
+  pthread_rwlock_unlock(&rw->lock);
+  return erased;
+}
+
+// 가장 작은 key를 *out에 (비어 있으면 0 반환)
+int rbtree_rw_min(rbtree_rw *rw, key_t *out) {
+  pthread_rwlock_rdlock(&rw->lock);
+  node_t *p = rbtree_min(rw->tree);
+  if (p != NULL) *out = p->key;
+  pthread_rwlock_unlock(&rw->lock);
+  return p != NULL;
+}
+
+int rbtree_rw_max(rbtree_rw *rw, key_t *out) {
+  pthread_rwlock_rdlock(&rw->lock);
+  node_t *p = rbtree_max(rw->tree);
+  if (p != NULL) *out = p->key;
+  pthread_rwlock_unlock(&rw->lock);
+  return p != NULL;
+}
+
+size_t rbtree_rw_size(rbtree_rw *rw) {
+  pthread_rwlock_rdlock(&rw->lock);
+  size_t n = rbtree_size(rw->tree);
+  pthread_rwlock_unlock(&rw->lock);
+  return n;
+}
+
+// 최대 n개를 key 순서대로 arr에 복사하고 복사한 개수 반환
+size_t rbtree_rw_to_array(rbtree_rw *rw, key_t *arr, const size_t n) {
+  pthread_rwlock_rdlock(&rw->lock);
+  size_t copied = (size_t)rbtree_to_array(rw->tree, arr, n);
+  pthread_rwlock_unlock(&rw->lock);
+  return copied;
+}
+
+// [lo, hi)를 nshards개의 같은 폭 구간으로 나눔 (구간 밖의 key는 양 끝 shard로 감). hi <= lo면 NULL
+rbtree_sharded *new_rbtree_sharded(const size_t nshards, const key_t lo, const key_t hi,
+                                   const rbtree_options *opts) {
+  if (hi <= lo) return NULL;
+  rbtree_sharded *s = (rbtree_sharded *)calloc(1, sizeof(rbtree_sharded));
+  if (s == NULL) return NULL;
+  s->nshards = nshards > 0 ? nshards : 1;
+  s->bounds = (key_t *)malloc(s->nshards * sizeof(key_t));
+  s->shards = (rbtree_rw *)aligned_alloc(64, s->nshards * sizeof(rbtree_rw));
+  if (s->bounds == NULL || s->shards == NULL) {
+    free(s->shards);
+    free(s->bounds);
+    free(s);
+    return NULL;
+  }
+
+  //구간보다 shard가 많으면 폭 1짜리 shard를 앞에서부터 채우고 나머지는 hi에서 끝나는 빈 shard가 됨
+  int64_t width = ((int64_t)hi - lo) / (int64_t)s->nshards;
+  if (width < 1) width = 1;
+  for (size_t i = 0; i < s->nshards; i++) {
+    const int64_t bound = lo + width * (int64_t)(i + 1);
+    s->bounds[i] = (key_t)(bound < hi ? bound : hi);
+    if (rw_init(&s->shards[i], opts) != 0) {
+      while (i-- > 0) rw_destroy(&s->shards[i]);
+      free(s->shards);
+      free(s->bounds);
+      free(s);
+      return NULL;
+    }
+  }
+  return s;
+}
+
+void delete_rbtree_sharded(rbtree_sharded *s) {
+  for (size_t i = 0; i < s->nshards; i++) rw_destroy(&s->shards[i]);
+  free(s->shards);
+  free(s->bounds);
+  free(s);
+}
+
+// key를 맡는 shard: key < bounds[i]인 첫 i (없으면 마지막 shard)
+static rbtree_rw *shard_of(const rbtree_sharded *s, const key_t key) {
+  size_t lo = 0, hi = s->nshards - 1;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (key < s->bounds[mid]) hi = mid;
+    else lo = mid + 1;
+  }
+  return &s->shards[lo];
+}
+
+int rbtree_sharded_insert(rbtree_sharded *s, const key_t key) {
+  return rbtree_rw_insert(shard_of(s, key), key);
+}
+
+int rbtree_sharded_find(rbtree_sharded *s, const key_t key) {
+  return rbtree_rw_find(shard_of(s, key), key);
+}
+
+int rbtree_sharded_erase(rbtree_sharded *s, const key_t key) {
+  return rbtree_rw_erase(shard_of(s, key), key);
+}
+
+// 가장 작은 key: 앞쪽 shard부터 보며 처음으로 비어 있지 않은 shard의 최솟값
+// (shard 하나씩 락을 잡으므로 여러 shard에 걸친 동시 갱신과는 순서가 보장되지 않음)
+int rbtree_sharded_min(rbtree_sharded *s, key_t *out) {
+  for (size_t i = 0; i < s->nshards; i++) {
+    if (rbtree_rw_min(&s->shards[i], out)) return 1;
+  }
+  return 0;
+}
+
+int rbtree_sharded_max(rbtree_sharded *s, key_t *out) {
+  for (size_t i = s->nshards; i-- > 0;) {
+    if (rbtree_rw_max(&s->shards[i], out)) return 1;
+  }
+  return 0;
+}
+
+size_t rbtree_sharded_size(rbtree_sharded *s) {
+  size_t n = 0;
+  for (size_t i = 0; i < s->nshards; i++) n += rbtree_rw_size(&s->shards[i]);
+  return n;
+}
+
+// 모든 shard의 읽기 락을 잡은 채로 구간 순서대로 이어 붙임 (한 시점의 일관된 내용)
+size_t rbtree_sharded_to_array(rbtree_sharded *s, key_t *arr, const size_t n) {
+  for (size_t i = 0; i < s->nshards; i++) pthread_rwlock_rdlock(&s->shards[i].lock);
+  size_t copied = 0;
+  for (size_t i = 0; i < s->nshards && copied < n; i++) {
+    copied += (size_t)rbtree_to_array(s->shards[i].tree, arr + copied, n - copied);
+  }
+  for (size_t i = 0; i < s->nshards; i++) pthread_rwlock_unlock(&s->shards[i].lock);
+  return copied;
+}
@@ -0,0 +1,44 @@
+#ifndef _RBTREE_CONCURRENT_H_
+#define _RBTREE_CONCURRENT_H_
+
+#include "rbtree.h"
+
+#include <pthread.h>
+
+// 여러 스레드에서 함께 쓰는 트리 (node pointer는 락 밖으로 내보내지 않고 key만 주고받음)
+
+// 읽기/쓰기 락 하나로 보호하는 트리: 읽기가 대부분인 경우
+// 락끼리 같은 캐시 라인을 나눠 쓰지 않도록 64바이트 단위로 정렬
+typedef struct {
+  pthread_rwlock_t lock;
+  rbtree *tree;
+} __attribute__((aligned(64))) rbtree_rw;
+
+rbtree_rw *new_rbtree_rw(const rbtree_options *);
+void delete_rbtree_rw(rbtree_rw *);
+int rbtree_rw_insert(rbtree_rw *, const key_t);
+int rbtree_rw_find(rbtree_rw *, const key_t);
+int rbtree_rw_erase(rbtree_rw *, const key_t);
+int rbtree_rw_min(rbtree_rw *, key_t *);
+int rbtree_rw_max(rbtree_rw *, key_t *);
+size_t rbtree_rw_size(rbtree_rw *);
+size_t rbtree_rw_to_array(rbtree_rw *, key_t *, const size_t);
+
+// key 구간별로 나눈 트리 n개: shard마다 락이 따로 있어서 서로 다른 구간은 동시에 갱신됨
+typedef struct {
+  size_t nshards;
+  key_t *bounds;      // shard i는 [bounds[i - 1], bounds[i]) 구간 (양 끝 shard는 바깥쪽도 맡음)
+  rbtree_rw *shards;
+} rbtree_sharded;
+
+rbtree_sharded *new_rbtree_sharded(const size_t, const key_t, const key_t, const rbtree_options *);
+void delete_rbtree_sharded(rbtree_sharded *);
+int rbtree_sharded_insert(rbtree_sharded *, const key_t);
+int rbtree_sharded_find(rbtree_sharded *, const key_t);
+int rbtree_sharded_erase(rbtree_sharded *, const key_t);
+int rbtree_sharded_min(rbtree_sharded *, key_t *);
+int rbtree_sharded_max(rbtree_sharded *, key_t *);
+size_t rbtree_sharded_size(rbtree_sharded *);
+size_t rbtree_sharded_to_array(rbtree_sharded *, key_t *, const size_t);
+
+#endif  // _RBTREE_CONCURRENT_H_
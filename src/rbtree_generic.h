@@ -0,0 +1,401 @@
+#ifndef _RBTREE_GENERIC_H_
+#define _RBTREE_GENERIC_H_
+
+#include "rbtree.h"
+
+#include <stdlib.h>
+
+// 임의의 key 타입에 대해 특수화된 RB tree를 만들어 주는 매크로
+//
+//   static inline int i64_cmp(int64_t a, int64_t b) { return (a > b) - (a < b); }
+//   RBTREE_DEFINE(i64tree, int64_t, i64_cmp)
+//
+// 위처럼 쓰면 i64tree, i64tree_node 타입과 i64tree_new, i64tree_insert, i64tree_find ...
+// 함수들이 생성됨. cmp(a, b)는 qsort처럼 a < b면 음수, 같으면 0, a > b면 양수를 반환하며
+// 함수나 함수형 매크로 모두 가능함 (탐색/삽입/삭제 루프 안에 그대로 인라인됨)
+//
+// 비교 함수를 실행 중에 정하는 void* key 트리(rbtree_any)도 함께 제공함
+//
+// int API(rbtree.c)를 이 템플릿의 인스턴스로 만들지 않고 일부러 따로 둠:
+// rbtree.c의 노드는 빌드 옵션에 따라 색을 포인터 하위 비트에 넣거나(RBTREE_COMPACT) 링크를 32비트 인덱스로
+// 바꾸고(RBTREE_INDEX32), 트리마다 중복 개수, value, 경로 복사, 양 끝 캐시, 해시 색인 같은 모드를 가짐.
+// 이것들을 key 타입과 비교 함수만 바꾸는 템플릿에 옮기면 모든 인스턴스가 그 분기와 레이아웃을 떠안게 되므로,
+// 여기에는 CLRS 그대로의 삽입/삭제/회전과 slab 풀만 둠. 위 기능들에 대한 수정은 이 파일과 관계없지만,
+// 회전이나 fixup을 고칠 때는 두 곳을 함께 고쳐야 하며 test_generic_ops가 두 구현을 같은 연산열로 돌려 비교함
+
+// qsort와 같은 형태의 비교 함수 (rbtree_any에서 사용)
+typedef int (*rbtree_cmp_fn)(const void *, const void *);
+
+// 노드/트리 타입 (extra: 트리 구조체에 추가로 넣을 필드)
+#define RBTREE__TYPES(name, key_type, extra)                                   \
+  typedef struct name##_node {                                                 \
+    color_t color;                                                             \
+    key_type key;                                                              \
+    struct name##_node *parent, *left, *right;                                 \
+  } name##_node;                                                               \
+                                                                               \
+  typedef struct name##_slab {                                                 \
+    struct name##_slab *next;                                                  \
+    size_t n;                                                                  \
+    name##_node nodes[];                                                       \
+  } name##_slab;                                                               \
+                                                                               \
+  typedef struct name {                                                        \
+    name##_node *root;                                                         \
+    name##_node *nil;                                                          \
+    name##_node nil_node;                                                      \
+    name##_node *free_list;                                                    \
+    name##_slab *slabs;                                                        \
+    name##_node *next, *end;                                                   \
+    size_t slab_nodes;                                                         \
+    size_t count;                                                              \
+    extra                                                                      \
+  } name;
+
+// 트리 연산들. 비교는 모두 name##__cmp(t, a, b)를 거침
+#define RBTREE__FUNCS(name, key_type)                                          \
+  static inline name##_node *name##__alloc(name *t) {                          \
+    name##_node *p = t->free_list;                                             \
+    if (p != NULL) {                                                           \
+      t->free_list = p->parent;                                                \
+      return p;                                                                \
+    }                                                                          \
+    if (t->next == t->end) {                                                   \
+      size_t n = t->slab_nodes;                                                \
+      name##_slab *s = malloc(sizeof(name##_slab) + n * sizeof(name##_node));  \
+      if (s == NULL) return NULL;                                              \
+      s->next = t->slabs;                                                      \
+      s->n = n;                                                                \
+      t->slabs = s;                                                            \
+      t->next = s->nodes;                                                      \
+      t->end = s->nodes + n;                                                   \
+      if (n < 65536) t->slab_nodes = n * 2;                                    \
+    }                                                                          \
+    return t->next++;                                                          \
+  }                                                                            \
+                                                                               \
+  static inline name *name##__create(void) {                                   \
+    name *t = calloc(1, sizeof(name));                                         \
+    if (t == NULL) return NULL;                                                \
+    t->nil = &t->nil_node;                                                     \
+    t->nil->color = RBTREE_BLACK;                                              \
+    t->root = t->nil;                                                          \
+    t->slab_nodes = 64;                                                        \
+    return t;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline void name##_clear(name *t) {                                   \
+    while (t->slabs != NULL) {                                                 \
+      name##_slab *s = t->slabs;                                               \
+      t->slabs = s->next;                                                      \
+      free(s);                                                                 \
+    }                                                                          \
+    t->free_list = t->next = t->end = NULL;                                    \
+    t->slab_nodes = 64;                                                        \
+    t->root = t->nil;                                                          \
+    t->count = 0;                                                              \
+  }                                                                            \
+                                                                               \
+  static inline void name##_delete(name *t) {                                  \
+    name##_clear(t);                                                           \
+    free(t);                                                                   \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_size(const name *t) { return t->count; }         \
+                                                                               \
+  static inline void name##__rotate_left(name *t, name##_node *x) {            \
+    name##_node *y = x->right;                                                 \
+    x->right = y->left;                                                        \
+    if (y->left != t->nil) y->left->parent = x;                                \
+    y->parent = x->parent;                                                     \
+    if (x->parent == t->nil) t->root = y;                                      \
+    else if (x == x->parent->left) x->parent->left = y;                        \
+    else x->parent->right = y;                                                 \
+    y->left = x;                                                               \
+    x->parent = y;                                                             \
+  }                                                                            \
+                                                                               \
+  static inline void name##__rotate_right(name *t, name##_node *x) {           \
+    name##_node *y = x->left;                                                  \
+    x->left = y->right;                                                        \
+    if (y->right != t->nil) y->right->parent = x;                              \
+    y->parent = x->parent;                                                     \
+    if (x->parent == t->nil) t->root = y;                                      \
+    else if (x == x->parent->right) x->parent->right = y;                      \
+    else x->parent->left = y;                                                  \
+    y->right = x;                                                              \
+    x->parent = y;                                                             \
+  }                                                                            \
+                                                                               \
+  static inline void name##__insert_fixup(name *t, name##_node *z) {           \
+    while (z->parent->color == RBTREE_RED) {                                   \
+      name##_node *g = z->parent->parent;                                      \
+      if (z->parent == g->left) {                                              \
+        name##_node *u = g->right;                                             \
+        if (u->color == RBTREE_RED) {                                          \
+          z->parent->color = u->color = RBTREE_BLACK;                          \
+          g->color = RBTREE_RED;                                               \
+          z = g;                                                               \
+          continue;                                                            \
+        }                                                                      \
+        if (z == z->parent->right) {                                           \
+          z = z->parent;                                                       \
+          name##__rotate_left(t, z);                                           \
+        }                                                                      \
+        z->parent->color = RBTREE_BLACK;                                       \
+        g->color = RBTREE_RED;                                                 \
+        name##__rotate_right(t, g);                                            \
+      } else {                                                                 \
+        name##_node *u = g->left;                                              \
+        if (u->color == RBTREE_RED) {                                          \
+          z->parent->color = u->color = RBTREE_BLACK;                          \
+          g->color = RBTREE_RED;                                               \
+          z = g;                                                               \
+          continue;                                                            \
+        }                                                                      \
+        if (z == z->parent->left) {                                            \
+          z = z->parent;                                                       \
+          name##__rotate_right(t, z);                                          \
+        }                                                                      \
+        z->parent->color = RBTREE_BLACK;                                       \
+        g->color = RBTREE_RED;                                                 \
+        name##__rotate_left(t, g);                                             \
+      }                                                                        \
+    }                                                                          \
+    t->root->color = RBTREE_BLACK;                                             \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_insert(name *t, key_type key) {            \
+    name##_node *x = t->root, *y = t->nil;                                     \
+    while (x != t->nil) {                                                      \
+      y = x;                                                                   \
+      x = name##__cmp(t, key, x->key) < 0 ? x->left : x->right;                \
+    }                                                                          \
+    name##_node *z = name##__alloc(t);                                         \
+    if (z == NULL) return NULL;                                                \
+    z->key = key;                                                              \
+    z->parent = y;                                                             \
+    z->left = z->right = t->nil;                                               \
+    z->color = RBTREE_RED;                                                     \
+    if (y == t->nil) t->root = z;                                              \
+    else if (name##__cmp(t, key, y->key) < 0) y->left = z;                     \
+    else y->right = z;                                                         \
+    t->count++;                                                                \
+    name##__insert_fixup(t, z);                                                \
+    return z;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_find(const name *t, key_type key) {        \
+    name##_node *cur = t->root;                                                \
+    while (cur != t->nil) {                                                    \
+      int c = name##__cmp(t, key, cur->key);                                   \
+      if (c == 0) return cur;                                                  \
+      cur = c < 0 ? cur->left : cur->right;                                    \
+    }                                                                          \
+    return NULL;                                                               \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_lower_bound(const name *t, key_type key) { \
+    name##_node *cur = t->root, *res = NULL;                                   \
+    while (cur != t->nil) {                                                    \
+      if (name##__cmp(t, cur->key, key) < 0) cur = cur->right;                 \
+      else {                                                                   \
+        res = cur;                                                             \
+        cur = cur->left;                                                       \
+      }                                                                        \
+    }                                                                          \
+    return res;                                                                \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_upper_bound(const name *t, key_type key) { \
+    name##_node *cur = t->root, *res = NULL;                                   \
+    while (cur != t->nil) {                                                    \
+      if (name##__cmp(t, key, cur->key) < 0) {                                 \
+        res = cur;                                                             \
+        cur = cur->left;                                                       \
+      } else cur = cur->right;                                                 \
+    }                                                                          \
+    return res;                                                                \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_min(const name *t) {                       \
+    if (t->root == t->nil) return NULL;                                        \
+    name##_node *cur = t->root;                                                \
+    while (cur->left != t->nil) cur = cur->left;                               \
+    return cur;                                                                \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_max(const name *t) {                       \
+    if (t->root == t->nil) return NULL;                                        \
+    name##_node *cur = t->root;                                                \
+    while (cur->right != t->nil) cur = cur->right;                             \
+    return cur;                                                                \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_next(const name *t, name##_node *p) {      \
+    if (p->right != t->nil) {                                                  \
+      p = p->right;                                                            \
+      while (p->left != t->nil) p = p->left;                                   \
+      return p;                                                                \
+    }                                                                          \
+    name##_node *y = p->parent;                                                \
+    while (y != t->nil && p == y->right) {                                     \
+      p = y;                                                                   \
+      y = y->parent;                                                           \
+    }                                                                          \
+    return y == t->nil ? NULL : y;                                             \
+  }                                                                            \
+                                                                               \
+  static inline name##_node *name##_prev(const name *t, name##_node *p) {      \
+    if (p->left != t->nil) {                                                   \
+      p = p->left;                                                             \
+      while (p->right != t->nil) p = p->right;                                 \
+      return p;                                                                \
+    }                                                                          \
+    name##_node *y = p->parent;                                                \
+    while (y != t->nil && p == y->left) {                                      \
+      p = y;                                                                   \
+      y = y->parent;                                                           \
+    }                                                                          \
+    return y == t->nil ? NULL : y;                                             \
+  }                                                                            \
+                                                                               \
+  static inline void name##__transplant(name *t, name##_node *u,               \
+                                        name##_node *v) {                      \
+    if (u->parent == t->nil) t->root = v;                                      \
+    else if (u == u->parent->left) u->parent->left = v;                        \
+    else u->parent->right = v;                                                 \
+    v->parent = u->parent;                                                     \
+  }                                                                            \
+                                                                               \
+  static inline void name##__erase_fixup(name *t, name##_node *x) {            \
+    while (x != t->root && x->color == RBTREE_BLACK) {                         \
+      if (x == x->parent->left) {                                              \
+        name##_node *w = x->parent->right;                                     \
+        if (w->color == RBTREE_RED) {                                          \
+          w->color = RBTREE_BLACK;                                             \
+          x->parent->color = RBTREE_RED;                                       \
+          name##__rotate_left(t, x->parent);                                   \
+          w = x->parent->right;                                                \
+        }                                                                      \
+        if (w->left->color == RBTREE_BLACK &&                                  \
+            w->right->color == RBTREE_BLACK) {                                 \
+          w->color = RBTREE_RED;                                               \
+          x = x->parent;                                                       \
+          continue;                                                            \
+        }                                                                      \
+        if (w->right->color == RBTREE_BLACK) {                                 \
+          w->left->color = RBTREE_BLACK;                                       \
+          w->color = RBTREE_RED;                                               \
+          name##__rotate_right(t, w);                                          \
+          w = x->parent->right;                                                \
+        }                                                                      \
+        w->color = x->parent->color;                                           \
+        x->parent->color = RBTREE_BLACK;                                       \
+        w->right->color = RBTREE_BLACK;                                        \
+        name##__rotate_left(t, x->parent);                                     \
+        x = t->root;                                                           \
+      } else {                                                                 \
+        name##_node *w = x->parent->left;                                      \
+        if (w->color == RBTREE_RED) {                                          \
+          w->color = RBTREE_BLACK;                                             \
+          x->parent->color = RBTREE_RED;                                       \
+          name##__rotate_right(t, x->parent);                                  \
+          w = x->parent->left;                                                 \
+        }                                                                      \
+        if (w->right->color == RBTREE_BLACK &&                                 \
+            w->left->color == RBTREE_BLACK) {                                  \
+          w->color = RBTREE_RED;                                               \
+          x = x->parent;                                                       \
+          continue;                                                            \
+        }                                                                      \
+        if (w->left->color == RBTREE_BLACK) {                                  \
+          w->right->color = RBTREE_BLACK;                                      \
+          w->color = RBTREE_RED;                                               \
+          name##__rotate_left(t, w);                                           \
+          w = x->parent->left;                                                 \
+        }                                                                      \
+        w->color = x->parent->color;                                           \
+        x->parent->color = RBTREE_BLACK;                                       \
+        w->left->color = RBTREE_BLACK;                                         \
+        name##__rotate_right(t, x->parent);                                    \
+        x = t->root;                                                           \
+      }                                                                        \
+    }                                                                          \
+    x->color = RBTREE_BLACK;                                                   \
+  }                                                                            \
+                                                                               \
+  static inline void name##_erase(name *t, name##_node *z) {                   \
+    name##_node *y = z, *x;                                                    \
+    color_t y_color = y->color;                                                \
+    if (z->left == t->nil) {                                                   \
+      x = z->right;                                                            \
+      name##__transplant(t, z, z->right);                                      \
+    } else if (z->right == t->nil) {                                           \
+      x = z->left;                                                             \
+      name##__transplant(t, z, z->left);                                       \
+    } else {                                                                   \
+      y = z->right;                                                            \
+      while (y->left != t->nil) y = y->left;                                   \
+      y_color = y->color;                                                      \
+      x = y->right;                                                            \
+      if (y->parent == z) x->parent = y;                                       \
+      else {                                                                   \
+        name##__transplant(t, y, y->right);                                    \
+        y->right = z->right;                                                   \
+        y->right->parent = y;                                                  \
+      }                                                                        \
+      name##__transplant(t, z, y);                                             \
+      y->left = z->left;                                                       \
+      y->left->parent = y;                                                     \
+      y->color = z->color;                                                     \
+    }                                                                          \
+    if (y_color == RBTREE_BLACK) name##__erase_fixup(t, x);                    \
+    z->parent = t->free_list;                                                  \
+    t->free_list = z;                                                          \
+    t->count--;                                                                \
+  }                                                                            \
+                                                                               \
+  static inline int name##_erase_key(name *t, key_type key) {                  \
+    name##_node *p = name##_find(t, key);                                      \
+    if (p == NULL) return 0;                                                   \
+    name##_erase(t, p);                                                        \
+    return 1;                                                                  \
+  }                                                                            \
+                                                                               \
+  static inline size_t name##_to_array(const name *t, key_type *arr,           \
+                                       size_t n) {                             \
+    size_t i = 0;                                                              \
+    for (name##_node *p = name##_min(t); p != NULL && i < n;                   \
+         p = name##_next(t, p))                                                \
+      arr[i++] = p->key;                                                       \
+    return i;                                                                  \
+  }
+
+// 비교 함수가 컴파일 시점에 정해지는 트리
+#define RBTREE_DEFINE(name, key_type, cmp)                                     \
+  RBTREE__TYPES(name, key_type, )                                              \
+  static inline int name##__cmp(const name *t, key_type a, key_type b) {       \
+    (void)t;                                                                   \
+    return cmp(a, b);                                                          \
+  }                                                                            \
+  RBTREE__FUNCS(name, key_type)                                                \
+  static inline name *name##_new(void) { return name##__create(); }
+
+// void* key와 실행 중에 넘겨받는 비교 함수를 쓰는 트리 (key가 가리키는 메모리는 호출자가 관리)
+// 비교가 함수 포인터 호출이 되므로 성능이 중요한 경로에서는 RBTREE_DEFINE을 쓸 것
+RBTREE__TYPES(rbtree_any, const void *, rbtree_cmp_fn cmp;)
+
+static inline int rbtree_any__cmp(const rbtree_any *t, const void *a, const void *b) {
+  return t->cmp(a, b);
+}
+
+RBTREE__FUNCS(rbtree_any, const void *)
+
+static inline rbtree_any *rbtree_any_new(rbtree_cmp_fn cmp) {
+  rbtree_any *t = rbtree_any__create();
+  if (t != NULL) t->cmp = cmp;
+  return t;
+}
+
+#endif  // _RBTREE_GENERIC_H_
@@ -1,8 +1,13 @@
 #include <assert.h>
+#include <pthread.h>
 #include "../src/rbtree.h"
+#include "../src/rbtree_concurrent.h"
+#include "../src/rbtree_generic.h"
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 // new_rbtree should return rbtree struct with null root node
 void test_init(void) {
@@ -24,15 +29,15 @@ void test_insert_single(const key_t key) {
   assert(p != NULL);
   assert(t->root == p);
   assert(p->key == key);
-  // assert(p->color == RBTREE_BLACK);  // color of root node should be black
+  // assert(rbtree_color(p) == RBTREE_BLACK);  // color of root node should be black
 #ifdef SENTINEL
-  assert(p->left == t->nil);
-  assert(p->right == t->nil);
-  assert(p->parent == t->nil);
+  assert(rbtree_left(t, p) == t->nil);
+  assert(rbtree_right(t, p) == t->nil);
+  assert(rbtree_parent(t, p) == t->nil);
 #else
-  assert(p->left == NULL);
-  assert(p->right == NULL);
-  assert(p->parent == NULL);
+  assert(rbtree_left(t, p) == NULL);
+  assert(rbtree_right(t, p) == NULL);
+  assert(rbtree_parent(t, p) == NULL);
 #endif
   delete_rbtree(t);
 }
@@ -180,7 +185,7 @@ void test_multi_instance() {
 // The values of right subtree should be greater than or equal to the current
 // node
 
-static bool search_traverse(const node_t *p, key_t *min, key_t *max,
+static bool search_traverse(const rbtree *t, const node_t *p, key_t *min, key_t *max,
                             node_t *nil) {
   if (p == nil) {
     return true;
@@ -191,11 +196,11 @@ static bool search_traverse(const node_t *p, key_t *min, key_t *max,
   key_t l_min, l_max, r_min, r_max;
   l_min = l_max = r_min = r_max = p->key;
 
-  const bool lr = search_traverse(p->left, &l_min, &l_max, nil);
+  const bool lr = search_traverse(t, rbtree_left(t, p), &l_min, &l_max, nil);
   if (!lr || l_max > p->key) {
     return false;
   }
-  const bool rr = search_traverse(p->right, &r_min, &r_max, nil);
+  const bool rr = search_traverse(t, rbtree_right(t, p), &r_min, &r_max, nil);
   if (!rr || r_min < p->key) {
     return false;
   }
@@ -214,7 +219,7 @@ void test_search_constraint(const rbtree *t) {
 #else
   node_t *nil = NULL;
 #endif
-  assert(search_traverse(p, &min, &max, nil));
+  assert(search_traverse(t, p, &min, &max, nil));
 }
 
 // Color constraint
@@ -232,7 +237,7 @@ static void init_color_traverse(void) {
   max_black_depth = 0;
 }
 
-static bool color_traverse(const node_t *p, const color_t parent_color,
+static bool color_traverse(const rbtree *t, const node_t *p, const color_t parent_color,
                            const int black_depth, node_t *nil) {
   if (p == nil) {
     if (!touch_nil) {
@@ -243,12 +248,12 @@ static bool color_traverse(const node_t *p, const color_t parent_color,
     }
     return true;
   }
-  if (parent_color == RBTREE_RED && p->color == RBTREE_RED) {
+  if (parent_color == RBTREE_RED && rbtree_color(p) == RBTREE_RED) {
     return false;
   }
-  int next_depth = ((p->color == RBTREE_BLACK) ? 1 : 0) + black_depth;
-  return color_traverse(p->left, p->color, next_depth, nil) &&
-         color_traverse(p->right, p->color, next_depth, nil);
+  int next_depth = ((rbtree_color(p) == RBTREE_BLACK) ? 1 : 0) + black_depth;
+  return color_traverse(t, rbtree_left(t, p), rbtree_color(p), next_depth, nil) &&
+         color_traverse(t, rbtree_right(t, p), rbtree_color(p), next_depth, nil);
 }
 
 void test_color_constraint(const rbtree *t) {
@@ -259,11 +264,11 @@ void test_color_constraint(const rbtree *t) {
   node_t *nil = NULL;
 #endif
   node_t *p = t->root;
-  assert(p == nil || p->color == RBTREE_BLACK);
+  assert(p == nil || rbtree_color(p) == RBTREE_BLACK);
 
   init_color_traverse();
   // print_rbtree(t, t->root, 0, ' ');
-  assert(color_traverse(p, RBTREE_BLACK, 0, nil));
+  assert(color_traverse(t, p, RBTREE_BLACK, 0, nil));
 }
 
 // rbtree should keep search tree and color constraints
@@ -368,6 +373,1893 @@ void test_find_erase_rand(const size_t n, const unsigned int seed) {
   delete_rbtree(t);
 }
 
+// erased nodes should be recycled by later inserts
+void test_node_reuse(void) {
+  rbtree *t = new_rbtree();
+  rbtree_insert(t, 1);
+  rbtree_insert(t, 2);
+  node_t *p = rbtree_find(t, 2);
+  assert(p != NULL);
+  rbtree_erase(t, p);
+
+  rbtree_insert(t, 3);
+  node_t *q = rbtree_find(t, 3);
+  assert(q == p);
+  assert(q->key == 3);
+
+  delete_rbtree(t);
+}
+
+// a preallocated tree should behave like a normal one, also past its hint
+void test_capacity_hint(const size_t hint, const size_t n) {
+  rbtree *t = new_rbtree_with_capacity(hint);
+  assert(t != NULL);
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (int)n;
+  }
+  insert_arr(t, arr, n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(n, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n) == n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// clear should empty the tree but keep it usable
+void test_clear(const size_t n) {
+  rbtree *t = new_rbtree();
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, i);
+  }
+  rbtree_clear(t);
+#ifdef SENTINEL
+  assert(t->root == t->nil);
+#else
+  assert(t->root == NULL);
+#endif
+  assert(rbtree_find(t, 0) == NULL);
+  assert(rbtree_min(t) == NULL);
+
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, (int)n - i);
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+  assert(rbtree_min(t)->key == 1);
+  assert(rbtree_max(t)->key == n);
+
+  // nodes released by delete_rbtree_sub should be reused
+  delete_rbtree_sub(t, t->root);
+  t->root = t->nil;
+  for (int i = 0; i < n; i++) {
+    rbtree_insert(t, i);
+  }
+  test_color_constraint(t);
+  assert(rbtree_max(t)->key == n - 1);
+
+  delete_rbtree(t);
+}
+
+// next/prev should walk the keys in sorted order
+void test_next_prev(const size_t n) {
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % 100;
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  size_t i = 0;
+  for (node_t *p = rbtree_min(t); p != NULL; p = rbtree_next(t, p)) {
+    assert(p->key == arr[i++]);
+  }
+  assert(i == n);
+  for (node_t *p = rbtree_max(t); p != NULL; p = rbtree_prev(t, p)) {
+    assert(p->key == arr[--i]);
+  }
+  assert(i == 0);
+
+  free(arr);
+  delete_rbtree(t);
+}
+
+typedef struct {
+  key_t *keys;
+  size_t n, cap;
+} collect_ctx;
+
+static int collect_key(node_t *p, void *ctx) {
+  collect_ctx *c = (collect_ctx *)ctx;
+  c->keys[c->n++] = p->key;
+  return c->n == c->cap;
+}
+
+// range scans should visit exactly the keys in [lo, hi) and stop when asked
+void test_foreach_range(void) {
+  const key_t entries[] = {10, 5, 8, 34, 67, 23, 156, 24, 2, 12, 24, 36, 990, 25};
+  const size_t n = sizeof(entries) / sizeof(entries[0]);
+  rbtree *t = new_rbtree();
+  insert_arr(t, entries, n);
+
+  key_t buf[16];
+  collect_ctx c = {buf, 0, 16};
+  assert(rbtree_foreach_range(t, 10, 36, collect_key, &c) == 7);
+  const key_t expected[] = {10, 12, 23, 24, 24, 25, 34};
+  assert(c.n == 7);
+  for (int i = 0; i < c.n; i++) {
+    assert(buf[i] == expected[i]);
+  }
+
+  c.n = 0;
+  c.cap = 3;
+  assert(rbtree_foreach_range(t, 0, 1000, collect_key, &c) == 3);
+  assert(buf[0] == 2 && buf[1] == 5 && buf[2] == 8);
+
+  c.n = 0;
+  c.cap = 16;
+  assert(rbtree_foreach_range(t, 40, 60, collect_key, &c) == 0);
+  assert(rbtree_foreach_range(t, 60, 40, collect_key, &c) == 0);
+
+  delete_rbtree(t);
+}
+
+// bounds and counts should agree with a sorted copy of the keys
+void test_bounds(const size_t n, const int range) {
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+  }
+  insert_arr(t, arr, n);
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  for (key_t key = -1; key <= range; key++) {
+    size_t lo = 0, hi = 0;
+    while (lo < n && arr[lo] < key) lo++;
+    hi = lo;
+    while (hi < n && arr[hi] == key) hi++;
+
+    node_t *l = rbtree_lower_bound(t, key);
+    node_t *u = rbtree_upper_bound(t, key);
+    if (lo == n) {
+      assert(l == NULL);
+    } else {
+      assert(l != NULL && l->key == arr[lo]);
+      assert(rbtree_prev(t, l) == NULL || rbtree_prev(t, l)->key < key);
+    }
+    if (hi == n) {
+      assert(u == NULL);
+    } else {
+      assert(u != NULL && u->key == arr[hi]);
+      assert(hi == 0 || rbtree_prev(t, u)->key <= key);
+    }
+
+    node_t *first, *last;
+    rbtree_equal_range(t, key, &first, &last);
+    assert(first == l && last == u);
+    assert(rbtree_count(t, key) == hi - lo);
+  }
+
+  free(arr);
+  delete_rbtree(t);
+}
+
+// a tree built from a sorted array should be a valid rbtree holding the same keys
+void test_build_from_sorted(const size_t n, const int range) {
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+  }
+  qsort((void *)arr, n, sizeof(key_t), comp);
+
+  rbtree *t = rbtree_build_from_sorted(arr, n);
+  assert(t != NULL);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n) == n);
+  for (int i = 0; i < n; i++) {
+    assert(arr[i] == res[i]);
+  }
+
+  // the result should stay a regular tree for later updates
+  rbtree_insert(t, range / 2);
+  if (n > 0) {
+    rbtree_erase(t, rbtree_min(t));
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+void test_build_from_sorted_suite(void) {
+  for (size_t n = 0; n < 70; n++) {
+    test_build_from_sorted(n, 1000);
+  }
+  test_build_from_sorted(10000, 100);
+
+  const key_t unsorted[] = {1, 3, 2};
+  assert(rbtree_build_from_sorted(unsorted, 3) == NULL);
+}
+
+// batched updates should give the same multiset as one call per key
+void test_batch(const size_t n, const int range, const int sorted) {
+  rbtree *t = new_rbtree();
+  rbtree *ref = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int round = 0; round < 4; round++) {
+    for (int i = 0; i < n; i++) {
+      arr[i] = rand() % range;
+    }
+    if (sorted) {
+      qsort((void *)arr, n, sizeof(key_t), comp);
+    }
+    assert(rbtree_insert_batch(t, arr, n) == n);
+    insert_arr(ref, arr, n);
+    test_color_constraint(t);
+    test_search_constraint(t);
+  }
+
+  // erase a batch that contains duplicates and keys not in the tree
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % (range + range / 4);
+  }
+  size_t expected = 0;
+  for (int i = 0; i < n; i++) {
+    node_t *p = rbtree_find(ref, arr[i]);
+    if (p != NULL) {
+      rbtree_erase(ref, p);
+      expected++;
+    }
+  }
+  assert(rbtree_erase_keys_batch(t, arr, n) == expected);
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  key_t *res = calloc(4 * n, sizeof(key_t));
+  key_t *res_ref = calloc(4 * n, sizeof(key_t));
+  const int m = rbtree_to_array(ref, res_ref, 4 * n);
+  assert(rbtree_to_array(t, res, 4 * n) == m);
+  for (int i = 0; i < m; i++) {
+    assert(res[i] == res_ref[i]);
+  }
+
+  free(res_ref);
+  free(res);
+  free(arr);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+#ifdef RBTREE_ORDER_STATISTICS
+// every subtree size should match the number of nodes below it
+static size_t size_traverse(const rbtree *t, const node_t *p, node_t *nil) {
+  if (p == nil) {
+    return 0;
+  }
+  const size_t size = size_traverse(t, rbtree_left(t, p), nil) + size_traverse(t, rbtree_right(t, p), nil) +
+                      rbtree_node_count(t, p);
+  assert(p->size == size);
+  return size;
+}
+#endif
+
+// size, select and rank should follow inserts and erases
+void test_order_statistics(const size_t n, const int range) {
+  rbtree *t = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+  }
+  insert_arr(t, arr, n);
+  for (int i = 0; i < n / 3; i++) {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+  }
+  rbtree_insert_batch(t, arr, n / 2);
+  const size_t m = n - n / 3 + n / 2;
+  assert(rbtree_size(t) == m);
+
+  key_t *res = calloc(m, sizeof(key_t));
+  assert(rbtree_to_array(t, res, m) == m);
+#ifdef RBTREE_ORDER_STATISTICS
+  size_traverse(t, t->root, t->nil);
+  for (size_t i = 0; i < m; i++) {
+    node_t *p = rbtree_select(t, i);
+    assert(p != NULL && p->key == res[i]);
+    assert(rbtree_rank(t, p) == i);
+  }
+  assert(rbtree_select(t, m) == NULL);
+
+  rbtree *b = rbtree_build_from_sorted(res, m);
+  size_traverse(b, b->root, b->nil);
+  assert(rbtree_size(b) == m);
+  assert(rbtree_select(b, m / 2)->key == res[m / 2]);
+  delete_rbtree(b);
+#endif
+
+  rbtree_clear(t);
+  assert(rbtree_size(t) == 0);
+
+  free(res);
+  free(arr);
+  delete_rbtree(t);
+}
+
+// a collapsing tree should hold one node per distinct key and
+// behave like a plain multiset otherwise
+void test_collapse_duplicates(const size_t n, const int range) {
+  rbtree_options opts = {0};
+  opts.collapse_duplicates = 1;
+  rbtree *t = new_rbtree_opts(&opts);
+  rbtree *ref = new_rbtree();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+  }
+  insert_arr(t, arr, n);
+  insert_arr(ref, arr, n);
+  rbtree_insert_batch(t, arr, n / 2);
+  insert_arr(ref, arr, n / 2);
+
+  // one node per distinct key
+  size_t nodes = 0;
+  for (node_t *p = rbtree_min(t); p != NULL; p = rbtree_next(t, p)) {
+    assert(rbtree_node_count(t, p) == rbtree_count(ref, p->key));
+    nodes++;
+  }
+  assert(nodes <= range);
+  assert(rbtree_size(t) == rbtree_size(ref));
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  // erase one copy at a time, through both entry points
+  for (int i = 0; i < n / 2; i++) {
+    assert(rbtree_erase_key(t, arr[i]) == 1);
+    rbtree_erase(ref, rbtree_find(ref, arr[i]));
+  }
+  assert(rbtree_erase_key(t, range + 1) == 0);
+  for (int i = n / 2; i < n / 2 + n / 4; i++) {
+    rbtree_erase(t, rbtree_find(t, arr[i]));
+    rbtree_erase(ref, rbtree_find(ref, arr[i]));
+  }
+  assert(rbtree_erase_keys_batch(t, arr + n / 4, n / 4) ==
+         rbtree_erase_keys_batch(ref, arr + n / 4, n / 4));
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  const size_t m = rbtree_size(ref);
+  assert(rbtree_size(t) == m);
+  key_t *res = calloc(m, sizeof(key_t));
+  key_t *res_ref = calloc(m, sizeof(key_t));
+  assert(rbtree_to_array(t, res, m) == m);
+  assert(rbtree_to_array(ref, res_ref, m) == m);
+  for (int i = 0; i < m; i++) {
+    assert(res[i] == res_ref[i]);
+  }
+  for (key_t key = 0; key < range; key++) {
+    assert(rbtree_count(t, key) == rbtree_count(ref, key));
+  }
+#ifdef RBTREE_ORDER_STATISTICS
+  size_traverse(t, t->root, t->nil);
+  for (size_t i = 0; i < m; i++) {
+    node_t *p = rbtree_select(t, i);
+    assert(p->key == res[i]);
+    assert(rbtree_rank(t, p) <= i && i < rbtree_rank(t, p) + rbtree_node_count(t, p));
+  }
+#endif
+
+  free(res_ref);
+  free(res);
+  free(arr);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+typedef struct {
+  int64_t sum;
+  key_t key;
+  int hits;
+} map_value;
+
+// map trees keep one value per key inline in the node
+void test_map(const size_t n, const int range, const size_t value_size) {
+  rbtree_options opts = {0};
+  opts.value_size = value_size;
+  rbtree *t = new_rbtree_opts(&opts);
+  int64_t *sums = calloc(range, sizeof(int64_t));
+  int *hits = calloc(range, sizeof(int));
+  map_value *v = calloc(1, value_size);
+
+  for (int i = 0; i < n; i++) {
+    key_t key = rand() % range;
+    int inserted = -1;
+    map_value *cur = rbtree_map_get_or_insert(t, key, &inserted);
+    assert(cur != NULL);
+    assert(inserted == (hits[key] == 0));
+    if (inserted) {
+      assert(cur->sum == 0 && cur->hits == 0);
+      cur->key = key;
+    }
+    cur->sum += i;
+    cur->hits++;
+    sums[key] += i;
+    hits[key]++;
+  }
+  // put overwrites in place and never duplicates a key
+  for (key_t key = 0; key < range; key += 3) {
+    v->sum = -key;
+    v->key = key;
+    v->hits = 1;
+    map_value *cur = rbtree_map_put(t, key, v);
+    assert(cur->sum == -key);
+    sums[key] = -key;
+    hits[key] = 1;
+  }
+  test_color_constraint(t);
+  test_search_constraint(t);
+
+  size_t distinct = 0;
+  for (key_t key = 0; key < range; key++) {
+    map_value *cur = rbtree_map_get(t, key);
+    assert((cur != NULL) == (hits[key] > 0));
+    if (cur == NULL) continue;
+    assert(cur->key == key && cur->sum == sums[key] && cur->hits == hits[key]);
+    distinct++;
+  }
+  assert(rbtree_size(t) == distinct);
+  assert(rbtree_map_get(t, range) == NULL);
+
+  // key and value share a cache line whenever the node fits in one
+  for (node_t *p = rbtree_min(t); p != NULL; p = rbtree_next(t, p)) {
+    char *end = (char *)rbtree_value(t, p) + value_size - 1;
+    assert((char *)rbtree_value(t, p) > (char *)&p->key);
+    if (t->pool.stride <= 64) {
+      assert((uintptr_t)p / 64 == (uintptr_t)end / 64);
+    }
+  }
+
+  // values move with their keys when erase relinks nodes
+  for (key_t key = 0; key < range; key += 2) {
+    if (hits[key] > 0) {
+      assert(rbtree_erase_key(t, key) == 1);
+      hits[key] = 0;
+    }
+  }
+  for (key_t key = 0; key < range; key++) {
+    map_value *cur = rbtree_map_get(t, key);
+    assert((cur != NULL) == (hits[key] > 0));
+    if (cur != NULL) assert(cur->key == key && cur->sum == sums[key]);
+  }
+  test_color_constraint(t);
+
+  free(v);
+  free(hits);
+  free(sums);
+  delete_rbtree(t);
+}
+
+// checks contents, RB rules and parent links of a tree whose nodes were moved in from others
+static void check_moved(const rbtree *t, const key_t *expect, const size_t n) {
+  assert(rbtree_size(t) == n);
+  test_color_constraint(t);
+  test_search_constraint(t);
+  size_t i = 0;
+  for (node_t *p = rbtree_min(t); p != NULL; p = rbtree_next(t, p)) {
+    for (size_t c = rbtree_node_count(t, p); c > 0; c--) {
+      assert(i < n && p->key == expect[i]);
+      i++;
+    }
+  }
+  assert(i == n);
+  for (node_t *p = rbtree_max(t); p != NULL; p = rbtree_prev(t, p)) {
+    i -= rbtree_node_count(t, p);
+    assert(p->key == expect[i]);
+  }
+  assert(i == 0);
+#ifdef RBTREE_ORDER_STATISTICS
+  size_traverse(t, t->root, t->nil);
+#endif
+}
+
+static bool sorted_contains(const key_t *arr, const size_t n, const key_t key) {
+  return bsearch(&key, arr, n, sizeof(key_t), comp) != NULL;
+}
+
+// reference result of a set operation on sorted arrays (op 0: union, 1: intersection, 2: difference)
+static size_t expect_set_op(const int op, const int unique, const key_t *a, const size_t na,
+                            const key_t *b, const size_t nb, key_t *out) {
+  size_t m = 0;
+  if (op == 0) {
+    for (size_t i = 0; i < na; i++) out[m++] = a[i];
+    for (size_t i = 0; i < nb; i++) {
+      if (!unique || !sorted_contains(a, na, b[i])) out[m++] = b[i];
+    }
+    qsort(out, m, sizeof(key_t), comp);
+    return m;
+  }
+  for (size_t i = 0; i < na; i++) {
+    if (sorted_contains(b, nb, a[i]) == (op == 1)) out[m++] = a[i];
+  }
+  return m;
+}
+
+// fills a tree; map trees get value 2 * key + tag so the surviving side can be told apart
+static void fill_set_tree(rbtree *t, const key_t *arr, const size_t n, const int64_t tag) {
+  for (size_t i = 0; i < n; i++) {
+    if (t->value_size > 0) {
+      const int64_t v = 2 * (int64_t)arr[i] + tag;
+      rbtree_map_put(t, arr[i], &v);
+    } else {
+      rbtree_insert(t, arr[i]);
+    }
+  }
+}
+
+// removes adjacent duplicates from a sorted array
+static size_t unique_sorted(key_t *arr, const size_t n) {
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (m == 0 || arr[m - 1] != arr[i]) arr[m++] = arr[i];
+  }
+  return m;
+}
+
+// union, intersection and difference move nodes into the first tree
+// (mode 0: multiset, 1: collapsed duplicates, 2: map)
+void test_set_ops(const size_t n, const int range, const int mode) {
+  rbtree_options opts = {0};
+  opts.collapse_duplicates = mode == 1;
+  opts.value_size = mode == 2 ? sizeof(int64_t) : 0;
+  key_t *a = calloc(n, sizeof(key_t)), *b = calloc(n, sizeof(key_t));
+  key_t *expect = calloc(3 * n, sizeof(key_t)), *again = calloc(3 * n, sizeof(key_t));
+
+  for (int big_first = 0; big_first < 2; big_first++) {
+    // the smaller side is the one that moves, so try both orders
+    size_t na = big_first ? n : n / 4, nb = big_first ? n / 4 : n;
+    for (size_t i = 0; i < na; i++) a[i] = rand() % range;
+    for (size_t i = 0; i < nb; i++) b[i] = rand() % range;
+    qsort(a, na, sizeof(key_t), comp);
+    qsort(b, nb, sizeof(key_t), comp);
+    if (mode == 2) {
+      na = unique_sorted(a, na);
+      nb = unique_sorted(b, nb);
+    }
+
+    for (int op = 0; op < 3; op++) {
+      rbtree *t1 = new_rbtree_opts(&opts), *t2 = new_rbtree_opts(&opts);
+      fill_set_tree(t1, a, na, 0);
+      fill_set_tree(t2, b, nb, 1);
+      const size_t m = expect_set_op(op, mode == 2, a, na, b, nb, expect);
+      int (*fn[])(rbtree *, rbtree *) = {rbtree_union, rbtree_intersection, rbtree_difference};
+      assert(fn[op](t1, t1) == -1);
+      assert(fn[op](t1, t2) == 0);
+      check_moved(t1, expect, m);
+      assert(rbtree_size(t2) == 0 && rbtree_min(t2) == NULL);
+      if (mode == 2) {
+        for (size_t i = 0; i < m; i++) {
+          const int64_t *v = rbtree_map_get(t1, expect[i]);
+          assert(*v == 2 * (int64_t)expect[i] + !sorted_contains(a, na, expect[i]));
+        }
+      }
+
+      // both trees keep working, and nodes can move between them again
+      fill_set_tree(t2, a, na, 0);
+      const size_t m2 = expect_set_op(0, mode == 2, expect, m, a, na, again);
+      assert(rbtree_union(t1, t2) == 0);
+      check_moved(t1, again, m2);
+      rbtree_insert(t2, range);
+      assert(rbtree_erase_key(t1, again[0]) == 1);
+      check_moved(t1, again + 1, m2 - 1);
+      delete_rbtree(t1);
+      assert(rbtree_size(t2) == 1 && rbtree_find(t2, range) != NULL);
+      delete_rbtree(t2);
+    }
+  }
+
+  // trees with different node layouts cannot exchange nodes
+  rbtree_options other = opts;
+  other.collapse_duplicates = !opts.collapse_duplicates;
+  rbtree *t1 = new_rbtree_opts(&opts), *t2 = new_rbtree_opts(&other);
+  assert(rbtree_union(t1, t2) == -1 && rbtree_concat(t1, t2) == -1);
+  delete_rbtree(t2);
+  delete_rbtree(t1);
+
+  free(again);
+  free(expect);
+  free(b);
+  free(a);
+}
+
+// split, concat and join on a multiset, across and within node-sharing families
+void test_split_join(const size_t n, const int range) {
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+  }
+  rbtree *t = new_rbtree();
+  insert_arr(t, arr, n);
+  qsort(arr, n, sizeof(key_t), comp);
+
+  const key_t pivots[] = {-1, arr[0], arr[n / 3], arr[n / 2] + 1, range};
+  for (size_t j = 0; j < sizeof(pivots) / sizeof(pivots[0]); j++) {
+    const key_t key = pivots[j];
+    size_t i = 0;
+    while (i < n && arr[i] < key) i++;
+
+    rbtree *lo, *hi;
+    assert(rbtree_split(t, key, &lo, &hi) == 0);
+    assert(rbtree_size(t) == 0);
+    check_moved(lo, arr, i);
+    check_moved(hi, arr + i, n - i);
+    delete_rbtree(t);   // the pieces outlive the tree they came from
+
+    if (i > 0 && i < n) {
+      assert(rbtree_concat(hi, lo) == -1);
+      assert(rbtree_join(lo, arr[n - 1] + 1, hi) == -1);
+    }
+    assert(rbtree_concat(lo, hi) == 0);
+    check_moved(lo, arr, n);
+    assert(rbtree_size(hi) == 0);
+    delete_rbtree(hi);
+    t = lo;
+  }
+
+  // join puts the key between the two halves
+  rbtree *lo, *hi;
+  const key_t key = arr[n / 2];
+  assert(rbtree_split(t, key, &lo, &hi) == 0);
+  assert(rbtree_join(lo, key, hi) == 0);
+  key_t *with_key = calloc(n + 1, sizeof(key_t));
+  size_t i = 0;
+  while (i < n && arr[i] < key) i++;
+  memcpy(with_key, arr, i * sizeof(key_t));
+  with_key[i] = key;
+  memcpy(with_key + i + 1, arr + i, (n - i) * sizeof(key_t));
+  check_moved(lo, with_key, n + 1);
+  delete_rbtree(hi);
+  delete_rbtree(t);
+
+  // pieces of two different splits: the nodes are shared with other trees, so they get copied
+  rbtree *u = new_rbtree();
+  insert_arr(u, arr, n);
+  rbtree *l1, *h1, *l2, *h2;
+  assert(rbtree_split(lo, key, &l1, &h1) == 0);
+  assert(rbtree_split(u, key, &l2, &h2) == 0);
+  delete_rbtree(u);
+  assert(rbtree_union(l1, l2) == 0);
+  assert(rbtree_union(h1, h2) == 0);
+  delete_rbtree(l2);
+  delete_rbtree(h2);
+  assert(rbtree_concat(l1, h1) == 0);
+  key_t *twice = calloc(2 * n + 1, sizeof(key_t));
+  const size_t m = expect_set_op(0, 0, with_key, n + 1, arr, n, twice);
+  check_moved(l1, twice, m);
+  delete_rbtree(lo);
+  delete_rbtree(h1);
+  rbtree_clear(l1);
+  insert_arr(l1, arr, n);
+  check_moved(l1, arr, n);
+  delete_rbtree(l1);
+
+  free(twice);
+  free(with_key);
+  free(arr);
+}
+
+// parallel build, export and union give the same trees as the sequential paths
+// (a small cutoff makes even short inputs split into many tasks)
+void test_parallel(const int threads, const size_t n, const int range) {
+  rbtree_workers *w = new_rbtree_workers(threads, 64);
+  assert(w != NULL);
+  key_t *a = calloc(n + 1, sizeof(key_t)), *b = calloc(n + 1, sizeof(key_t));
+  key_t *expect = calloc(2 * n + 1, sizeof(key_t)), *res = calloc(2 * n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) a[i] = rand() % range;
+  for (size_t i = 0; i < n; i++) b[i] = rand() % range;
+  qsort(a, n, sizeof(key_t), comp);
+  qsort(b, n, sizeof(key_t), comp);
+
+  rbtree *t = rbtree_build_from_sorted_par(w, a, n);
+  check_moved(t, a, n);
+  assert(rbtree_to_array_par(w, t, res, n) == n);
+  assert(memcmp(res, a, n * sizeof(key_t)) == 0);
+  // a short buffer only gets the smallest keys
+  memset(res, 0, n * sizeof(key_t));
+  assert(rbtree_to_array_par(w, t, res, n / 3) == n / 3);
+  assert(memcmp(res, a, n / 3 * sizeof(key_t)) == 0 && (n / 3 == n || res[n / 3] == 0));
+  rbtree_insert(t, range / 2);
+  assert(rbtree_erase_key(t, a[0]) == 1);
+  test_color_constraint(t);
+  delete_rbtree(t);
+
+  if (n > 1) {
+    const key_t saved = a[n / 2];
+    a[n / 2] = a[n - 1] + 1;
+    assert(rbtree_build_from_sorted_par(w, a, n) == NULL);
+    a[n / 2] = saved;
+  }
+
+  for (int collapse = 0; collapse < 2; collapse++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = collapse;
+    for (size_t nb = n / 8; nb <= n; nb += n - n / 8) {
+      rbtree *t1 = new_rbtree_opts(&opts), *t2 = new_rbtree_opts(&opts);
+      fill_set_tree(t1, a, n, 0);
+      fill_set_tree(t2, b, nb, 0);
+      const size_t m = expect_set_op(0, 0, a, n, b, nb, expect);
+      assert(rbtree_union_par(w, t1, t1) == -1);
+      assert(rbtree_union_par(w, t1, t2) == 0);
+      check_moved(t1, expect, m);
+      assert(rbtree_size(t2) == 0);
+      assert(rbtree_to_array_par(w, t1, res, m) == m);
+      assert(memcmp(res, expect, m * sizeof(key_t)) == 0);
+      // nodes dropped by the union are reused
+      for (size_t i = 0; i < nb; i++) rbtree_insert(t2, b[i]);
+      test_color_constraint(t2);
+      delete_rbtree(t2);
+      delete_rbtree(t1);
+    }
+  }
+
+  free(res);
+  free(expect);
+  free(b);
+  free(a);
+  delete_rbtree_workers(w);
+}
+
+// saved trees load back with the same contents, and damaged files are rejected
+// (mode 0: multiset, 1: collapsed duplicates, 2: map)
+void test_save_load(const size_t n, const int range, const int mode) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/test-rbtree-%d.bin", (int)getpid());
+  rbtree_options opts = {0};
+  opts.collapse_duplicates = mode == 1;
+  opts.value_size = mode == 2 ? sizeof(int64_t) : 0;
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) arr[i] = rand() % range - range / 2;
+  qsort(arr, n, sizeof(key_t), comp);
+  size_t m = mode == 2 ? unique_sorted(arr, n) : n;
+
+  rbtree *t = new_rbtree_opts(&opts);
+  fill_set_tree(t, arr, m, 0);
+  assert(rbtree_save(t, path) == 0);
+  rbtree *u = rbtree_load(path);
+  assert(u != NULL && u->collapse_duplicates == t->collapse_duplicates && u->value_size == t->value_size);
+  check_moved(u, arr, m);
+  for (size_t i = 0; mode == 2 && i < m; i++) {
+    assert(*(int64_t *)rbtree_map_get(u, arr[i]) == 2 * (int64_t)arr[i]);
+  }
+
+  // the read-only view answers lookups straight from the mapped file
+  rbtree_view *v = rbtree_view_open(path);
+  assert(v != NULL && v->count == m);
+  for (int k = -range / 2 - 1; k <= range / 2 + 1; k++) {
+    const size_t i = rbtree_view_lower_bound(v, k);
+    node_t *p = rbtree_lower_bound(u, k);
+    assert(i == v->nodes ? p == NULL : p != NULL && p->key == v->keys[i]);
+    assert((rbtree_view_find(v, k) >= 0) == (rbtree_find(u, k) != NULL));
+    if (v->counts != NULL && p != NULL) assert(v->counts[i] == rbtree_node_count(u, p));
+    if (mode == 2) {
+      const int64_t *val = rbtree_view_get(v, k);
+      assert(val == NULL ? rbtree_find(u, k) == NULL : *val == 2 * (int64_t)k);
+    }
+  }
+  rbtree_view_close(v);
+
+  // the loaded tree keeps working
+  if (m > 0) assert(rbtree_erase_key(u, arr[0]) == 1);
+  rbtree_insert(u, range);
+  test_color_constraint(u);
+  test_search_constraint(u);
+#ifdef RBTREE_ORDER_STATISTICS
+  size_traverse(u, u->root, u->nil);
+#endif
+  delete_rbtree(u);
+
+  // a flipped byte anywhere or a truncated file fails to load
+  FILE *f = fopen(path, "r+b");
+  fseek(f, 0, SEEK_END);
+  const long size = ftell(f);
+  for (long at = 0; at < size; at += size / 7 + 1) {
+    fseek(f, at, SEEK_SET);
+    const int c = fgetc(f);
+    fseek(f, at, SEEK_SET);
+    fputc(c ^ 0x10, f);
+    fflush(f);
+    assert(rbtree_load(path) == NULL);
+    fseek(f, at, SEEK_SET);
+    fputc(c, f);
+    fflush(f);
+  }
+  assert(ftruncate(fileno(f), size - 1) == 0);
+  fclose(f);
+  assert(rbtree_load(path) == NULL && rbtree_view_open(path) == NULL);
+
+  // an empty tree round-trips; missing files and unwritable paths fail
+  rbtree *e = new_rbtree_opts(&opts);
+  assert(rbtree_save(e, path) == 0);
+  delete_rbtree(e);
+  e = rbtree_load(path);
+  assert(e != NULL && rbtree_size(e) == 0 && rbtree_min(e) == NULL);
+  delete_rbtree(e);
+  unlink(path);
+  assert(rbtree_load(path) == NULL);
+  assert(rbtree_save(t, "/nonexistent-dir/tree.bin") == -1);
+
+  delete_rbtree(t);
+  free(arr);
+}
+
+// rbtree_min/max come from the cached end nodes; they must match the ends of the tree
+static void check_ends(const rbtree *t) {
+  node_t *lo = NULL, *hi = NULL;
+  if (t->root != t->nil) {
+    for (lo = t->root; rbtree_left(t, lo) != t->nil; lo = rbtree_left(t, lo)) {
+    }
+    for (hi = t->root; rbtree_right(t, hi) != t->nil; hi = rbtree_right(t, hi)) {
+    }
+  }
+  assert(rbtree_min(t) == lo && rbtree_max(t) == hi);
+}
+
+// the cached ends follow inserts, erases and bulk operations in every tree mode
+void test_min_max_cache(const size_t n, const int range) {
+  for (int mode = 0; mode < 4; mode++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = mode == 1;
+    opts.value_size = mode == 2 ? sizeof(int64_t) : 0;
+    opts.persistent = mode == 3;
+    rbtree *t = new_rbtree_opts(&opts);
+    check_ends(t);
+    for (size_t i = 0; i < n; i++) {
+      const key_t key = rand() % range;
+      if (rand() % 3 == 0) rbtree_erase_key(t, key);
+      else if (mode == 2) rbtree_map_put(t, key, &(int64_t){key});
+      else rbtree_insert(t, key);
+      check_ends(t);
+    }
+    // erasing from either end, directly or through the node
+    while (rbtree_size(t) > n / 4) {
+      node_t *p = rand() % 2 ? rbtree_min(t) : rbtree_max(t);
+      if (mode == 3) rbtree_erase_key(t, p->key);
+      else rbtree_erase(t, p);
+      check_ends(t);
+    }
+    if (mode == 3) {
+      rbtree *snap = rbtree_snapshot(t);
+      check_ends(snap);
+      rbtree_insert(t, -1);
+      rbtree_insert(t, range);
+      check_ends(t);
+      assert(rbtree_min(snap)->key >= 0 && rbtree_max(snap)->key < range);
+      rbtree_snapshot_release(snap);
+    } else {
+      rbtree *lo, *hi;
+      assert(rbtree_split(t, range / 2, &lo, &hi) == 0);
+      check_ends(t);
+      check_ends(lo);
+      check_ends(hi);
+      assert(rbtree_union(lo, hi) == 0);
+      check_ends(lo);
+      check_ends(hi);
+      rbtree_insert(hi, range);
+      assert(rbtree_concat(lo, hi) == 0);
+      check_ends(lo);
+      check_ends(hi);
+      delete_rbtree(hi);
+      delete_rbtree(lo);
+    }
+    rbtree_clear(t);
+    check_ends(t);
+    rbtree_insert(t, 7);
+    check_ends(t);
+    delete_rbtree(t);
+  }
+
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (size_t i = 0; i < n; i++) arr[i] = (key_t)i;
+  rbtree *t = rbtree_build_from_sorted(arr, n);
+  check_ends(t);
+  delete_rbtree(t);
+  free(arr);
+}
+
+// inserting next to a hint gives the same tree as a plain insert, in either direction and far from the hint
+void test_insert_hint(const size_t n, const int range) {
+  for (int collapse = 0; collapse < 2; collapse++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = collapse;
+    key_t *arr = calloc(n, sizeof(key_t));
+    rbtree *t = new_rbtree_opts(&opts);
+
+    // ascending appends with the last node as the hint, then descending prepends
+    node_t *hint = NULL;
+    size_t m = 0;
+    for (size_t i = 0; i < n / 2; i++) {
+      hint = rbtree_insert_hint(t, hint, (key_t)(i / 3));
+      arr[m++] = (key_t)(i / 3);
+      assert(hint != NULL && hint->key == (key_t)(i / 3));
+      check_ends(t);
+    }
+    hint = rbtree_min(t);
+    for (size_t i = 1; i <= n / 4; i++) {
+      hint = rbtree_insert_hint(t, hint, -(key_t)(i / 2));
+      arr[m++] = -(key_t)(i / 2);
+      assert(hint->key == -(key_t)(i / 2));
+      check_ends(t);
+    }
+    // random keys with random hints, and a NULL hint
+    for (size_t i = m; i < n; i++) {
+      const key_t key = rand() % range - range / 4;
+      node_t *h = i % 5 == 0 ? NULL : rbtree_find(t, arr[rand() % m]);
+      node_t *p = rbtree_insert_hint(t, h, key);
+      assert(p != NULL && p->key == key);
+      arr[m++] = key;
+    }
+    qsort(arr, m, sizeof(key_t), comp);
+    check_moved(t, arr, m);
+    check_ends(t);
+    if (collapse) {
+      // equal keys must land on the existing node, never on a second one
+      for (node_t *p = rbtree_min(t), *q; p != NULL && (q = rbtree_next(t, p)) != NULL; p = q) {
+        assert(p->key < q->key);
+      }
+    }
+    delete_rbtree(t);
+    free(arr);
+  }
+
+  // a hint deep in the tree, inserting the key of the ancestor where the climb stops
+  rbtree_options opts = {0};
+  opts.collapse_duplicates = 1;
+  rbtree *t = new_rbtree_opts(&opts);
+  for (key_t key = 10; key <= 150; key += 10) rbtree_insert(t, key);
+  for (key_t h = 10; h <= 150; h += 10) {
+    for (key_t key = 10; key < h; key += 10) {
+      const size_t before = rbtree_count(t, key);
+      node_t *p = rbtree_insert_hint(t, rbtree_lower_bound(t, h), key);
+      assert(p == rbtree_find(t, key) && rbtree_count(t, key) == before + 1);
+    }
+  }
+  size_t nodes = 0;
+  for (node_t *p = rbtree_min(t); p != NULL; p = rbtree_next(t, p)) nodes++;
+  assert(nodes == 15);
+  delete_rbtree(t);
+}
+
+// updates that only copy the path (a repeated key, or a count going down) must move the cached ends too
+void test_persistent_ends(void) {
+  for (int mode = 0; mode < 3; mode++) {
+    rbtree_options opts = {0};
+    opts.persistent = 1;
+    opts.collapse_duplicates = mode != 2;
+    opts.value_size = mode == 2 ? sizeof(int64_t) : 0;
+    rbtree *t = new_rbtree_opts(&opts);
+    for (key_t key = 0; key <= 90; key++) {
+      if (mode == 2) rbtree_map_get_or_insert(t, key, NULL);
+      else rbtree_insert(t, key);
+    }
+    if (mode == 1) {
+      rbtree_insert(t, 0);
+      rbtree_insert(t, 90);
+    }
+
+    rbtree *snap = rbtree_snapshot(t);
+    if (mode == 0) {
+      rbtree_insert(t, 0);
+      rbtree_insert(t, 90);
+    } else if (mode == 1) {
+      assert(rbtree_erase_key(t, 0) == 1 && rbtree_erase_key(t, 90) == 1);
+    } else {
+      int inserted;
+      *(int64_t *)rbtree_map_get_or_insert(t, 0, &inserted) = 5;
+      assert(!inserted && rbtree_map_get_or_insert(t, 90, &inserted) != NULL && !inserted);
+    }
+    rbtree_snapshot_release(snap);
+    rbtree_reclaim(t);
+
+    // the old end nodes are gone now; the ends must be the current copies
+    assert(rbtree_min(t) == rbtree_find(t, 0) && rbtree_max(t) == rbtree_find(t, 90));
+    if (mode == 2) assert(*(int64_t *)rbtree_value(t, rbtree_min(t)) == 5);
+    key_t key;
+    assert(rbtree_pop_min(t, &key) && key == 0);
+    assert(rbtree_pop_max(t, &key) && key == 90);
+    assert(rbtree_size(t) == (mode == 0 ? 91 : 89));
+    delete_rbtree(t);
+  }
+}
+
+// contents of a tree without parent links (persistent trees) or with them
+static void check_contents(const rbtree *t, const key_t *expect, const size_t n) {
+  if (!t->persistent) {
+    check_moved(t, expect, n);
+    return;
+  }
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_size(t) == n && rbtree_to_array(t, res, n + 1) == n);
+  assert(memcmp(res, expect, n * sizeof(key_t)) == 0);
+  test_color_constraint(t);
+  free(res);
+}
+
+// pop_min/pop_max/pop_min_while take elements off the ends in order, in every tree mode
+void test_pop(const size_t n, const int range) {
+  key_t *arr = calloc(n, sizeof(key_t)), *out = calloc(n, sizeof(key_t));
+  for (int mode = 0; mode < 3; mode++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = mode == 1;
+    opts.persistent = mode == 2;
+    rbtree *t = new_rbtree_opts(&opts);
+    key_t key = -1;
+    assert(rbtree_pop_min(t, &key) == 0 && rbtree_pop_max(t, &key) == 0 && key == -1);
+    for (size_t i = 0; i < n; i++) {
+      arr[i] = rand() % range;
+      rbtree_insert(t, arr[i]);
+    }
+    qsort(arr, n, sizeof(key_t), comp);
+
+    // alternate ends; arr[lo, hi) is what should be left
+    size_t lo = 0, hi = n;
+    while (hi - lo > n / 2) {
+      if (rand() % 2) {
+        assert(rbtree_pop_min(t, &key) == 1 && key == arr[lo++]);
+      } else {
+        assert(rbtree_pop_max(t, &key) == 1 && key == arr[--hi]);
+      }
+      assert(rbtree_size(t) == hi - lo);
+      check_ends(t);
+      if ((hi - lo) % 97 == 0) check_contents(t, arr + lo, hi - lo);
+    }
+    check_contents(t, arr + lo, hi - lo);
+
+    // drain everything up to a limit, a few at a time
+    const key_t limit = arr[lo + (hi - lo) / 2];
+    size_t got;
+    while ((got = rbtree_pop_min_while(t, limit, out, 7)) > 0) {
+      assert(got <= 7);
+      for (size_t i = 0; i < got; i++) assert(out[i] == arr[lo++] && out[i] <= limit);
+    }
+    assert(lo == hi || arr[lo] > limit);
+    check_contents(t, arr + lo, hi - lo);
+    assert(rbtree_pop_min_while(t, limit, out, n) == 0);
+    assert(rbtree_pop_min_while(t, range, out, 0) == 0);
+
+    // the rest in one call, then the nodes get reused
+    assert(rbtree_pop_min_while(t, range, out, n) == hi - lo);
+    assert(memcmp(out, arr + lo, (hi - lo) * sizeof(key_t)) == 0);
+    assert(rbtree_size(t) == 0 && rbtree_min(t) == NULL && rbtree_max(t) == NULL);
+    for (size_t i = 0; i < n; i++) rbtree_insert(t, arr[i]);
+    check_contents(t, arr, n);
+    delete_rbtree(t);
+  }
+  free(out);
+  free(arr);
+}
+
+// removes every key in [lo, hi) (hi inclusive when upper) from a sorted array and returns the new length
+static size_t remove_between(key_t *arr, const size_t n, const key_t lo, const key_t hi, const int upper) {
+  size_t m = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (arr[i] < lo || arr[i] > hi || (!upper && arr[i] == hi)) arr[m++] = arr[i];
+  }
+  return m;
+}
+
+// erase_key, erase_all and erase_range (both the one-by-one path for short ranges and the
+// split-and-free path for long ones) in every tree mode
+void test_erase_range(const size_t n, const int range) {
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int mode = 0; mode < 4; mode++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = mode == 1;
+    opts.value_size = mode == 2 ? sizeof(int64_t) : 0;
+    opts.persistent = mode == 3;
+    rbtree *t = new_rbtree_opts(&opts);
+    for (size_t i = 0; i < n; i++) arr[i] = rand() % range;
+    qsort(arr, n, sizeof(key_t), comp);
+    size_t m = mode == 2 ? unique_sorted(arr, n) : n;
+    fill_set_tree(t, arr, m, 0);
+
+    assert(rbtree_erase_key(t, -1) == 0 && rbtree_erase_all(t, range) == 0);
+    assert(rbtree_erase_range(t, 5, 5) == 0 && rbtree_erase_range(t, 9, 2) == 0);
+    const key_t one = arr[m / 2];
+    assert(rbtree_erase_key(t, one) == 1);
+    for (size_t i = m / 2; i + 1 < m; i++) arr[i] = arr[i + 1];
+    m--;
+    check_contents(t, arr, m);
+
+    const key_t dup = arr[m / 3];
+    const size_t before = m;
+    m = remove_between(arr, m, dup, dup, 1);
+    assert(rbtree_erase_all(t, dup) == before - m && rbtree_find(t, dup) == NULL);
+    check_contents(t, arr, m);
+
+    // narrow and wide ranges, including ones past either end of the tree
+    while (rbtree_size(t) > n / 4) {
+      const int width = rand() % 4 == 0 ? range / 3 : rand() % 4 + 1;
+      const key_t lo = rand() % (range + 20) - 10, hi = lo + width;
+      const size_t kept = remove_between(arr, m, lo, hi, 0);
+      assert(rbtree_erase_range(t, lo, hi) == m - kept);
+      m = kept;
+      check_contents(t, arr, m);
+      check_ends(t);
+    }
+    assert(rbtree_erase_range(t, -10, range + 10) == m);
+    assert(rbtree_size(t) == 0 && rbtree_min(t) == NULL);
+    rbtree_insert(t, 1);
+    check_contents(t, (key_t[]){1}, 1);
+    delete_rbtree(t);
+  }
+  free(arr);
+}
+
+// batched lookups should give exactly what rbtree_find gives, key by key
+void test_find_batch(const size_t n, const int range) {
+  const size_t queries = 3 * n;
+  key_t *q = calloc(queries, sizeof(key_t));
+  node_t **out = calloc(queries, sizeof(node_t *));
+  unsigned char *flags = calloc(queries, 1);
+  for (int mode = 0; mode < 3; mode++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = mode == 1;
+    opts.persistent = mode == 2;
+    rbtree *t = new_rbtree_opts(&opts);
+    assert(rbtree_find_batch(t, q, 5, out) == 0 && out[4] == NULL);
+    for (size_t i = 0; i < n; i++) rbtree_insert(t, rand() % range);
+    for (size_t i = 0; i < queries; i++) q[i] = rand() % (range + range / 2) - range / 4;
+
+    // batch sizes below, at and above the number of searches kept in flight
+    const size_t sizes[] = {0, 1, 7, 16, 17, 100, queries};
+    for (int s = 0; s < 7; s++) {
+      memset(out, 0xff, queries * sizeof(node_t *));
+      memset(flags, 2, queries);
+      size_t expect = 0;
+      for (size_t i = 0; i < sizes[s]; i++) expect += rbtree_find(t, q[i]) != NULL;
+      assert(rbtree_find_batch(t, q, sizes[s], out) == expect);
+      assert(rbtree_contains_batch(t, q, sizes[s], flags) == expect);
+      for (size_t i = 0; i < sizes[s]; i++) {
+        assert(out[i] == rbtree_find(t, q[i]));
+        assert(flags[i] == (out[i] != NULL));
+      }
+      if (sizes[s] < queries) assert(flags[sizes[s]] == 2);
+    }
+    assert(rbtree_contains_batch(t, q, queries, NULL) == rbtree_find_batch(t, q, queries, out));
+
+    if (mode == 2) {
+      // a snapshot answers from its own version while the writer moves on
+      rbtree *snap = rbtree_snapshot(t);
+      const size_t before = rbtree_contains_batch(snap, q, queries, NULL);
+      for (size_t i = 0; i < n / 2; i++) rbtree_erase_all(t, q[i]);
+      assert(rbtree_contains_batch(snap, q, queries, NULL) == before);
+      assert(rbtree_find_batch(t, q, n / 2, out) == 0);
+      rbtree_snapshot_release(snap);
+    }
+    delete_rbtree(t);
+  }
+  free(flags);
+  free(out);
+  free(q);
+}
+
+// a frozen copy should answer find, lower_bound and range like the sorted contents of the tree
+void test_freeze(const size_t n, const int range) {
+  key_t *arr = calloc(n + 1, sizeof(key_t));
+  // sizes around one leaf block, one full internal node and several levels
+  const size_t sizes[] = {0, 1, 15, 16, 17, 272, 273, 300, n};
+  for (int mode = 0; mode < 3; mode++) {
+    for (int s = 0; s < 9; s++) {
+      const size_t m = sizes[s];
+      rbtree_options opts = {0};
+      opts.collapse_duplicates = mode == 1;
+      opts.persistent = mode == 2;
+      rbtree *t = new_rbtree_opts(&opts);
+      for (size_t i = 0; i < m; i++) arr[i] = rand() % range - range / 4;
+      if (m > 0 && mode == 0) arr[rand() % m] = INT32_MAX;   // the padding value may also be a real key
+      for (size_t i = 0; i < m; i++) rbtree_insert(t, arr[i]);
+      qsort(arr, m, sizeof(key_t), comp);
+
+      rbtree *src = mode == 2 ? rbtree_snapshot(t) : t;
+      rbtree_frozen *f = rbtree_freeze(src);
+      if (mode == 2) {
+        // later writes do not reach the frozen copy
+        rbtree_insert(t, 0);
+        rbtree_snapshot_release(src);
+      }
+      assert(f != NULL && f->n == m);
+      for (size_t i = 0; i < m; i++) assert(f->keys[i] == arr[i]);
+
+      size_t lb = 0;
+      for (int q = -range / 2; q < range + range / 4; q++) {
+        while (lb < m && arr[lb] < q) lb++;
+        assert(rbtree_frozen_lower_bound(f, q) == lb);
+        const ptrdiff_t found = rbtree_frozen_find(f, q);
+        assert(lb < m && arr[lb] == q ? found == (ptrdiff_t)lb : found == -1);
+
+        const key_t hi = q + rand() % 20;
+        size_t e = lb, first = 12345;
+        while (e < m && arr[e] < hi) e++;
+        assert(rbtree_frozen_range(f, q, hi, &first) == e - lb && first == lb);
+      }
+      assert(rbtree_frozen_lower_bound(f, INT32_MIN) == 0);
+      assert(rbtree_frozen_range(f, 5, 5, NULL) == 0 && rbtree_frozen_range(f, 9, 2, NULL) == 0);
+      if (m > 0 && mode == 0) {
+        assert(rbtree_frozen_find(f, INT32_MAX) == (ptrdiff_t)m - 1);
+        assert(rbtree_frozen_lower_bound(f, INT32_MAX) == m - 1);
+      }
+      delete_rbtree_frozen(f);
+      delete_rbtree(t);
+    }
+  }
+  free(arr);
+}
+
+// rbtree_find through the hash index must agree with a plain tree descent (lower_bound)
+static void check_hash_index(const rbtree *t, const int range) {
+  for (int q = -range / 4; q < range + range / 4; q++) {
+    const node_t *lb = rbtree_lower_bound(t, q), *f = rbtree_find(t, q);
+    if (lb == NULL || lb->key != q) {
+      assert(f == NULL);
+      continue;
+    }
+    // any of the equal nodes will do, as long as it is still in the tree
+    assert(f != NULL && f->key == q);
+    while (lb != f) {
+      lb = rbtree_next(t, lb);
+      assert(lb != NULL && lb->key == q);
+    }
+  }
+}
+
+// the key -> node index should follow every way nodes enter and leave a tree
+void test_hash_index(const size_t n, const int range) {
+  const int64_t one = 1;
+  for (int mode = 0; mode < 3; mode++) {
+    rbtree_options opts = {0};
+    opts.collapse_duplicates = mode == 1;
+    opts.value_size = mode == 2 ? sizeof(int64_t) : 0;
+    opts.hash_index = 1;
+    rbtree *t = new_rbtree_opts(&opts), *u = new_rbtree_opts(&opts);
+    assert(rbtree_find(t, 0) == NULL && rbtree_hash_index_memory(t) > 0);
+    for (size_t i = 0; i < n; i++) {
+      if (mode == 2) rbtree_map_put(t, rand() % range, &one);
+      else rbtree_insert(t, rand() % range);
+    }
+    check_hash_index(t, range);
+    const size_t before = rbtree_hash_index_memory(t);
+    assert(before > rbtree_hash_index_memory(u));
+
+    if (mode == 2) {
+      int inserted = -1;
+      const key_t k = rbtree_min(t)->key;
+      assert(rbtree_map_get_or_insert(t, k, &inserted) == rbtree_value(t, rbtree_find(t, k)) && !inserted);
+      assert(rbtree_map_get_or_insert(t, range + 1, &inserted) != NULL && inserted);
+      assert(rbtree_find(t, range + 1) != NULL);
+    }
+
+    // single erases, including duplicates that leave their siblings behind
+    for (size_t i = 0; i < n / 2; i++) rbtree_erase_key(t, rand() % range);
+    check_hash_index(t, range);
+    for (int i = 0; i < 50; i++) {
+      rbtree_pop_min(t, NULL);
+      rbtree_pop_max(t, NULL);
+    }
+    check_hash_index(t, range);
+    rbtree_erase_range(t, range / 4, range / 4 + range / 10);   // bulk path
+    rbtree_erase_range(t, range / 2, range / 2 + 3);             // one node at a time
+    rbtree_erase_all(t, rand() % range);
+    check_hash_index(t, range);
+
+    // moving nodes between trees rebuilds the index on both sides
+    for (size_t i = 0; i < n / 2; i++) rbtree_insert(u, rand() % range);
+    assert(rbtree_union(t, u) == 0);
+    assert(rbtree_size(u) == 0);
+    check_hash_index(u, range);
+    check_hash_index(t, range);
+    for (size_t i = 0; i < n / 4; i++) rbtree_insert(u, rand() % range);
+    assert(rbtree_difference(t, u) == 0);
+    check_hash_index(t, range);
+    for (size_t i = 0; i < n / 2; i++) rbtree_insert(u, rand() % range);
+    assert(rbtree_intersection(u, t) == 0);   // t comes back empty
+    check_hash_index(u, range);
+    check_hash_index(t, range);
+
+    rbtree *lo, *hi;
+    assert(rbtree_split(u, range / 2, &lo, &hi) == 0);
+    assert(rbtree_size(u) == 0);
+    check_hash_index(u, range);
+    assert(rbtree_hash_index_memory(lo) == 0 && rbtree_hash_index_enable(lo) == 0);
+    check_hash_index(lo, range);
+    assert(rbtree_concat(lo, hi) == 0);
+    check_hash_index(lo, range);
+
+    // switching the index off and on again keeps finds the same
+    rbtree_hash_index_disable(lo);
+    assert(rbtree_hash_index_memory(lo) == 0);
+    check_hash_index(lo, range);
+    assert(rbtree_hash_index_enable(lo) == 0 && rbtree_hash_index_enable(lo) == 0);
+    check_hash_index(lo, range);
+    rbtree_clear(lo);
+    check_hash_index(lo, range);
+    rbtree_insert(lo, 7);
+    assert(rbtree_find(lo, 7) != NULL);
+
+    assert(rbtree_hash_index_memory(t) > 0 && rbtree_hash_index_memory(u) > 0);
+    delete_rbtree(hi);
+    delete_rbtree(lo);
+    delete_rbtree(u);
+    delete_rbtree(t);
+  }
+
+  // path copying rewrites nodes on every update, so persistent trees cannot keep an index
+  rbtree_options opts = {0};
+  opts.persistent = 1;
+  opts.hash_index = 1;
+  assert(new_rbtree_opts(&opts) == NULL);
+  opts.hash_index = 0;
+  rbtree *t = new_rbtree_opts(&opts);
+  assert(rbtree_hash_index_enable(t) == -1 && rbtree_hash_index_memory(t) == 0);
+  delete_rbtree(t);
+}
+
+// counters should match what the fixups did, and the histograms should cover every node
+void test_stats(const size_t n, const int range) {
+#ifdef RBTREE_STATS
+  for (int persistent = 0; persistent < 2; persistent++) {
+    rbtree_options opts = {0};
+    opts.persistent = persistent;
+    rbtree *t = new_rbtree_opts(&opts);
+    key_t *arr = calloc(n, sizeof(key_t));
+    rbtree_stats s;
+    rbtree_stats_snapshot(t, &s);
+    assert(s.inserts == 0 && s.rotate_left + s.rotate_right == 0 && s.allocs == 0);
+
+    for (size_t i = 0; i < n; i++) {
+      arr[i] = rand() % range;
+      rbtree_insert(t, arr[i]);
+    }
+    rbtree_stats_snapshot(t, &s);
+    assert(s.inserts == n && s.allocs == n && s.frees == 0);
+    assert(s.insert_compares >= n - 1);
+    // case 2 and case 3 rotate once each; case 2 always goes on to case 3
+    assert(s.rotate_left + s.rotate_right == s.insert_fixup[1] + s.insert_fixup[2]);
+    assert(s.insert_fixup[1] <= s.insert_fixup[2] && s.insert_fixup[2] > 0);
+
+    size_t depth[64], black[64];
+    const int height = rbtree_depth_histogram(t, depth, black, 64);
+    size_t nodes = 0, blacks = 0;
+    int max_depth = 0;
+    for (int i = 0; i < 64; i++) {
+      nodes += depth[i];
+      blacks += black[i];
+      if (depth[i] > 0) max_depth = i;
+    }
+    assert(nodes == n && blacks == n && depth[0] == 1 && black[0] == 0);
+    assert(height == max_depth + 1 && (size_t)1 << (height / 2) <= n + 1);
+    assert(rbtree_depth_histogram(t, NULL, NULL, 64) == height);
+    assert(rbtree_depth_histogram(t, depth, NULL, 2) == height && depth[0] == 1 && depth[1] == n - 1);
+
+    rbtree_stats_reset(t);
+    for (size_t i = 0; i < n; i++) assert(rbtree_find(t, arr[i]) != NULL);
+    rbtree_stats_snapshot(t, &s);
+    assert(s.finds == n && s.find_compares >= n && s.find_compares <= n * height);
+    assert(s.inserts == 0 && s.allocs == 0);
+
+    rbtree_stats_reset(t);
+    for (size_t i = 0; i < n / 2; i++) assert(rbtree_erase_key(t, arr[i]) == 1);
+    rbtree_stats_snapshot(t, &s);
+    assert(s.frees == n / 2 && s.insert_fixup[0] == 0);
+    // case 1, case 3 and case 4 rotate once each
+    assert(s.rotate_left + s.rotate_right == s.erase_fixup[0] + s.erase_fixup[2] + s.erase_fixup[3]);
+    assert(s.erase_fixup[2] <= s.erase_fixup[3]);
+
+    rbtree_clear(t);
+    assert(rbtree_depth_histogram(t, depth, black, 64) == 0 && depth[0] == 0);
+    free(arr);
+    delete_rbtree(t);
+  }
+#endif
+}
+
+// black height of the subtree, or -1 if it breaks a color rule
+// (reentrant, unlike color_traverse, so reader threads can use it)
+static int black_height(const rbtree *t, const node_t *p) {
+  if (p == t->nil) return 0;
+  const node_t *l = rbtree_left(t, p), *r = rbtree_right(t, p);
+  if (rbtree_color(p) == RBTREE_RED &&
+      (rbtree_color(l) == RBTREE_RED || rbtree_color(r) == RBTREE_RED)) {
+    return -1;
+  }
+  const int hl = black_height(t, l), hr = black_height(t, r);
+  if (hl < 0 || hl != hr) return -1;
+  return hl + (rbtree_color(p) == RBTREE_BLACK);
+}
+
+// checks that a read-only tree holds exactly the sorted keys in expect
+static void check_version(const rbtree *t, const key_t *expect, const size_t n) {
+  assert(rbtree_size(t) == n);
+  key_t *res = calloc(n + 1, sizeof(key_t));
+  assert(rbtree_to_array(t, res, n) == n);
+  for (size_t i = 0; i < n; i++) {
+    assert(res[i] == expect[i]);
+    assert(rbtree_find(t, expect[i]) != NULL);
+  }
+  if (n > 0) {
+    collect_ctx c = {res, 0, n + 1};
+    assert(rbtree_foreach_range(t, expect[0], expect[n - 1], collect_key, &c) ==
+           n - rbtree_count(t, expect[n - 1]));
+    assert(rbtree_min(t)->key == expect[0] && rbtree_max(t)->key == expect[n - 1]);
+  }
+  assert(t->root == t->nil || rbtree_color(t->root) == RBTREE_BLACK);
+  assert(black_height(t, t->root) >= 0);
+  test_search_constraint(t);
+  free(res);
+}
+
+// persistent trees keep every snapshot intact while the writer moves on
+void test_persistent(const size_t n, const int range) {
+  rbtree_options opts = {0};
+  opts.persistent = 1;
+  rbtree *t = new_rbtree_opts(&opts);
+  rbtree *ref = new_rbtree();
+  enum { VERSIONS = 8 };
+  rbtree *snaps[VERSIONS];
+  key_t *expect[VERSIONS];
+  size_t sizes[VERSIONS];
+
+  for (int v = 0; v < VERSIONS; v++) {
+    for (int i = 0; i < n; i++) {
+      key_t key = rand() % range;
+      if (rand() % 3 == 0) {
+        assert(rbtree_erase_key(t, key) == rbtree_erase_key(ref, key));
+      } else {
+        assert(rbtree_insert(t, key)->key == key);
+        rbtree_insert(ref, key);
+      }
+    }
+    test_color_constraint(t);
+    test_search_constraint(t);
+#ifdef RBTREE_ORDER_STATISTICS
+    size_traverse(t, t->root, t->nil);
+#endif
+    sizes[v] = rbtree_size(ref);
+    expect[v] = calloc(sizes[v] + 1, sizeof(key_t));
+    rbtree_to_array(ref, expect[v], sizes[v]);
+    snaps[v] = rbtree_snapshot(t);
+    assert(snaps[v] != NULL);
+    // drop some versions early, out of order
+    if (v % 3 == 2) {
+      rbtree_snapshot_release(snaps[v - 1]);
+      snaps[v - 1] = NULL;
+    }
+  }
+  // batches fall back to single updates and still never touch snapshots
+  key_t batch[64];
+  for (int i = 0; i < 64; i++) {
+    batch[i] = rand() % range;
+  }
+  assert(rbtree_insert_batch(t, batch, 64) == 64);
+  insert_arr(ref, batch, 64);
+  assert(rbtree_erase_keys_batch(t, batch, 32) == rbtree_erase_keys_batch(ref, batch, 32));
+  if (rbtree_find(ref, batch[40]) != NULL) {
+    assert(rbtree_erase(t, rbtree_find(t, batch[40])) == 0);
+    rbtree_erase(ref, rbtree_find(ref, batch[40]));
+  }
+  // erasing through a node of an older version goes by key, and fails once the key is gone
+  if (sizes[VERSIONS - 1] > 0) {
+    node_t *stale = rbtree_find(snaps[VERSIONS - 1], expect[VERSIONS - 1][0]);
+    rbtree_erase_all(t, stale->key);
+    rbtree_erase_all(ref, stale->key);
+    assert(rbtree_erase(t, stale) == -1);
+  }
+
+  for (int v = 0; v < VERSIONS; v++) {
+    if (snaps[v] != NULL) check_version(snaps[v], expect[v], sizes[v]);
+  }
+  const size_t m = rbtree_size(ref);
+  key_t *cur = calloc(m + 1, sizeof(key_t));
+  rbtree_to_array(ref, cur, m);
+  check_version(t, cur, m);
+
+  // clearing keeps the nodes a snapshot still sees
+  rbtree *last = rbtree_snapshot(t);
+  rbtree_clear(t);
+  assert(rbtree_size(t) == 0 && rbtree_min(t) == NULL);
+  check_version(last, cur, m);
+  rbtree_insert(t, 7);
+  check_version(last, cur, m);
+  rbtree_snapshot_release(last);
+
+  size_t live = 1;
+  for (int v = 0; v < VERSIONS; v++) {
+    if (snaps[v] != NULL) {
+      rbtree_snapshot_release(snaps[v]);
+      live++;
+    }
+    free(expect[v]);
+  }
+  assert(rbtree_reclaim(t) == live);
+  assert(rbtree_reclaim(t) == 0);
+  assert(rbtree_size(t) == 1 && rbtree_find(t, 7) != NULL);
+
+  // map values are copied with their nodes, so a snapshot keeps old values
+  rbtree_options mopts = {0};
+  mopts.persistent = 1;
+  mopts.value_size = sizeof(int);
+  rbtree *map = new_rbtree_opts(&mopts);
+  for (int i = 0; i < 100; i++) {
+    rbtree_map_put(map, i, &i);
+  }
+  rbtree *before = rbtree_snapshot(map);
+  for (int i = 0; i < 100; i++) {
+    int doubled = 2 * i;
+    rbtree_map_put(map, i, &doubled);
+  }
+  rbtree_erase_key(map, 50);
+  for (int i = 0; i < 100; i++) {
+    assert(*(int *)rbtree_map_get(before, i) == i);
+    if (i != 50) assert(*(int *)rbtree_map_get(map, i) == 2 * i);
+  }
+  rbtree_snapshot_release(before);
+  delete_rbtree(map);
+
+  assert(rbtree_snapshot(ref) == NULL);
+  free(cur);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+typedef struct {
+  rbtree *snap;
+  const key_t *expect;
+  size_t n;
+} reader_arg;
+
+static void *snapshot_reader(void *arg) {
+  reader_arg *r = (reader_arg *)arg;
+  for (int round = 0; round < 20; round++) {
+    check_version(r->snap, r->expect, r->n);
+  }
+  rbtree_snapshot_release(r->snap);
+  return NULL;
+}
+
+// readers walk their snapshots on other threads while the writer keeps updating
+void test_persistent_threads(const size_t n, const int range) {
+  rbtree_options opts = {0};
+  opts.persistent = 1;
+  rbtree *t = new_rbtree_opts(&opts);
+  rbtree *ref = new_rbtree();
+  enum { READERS = 4 };
+  pthread_t th[READERS];
+  reader_arg args[READERS];
+  key_t *expect[READERS];
+
+  for (int r = 0; r < READERS; r++) {
+    for (int i = 0; i < n; i++) {
+      key_t key = rand() % range;
+      rbtree_insert(t, key);
+      rbtree_insert(ref, key);
+    }
+    const size_t m = rbtree_size(ref);
+    expect[r] = calloc(m + 1, sizeof(key_t));
+    rbtree_to_array(ref, expect[r], m);
+    args[r].snap = rbtree_snapshot(t);
+    args[r].expect = expect[r];
+    args[r].n = m;
+    assert(pthread_create(&th[r], NULL, snapshot_reader, &args[r]) == 0);
+    for (int i = 0; i < n; i++) {
+      key_t key = rand() % range;
+      rbtree_erase_key(t, key);
+      rbtree_erase_key(ref, key);
+    }
+  }
+  for (int i = 0; i < 4 * n; i++) {
+    key_t key = rand() % range;
+    if (i % 2) rbtree_insert(t, key);
+    else rbtree_erase_key(t, key);
+  }
+  for (int r = 0; r < READERS; r++) {
+    pthread_join(th[r], NULL);
+    free(expect[r]);
+  }
+  // updates reclaim released snapshots as they go; whatever is left goes now
+  rbtree_reclaim(t);
+  assert(t->versions == NULL);
+  test_color_constraint(t);
+  delete_rbtree(ref);
+  delete_rbtree(t);
+}
+
+typedef struct {
+  rbtree_rw *rw;
+  rbtree_sharded *sh;
+  key_t base;
+  size_t n;
+} concurrent_arg;
+
+// each worker owns keys base, base + 1, ..., inserts them all and erases the odd ones
+static void *concurrent_worker(void *arg) {
+  concurrent_arg *a = (concurrent_arg *)arg;
+  for (size_t i = 0; i < a->n; i++) {
+    assert(rbtree_rw_insert(a->rw, a->base + i));
+    assert(rbtree_sharded_insert(a->sh, a->base + i));
+  }
+  for (size_t i = 0; i < a->n; i++) {
+    assert(rbtree_rw_find(a->rw, a->base + i));
+    assert(rbtree_sharded_find(a->sh, a->base + i));
+    if (i % 2) {
+      assert(rbtree_rw_erase(a->rw, a->base + i));
+      assert(rbtree_sharded_erase(a->sh, a->base + i));
+    }
+  }
+  return NULL;
+}
+
+// scans the sharded tree while workers update it; every snapshot must be sorted
+static void *concurrent_scanner(void *arg) {
+  concurrent_arg *a = (concurrent_arg *)arg;
+  key_t *buf = calloc(a->n, sizeof(key_t));
+  for (int round = 0; round < 50; round++) {
+    size_t m = rbtree_sharded_to_array(a->sh, buf, a->n);
+    for (size_t i = 1; i < m; i++) {
+      assert(buf[i - 1] <= buf[i]);
+    }
+  }
+  free(buf);
+  return NULL;
+}
+
+// the locked front ends should end up with exactly the keys the workers kept
+void test_concurrent(const int threads, const size_t n) {
+  rbtree_rw *rw = new_rbtree_rw(NULL);
+  rbtree_sharded *sh = new_rbtree_sharded(7, 0, (key_t)(threads * n), NULL);
+  key_t k;
+  assert(!rbtree_rw_min(rw, &k) && !rbtree_sharded_max(sh, &k));
+
+  pthread_t th[16], scanner;
+  concurrent_arg args[16];
+  concurrent_arg scan = {rw, sh, 0, threads * n};
+  assert(pthread_create(&scanner, NULL, concurrent_scanner, &scan) == 0);
+  for (int i = 0; i < threads; i++) {
+    args[i] = (concurrent_arg){rw, sh, (key_t)(i * n), n};
+    assert(pthread_create(&th[i], NULL, concurrent_worker, &args[i]) == 0);
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(th[i], NULL);
+  }
+  pthread_join(scanner, NULL);
+
+  const size_t m = threads * n / 2;
+  assert(rbtree_rw_size(rw) == m && rbtree_sharded_size(sh) == m);
+  key_t *a = calloc(m, sizeof(key_t)), *b = calloc(m, sizeof(key_t));
+  assert(rbtree_rw_to_array(rw, a, m) == m);
+  assert(rbtree_sharded_to_array(sh, b, m) == m);
+  for (size_t i = 0; i < m; i++) {
+    assert(a[i] == (key_t)(2 * i) && b[i] == a[i]);
+  }
+  assert(rbtree_sharded_min(sh, &k) && k == 0);
+  assert(rbtree_sharded_max(sh, &k) && k == a[m - 1]);
+  assert(rbtree_rw_max(rw, &k) && k == a[m - 1]);
+
+  // keys outside the configured range go to the end shards
+  assert(rbtree_sharded_insert(sh, -5) && rbtree_sharded_insert(sh, 1 << 30));
+  assert(rbtree_sharded_min(sh, &k) && k == -5);
+  assert(rbtree_sharded_max(sh, &k) && k == 1 << 30);
+
+  // an empty or inverted range is rejected; more shards than keys in the range still keeps the order
+  assert(new_rbtree_sharded(4, 10, 10, NULL) == NULL && new_rbtree_sharded(4, 10, -10, NULL) == NULL);
+  rbtree_sharded *narrow = new_rbtree_sharded(8, 0, 3, NULL);
+  for (key_t key = 6; key >= -2; key--) assert(rbtree_sharded_insert(narrow, key));
+  key_t c[9];
+  assert(rbtree_sharded_to_array(narrow, c, 9) == 9);
+  for (int i = 0; i < 9; i++) assert(c[i] == i - 2);
+  for (key_t key = -2; key <= 6; key++) assert(rbtree_sharded_find(narrow, key));
+  delete_rbtree_sharded(narrow);
+
+  free(b);
+  free(a);
+  delete_rbtree_sharded(sh);
+  delete_rbtree_rw(rw);
+}
+
+// instantiations used by test_generic
+static inline int int_cmp(int a, int b) { return (a > b) - (a < b); }
+RBTREE_DEFINE(itree, int, int_cmp)
+
+static inline int i64_cmp(int64_t a, int64_t b) { return (a > b) - (a < b); }
+RBTREE_DEFINE(i64tree, int64_t, i64_cmp)
+
+typedef struct {
+  char s[12];
+} name_key;
+#define NAME_CMP(a, b) memcmp((a).s, (b).s, sizeof((a).s))
+RBTREE_DEFINE(nametree, name_key, NAME_CMP)
+
+typedef struct {
+  int major, minor;
+} pair_key;
+static inline int pair_cmp(pair_key a, pair_key b) {
+  if (a.major != b.major) return a.major < b.major ? -1 : 1;
+  return (a.minor > b.minor) - (a.minor < b.minor);
+}
+RBTREE_DEFINE(pairtree, pair_key, pair_cmp)
+
+static int str_cmp(const void *a, const void *b) { return strcmp(a, b); }
+
+// returns the black height of the subtree, asserting the red-black rules
+static int itree_check(const itree *t, const itree_node *p) {
+  if (p == t->nil) return 1;
+  if (p->color == RBTREE_RED) {
+    assert(p->left->color == RBTREE_BLACK && p->right->color == RBTREE_BLACK);
+  }
+  if (p->left != t->nil) assert(p->left->parent == p && p->left->key <= p->key);
+  if (p->right != t->nil) assert(p->right->parent == p && p->key <= p->right->key);
+  int h = itree_check(t, p->left);
+  assert(h == itree_check(t, p->right));
+  return h + (p->color == RBTREE_BLACK);
+}
+
+// generated trees should behave exactly like the int API
+void test_generic(const size_t n, const int range) {
+  // int instantiation against rbtree.c
+  rbtree *ref = new_rbtree();
+  itree *it = itree_new();
+  key_t *arr = calloc(n, sizeof(key_t));
+  for (int i = 0; i < n; i++) {
+    arr[i] = rand() % range;
+    rbtree_insert(ref, arr[i]);
+    assert(itree_insert(it, arr[i])->key == arr[i]);
+  }
+  assert(itree_size(it) == n);
+  assert(it->root->color == RBTREE_BLACK);
+  itree_check(it, it->root);
+  for (key_t key = -1; key <= range; key++) {
+    assert((itree_find(it, key) == NULL) == (rbtree_find(ref, key) == NULL));
+    node_t *lb = rbtree_lower_bound(ref, key), *ub = rbtree_upper_bound(ref, key);
+    itree_node *ilb = itree_lower_bound(it, key), *iub = itree_upper_bound(it, key);
+    assert(lb == NULL ? ilb == NULL : ilb->key == lb->key);
+    assert(ub == NULL ? iub == NULL : iub->key == ub->key);
+  }
+  for (int i = 0; i < n / 2; i++) {
+    assert(itree_erase_key(it, arr[i]) == 1);
+    rbtree_erase(ref, rbtree_find(ref, arr[i]));
+  }
+  assert(itree_erase_key(it, range + 1) == 0);
+  itree_check(it, it->root);
+
+  const size_t m = rbtree_size(ref);
+  key_t *res = calloc(m, sizeof(key_t));
+  key_t *res_ref = calloc(m, sizeof(key_t));
+  assert(itree_to_array(it, res, m) == m);
+  rbtree_to_array(ref, res_ref, m);
+  for (int i = 0; i < m; i++) {
+    assert(res[i] == res_ref[i]);
+  }
+  itree_node *p = itree_max(it);
+  for (int i = m - 1; i >= 0; i--, p = itree_prev(it, p)) {
+    assert(p->key == res[i]);
+  }
+  assert(p == NULL);
+  itree_clear(it);
+  assert(itree_size(it) == 0 && itree_min(it) == NULL);
+  itree_insert(it, 1);
+  assert(itree_find(it, 1) != NULL);
+  free(res_ref);
+  free(res);
+  itree_delete(it);
+  delete_rbtree(ref);
+
+  // 64-bit keys that do not fit in an int
+  i64tree *lt = i64tree_new();
+  for (int i = 0; i < n; i++) {
+    i64tree_insert(lt, ((int64_t)arr[i] << 40) + i);
+  }
+  int64_t prev = INT64_MIN;
+  for (i64tree_node *q = i64tree_min(lt); q != NULL; q = i64tree_next(lt, q)) {
+    assert(prev < q->key);
+    prev = q->key;
+  }
+  assert(i64tree_find(lt, ((int64_t)arr[0] << 40) + 0) != NULL);
+  assert(i64tree_find(lt, ((int64_t)arr[0] << 40) + n) == NULL);
+  i64tree_delete(lt);
+
+  // fixed-width byte strings
+  nametree *nt = nametree_new();
+  const char *names[] = {"kiwi", "apple", "mango", "banana", "cherry"};
+  for (int i = 0; i < 5; i++) {
+    name_key k = {{0}};
+    strcpy(k.s, names[i]);
+    nametree_insert(nt, k);
+  }
+  name_key sorted[5];
+  assert(nametree_to_array(nt, sorted, 5) == 5);
+  assert(strcmp(sorted[0].s, "apple") == 0 && strcmp(sorted[4].s, "mango") == 0);
+  name_key probe = {{0}};
+  strcpy(probe.s, "c");
+  assert(strcmp(nametree_lower_bound(nt, probe)->key.s, "cherry") == 0);
+  nametree_delete(nt);
+
+  // composite keys
+  pairtree *pt = pairtree_new();
+  for (int i = 0; i < n; i++) {
+    pair_key k = {arr[i] % 7, arr[i]};
+    pairtree_insert(pt, k);
+  }
+  pair_key last = {-1, 0};
+  for (pairtree_node *q = pairtree_min(pt); q != NULL; q = pairtree_next(pt, q)) {
+    assert(pair_cmp(last, q->key) <= 0);
+    last = q->key;
+  }
+  pairtree_delete(pt);
+
+  // void* keys with a runtime comparator
+  rbtree_any *at = rbtree_any_new(str_cmp);
+  for (int i = 0; i < 5; i++) {
+    rbtree_any_insert(at, names[i]);
+  }
+  assert(strcmp(rbtree_any_min(at)->key, "apple") == 0);
+  assert(rbtree_any_find(at, "mango") != NULL);
+  assert(rbtree_any_find(at, "pear") == NULL);
+  assert(rbtree_any_erase_key(at, "kiwi") == 1);
+  assert(rbtree_any_size(at) == 4);
+  assert(strcmp(rbtree_any_max(at)->key, "mango") == 0);
+  rbtree_any_delete(at);
+
+  free(arr);
+}
+
+// the generated tree and rbtree.c run the same random sequence of inserts and erases and must agree after every step
+void test_generic_ops(const size_t ops, const int range) {
+  rbtree *ref = new_rbtree();
+  itree *it = itree_new();
+  for (size_t i = 0; i < ops; i++) {
+    const key_t key = rand() % range;
+    if (rand() % 3 != 0) {
+      rbtree_insert(ref, key);
+      itree_insert(it, key);
+    } else {
+      node_t *p = rbtree_find(ref, key);
+      if (p != NULL) rbtree_erase(ref, p);
+      assert(itree_erase_key(it, key) == (p != NULL));
+    }
+    assert(itree_size(it) == rbtree_size(ref));
+    assert(it->root->color == RBTREE_BLACK && it->root->parent == it->nil);
+    const node_t *min = rbtree_min(ref), *max = rbtree_max(ref);
+    assert(min == NULL ? itree_min(it) == NULL : itree_min(it)->key == min->key);
+    assert(max == NULL ? itree_max(it) == NULL : itree_max(it)->key == max->key);
+    const key_t q = rand() % (range + 2) - 1;
+    const node_t *lb = rbtree_lower_bound(ref, q), *ub = rbtree_upper_bound(ref, q);
+    assert(lb == NULL ? itree_lower_bound(it, q) == NULL : itree_lower_bound(it, q)->key == lb->key);
+    assert(ub == NULL ? itree_upper_bound(it, q) == NULL : itree_upper_bound(it, q)->key == ub->key);
+
+    // full walk and red-black check now and then (each is O(n))
+    if (i % 64 == 0) {
+      itree_check(it, it->root);
+      const node_t *p = min;
+      for (itree_node *x = itree_min(it); x != NULL; x = itree_next(it, x), p = rbtree_next(ref, p)) {
+        assert(p != NULL && p->key == x->key);
+      }
+      assert(p == NULL);
+    }
+  }
+  itree_delete(it);
+  delete_rbtree(ref);
+}
+
 int main(void) {
   test_init();
   test_insert_single(1024);
@@ -380,6 +2272,53 @@ int main(void) {
   test_duplicate_values(); 
   test_multi_instance();
   test_find_erase_rand(10000, 17);
+  test_node_reuse();
+  test_capacity_hint(100, 1000);
+  test_capacity_hint(5000, 1000);
+  test_clear(1000);
+  test_next_prev(1000);
+  test_foreach_range();
+  test_bounds(1000, 50);
+  test_bounds(100, 1000);
+  test_bounds(3000, 3);
+  test_build_from_sorted_suite();
+  test_batch(1000, 300, 0);
+  test_batch(1000, 300, 1);
+  test_batch(500, 100000, 1);
+  test_order_statistics(1000, 100);
+  test_collapse_duplicates(2000, 50);
+  test_collapse_duplicates(2000, 5000);
+  test_generic(3000, 500);
+  test_generic_ops(20000, 300);
+  test_generic_ops(5000, 20);
+  test_map(5000, 700, sizeof(map_value));
+  test_map(2000, 300, 100);
+  test_persistent(2000, 500);
+  test_persistent(500, 20);
+  test_persistent_threads(3000, 1000);
+  test_concurrent(4, 5000);
+  test_set_ops(2000, 1500, 0);
+  test_set_ops(2000, 300, 1);
+  test_set_ops(2000, 3000, 2);
+  test_split_join(3000, 1000);
+  test_parallel(1, 3000, 1000);
+  test_parallel(4, 5000, 2000);
+  test_parallel(4, 3000, 50);
+  test_save_load(3000, 1000, 0);
+  test_save_load(3000, 100, 1);
+  test_save_load(3000, 5000, 2);
+  test_min_max_cache(3000, 500);
+  test_insert_hint(4000, 3000);
+  test_persistent_ends();
+  test_pop(3000, 1000);
+  test_pop(2000, 50);
+  test_erase_range(3000, 1000);
+  test_erase_range(3000, 40);
+  test_stats(3000, 1000);
+  test_find_batch(3000, 2000);
+  test_freeze(6000, 3000);
+  test_hash_index(3000, 1000);
+  test_hash_index(3000, 40);
   printf("Passed all tests!\n");
 }
 